@@ -0,0 +1,328 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "../fixed/fixed.h"
+#include "../mem-utils/mem-macros.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif
+
+#include "bench.h"
+
+#define ARRAY_LENGTH 4096
+
+static volatile double result_sink;
+
+static void bench_scalar(struct BenchReport *report, struct BenchConfig *config);
+static void bench_trig(struct BenchReport *report, struct BenchConfig *config);
+static void bench_arrays(struct BenchReport *report, struct BenchConfig *config);
+static void double_add_array(double *out, const double *a, const double *b, size_t count);
+static void double_scale_array(double *out, const double *values, double scale, size_t count);
+
+/* Per-operation cost of the fixed-point library against plain doubles */
+void bench_fixed_suite(struct BenchReport *report, struct BenchConfig *config)
+{
+	bench_scalar(report, config);
+	bench_trig(report, config);
+	bench_arrays(report, config);
+}
+
+/* Each loop is one dependency chain, so these are latencies rather than throughputs */
+static void bench_scalar(struct BenchReport *report, struct BenchConfig *config)
+{
+	uint32_t op_count = config->quick ? 2000000 : 20000000;
+	uint32_t divide_count = op_count / 10;
+
+	// Derived from the seed so the compiler can't fold the chains away
+	double start = 1 + (config->seed % 1000) * 1e-6;
+	double factor = 1 + 1e-8;
+
+	struct Fixed64 fixed_start = fixed64_from_double(start);
+	struct Fixed64 fixed_step = fixed64_from_double(factor - 1);
+	struct Fixed64 fixed_factor = fixed64_from_double(factor);
+
+	uint64_t start_ns;
+	double fixed_ns[5], double_ns[5];
+
+	struct Fixed64 fixed_value = fixed_start;
+	start_ns = bench_now_ns();
+	for (uint32_t op = 0; op < op_count; op++) {
+		fixed_value = fixed64_add(fixed_value, fixed_step);
+		BENCH_OPAQUE(fixed_value.as_int);
+	}
+	fixed_ns[0] = (double) (bench_now_ns() - start_ns) / op_count;
+	result_sink = fixed64_to_double(fixed_value);
+
+	fixed_value = fixed_start;
+	start_ns = bench_now_ns();
+	for (uint32_t op = 0; op < op_count; op++) {
+		fixed_value = fixed64_multiply(fixed_value, fixed_factor);
+		BENCH_OPAQUE(fixed_value.as_int);
+	}
+	fixed_ns[1] = (double) (bench_now_ns() - start_ns) / op_count;
+	result_sink = fixed64_to_double(fixed_value);
+
+	fixed_value = fixed_start;
+	start_ns = bench_now_ns();
+	for (uint32_t op = 0; op < divide_count; op++) {
+		fixed_value = fixed64_divide(fixed_value, fixed_factor);
+		BENCH_OPAQUE(fixed_value.as_int);
+	}
+	fixed_ns[2] = (double) (bench_now_ns() - start_ns) / divide_count;
+	result_sink = fixed64_to_double(fixed_value);
+
+	// Square roots are independent here, since chaining them would converge on 1
+	struct Fixed64 fixed_root_sum = { 0 };
+	start_ns = bench_now_ns();
+	for (uint32_t op = 0; op < op_count; op++) {
+		struct Fixed64 input = { .as_int = fixed_start.as_int + op };
+		BENCH_OPAQUE(input.as_int);
+		fixed_root_sum = fixed64_add(fixed_root_sum, fixed64_sqrt(input));
+	}
+	fixed_ns[3] = (double) (bench_now_ns() - start_ns) / op_count;
+	result_sink = fixed64_to_double(fixed_root_sum);
+
+	fixed_value = fixed_start;
+	start_ns = bench_now_ns();
+	for (uint32_t op = 0; op < divide_count; op++) {
+		fixed_value = fixed64_reciprocal(fixed_value);
+		BENCH_OPAQUE(fixed_value.as_int);
+	}
+	fixed_ns[4] = (double) (bench_now_ns() - start_ns) / divide_count;
+	result_sink = fixed64_to_double(fixed_value);
+
+	double double_value = start;
+	double double_step = factor - 1;
+	start_ns = bench_now_ns();
+	for (uint32_t op = 0; op < op_count; op++) {
+		double_value += double_step;
+	}
+	double_ns[0] = (double) (bench_now_ns() - start_ns) / op_count;
+	result_sink = double_value;
+
+	double_value = start;
+	start_ns = bench_now_ns();
+	for (uint32_t op = 0; op < op_count; op++) {
+		double_value *= factor;
+	}
+	double_ns[1] = (double) (bench_now_ns() - start_ns) / op_count;
+	result_sink = double_value;
+
+	double_value = start;
+	start_ns = bench_now_ns();
+	for (uint32_t op = 0; op < divide_count; op++) {
+		double_value /= factor;
+	}
+	double_ns[2] = (double) (bench_now_ns() - start_ns) / divide_count;
+	result_sink = double_value;
+
+	double double_root_sum = 0;
+	start_ns = bench_now_ns();
+	for (uint32_t op = 0; op < op_count; op++) {
+		double_root_sum += sqrt(start + op * 1e-9);
+	}
+	double_ns[3] = (double) (bench_now_ns() - start_ns) / op_count;
+	result_sink = double_root_sum;
+
+	double_value = start;
+	start_ns = bench_now_ns();
+	for (uint32_t op = 0; op < divide_count; op++) {
+		double_value = 1 / double_value;
+	}
+	double_ns[4] = (double) (bench_now_ns() - start_ns) / divide_count;
+	result_sink = double_value;
+
+	struct BenchResult *result = bench_report_add_result(report, "fixed64-scalar");
+	bench_result_add_metric(result, "add_ns", fixed_ns[0], BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "multiply_ns", fixed_ns[1], BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "divide_ns", fixed_ns[2], BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "sqrt_ns", fixed_ns[3], BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "reciprocal_ns", fixed_ns[4], BENCH_LOWER_IS_BETTER);
+
+	result = bench_report_add_result(report, "double-scalar");
+	bench_result_add_metric(result, "add_ns", double_ns[0], BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "multiply_ns", double_ns[1], BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "divide_ns", double_ns[2], BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "sqrt_ns", double_ns[3], BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "reciprocal_ns", double_ns[4], BENCH_LOWER_IS_BETTER);
+}
+
+/* Binary angle tables against libm, over angles and ratios spread across their whole ranges */
+static void bench_trig(struct BenchReport *report, struct BenchConfig *config)
+{
+	uint32_t op_count = config->quick ? 2000000 : 20000000;
+	uint32_t angle_step = 0x9e3779b9 + (uint32_t) config->seed * 2; // odd, so it visits every angle
+	double radian_step = binary_angle_to_radians((struct BinaryAngle) { angle_step });
+
+	uint64_t start_ns;
+	double binary_angle_ns[2], libm_ns[2];
+
+	struct BinaryAngle angle = { 0 };
+	int64_t fixed_sum = 0;
+	start_ns = bench_now_ns();
+	for (uint32_t op = 0; op < op_count; op++) {
+		struct Fixed64 sin, cos;
+		binary_angle_sin_cos(angle, &sin, &cos);
+		fixed_sum += sin.as_int + cos.as_int;
+		angle.as_uint += angle_step;
+		BENCH_OPAQUE(angle.as_uint);
+	}
+	binary_angle_ns[0] = (double) (bench_now_ns() - start_ns) / op_count;
+	result_sink = fixed_sum;
+
+	uint32_t angle_sum = 0;
+	start_ns = bench_now_ns();
+	for (uint32_t op = 0; op < op_count; op++) {
+		struct Fixed64 ratio = { .as_int = (int64_t) (op * 2654435761U) - INT32_MAX }; // in [-0.5, 0.5]
+		BENCH_OPAQUE(ratio.as_int);
+		angle_sum += binary_angle_atan(ratio).as_uint;
+	}
+	binary_angle_ns[1] = (double) (bench_now_ns() - start_ns) / op_count;
+	result_sink = angle_sum;
+
+	double radians = 0;
+	double double_sum = 0;
+	start_ns = bench_now_ns();
+	for (uint32_t op = 0; op < op_count; op++) {
+		double_sum += sin(radians) + cos(radians);
+		radians += radian_step;
+		if (radians >= 6.28318530717958647692) {
+			radians -= 6.28318530717958647692;
+		}
+		BENCH_OPAQUE(radians);
+	}
+	libm_ns[0] = (double) (bench_now_ns() - start_ns) / op_count;
+	result_sink = double_sum;
+
+	double_sum = 0;
+	start_ns = bench_now_ns();
+	for (uint32_t op = 0; op < op_count; op++) {
+		double ratio = ((int64_t) (op * 2654435761U) - INT32_MAX) / 4294967296.0;
+		BENCH_OPAQUE(ratio);
+		double_sum += atan(ratio);
+	}
+	libm_ns[1] = (double) (bench_now_ns() - start_ns) / op_count;
+	result_sink = double_sum;
+
+	struct BenchResult *result = bench_report_add_result(report, "binary-angle-trig");
+	bench_result_add_metric(result, "sin_cos_ns", binary_angle_ns[0], BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "atan_ns", binary_angle_ns[1], BENCH_LOWER_IS_BETTER);
+
+	result = bench_report_add_result(report, "libm-trig");
+	bench_result_add_metric(result, "sin_cos_ns", libm_ns[0], BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "atan_ns", libm_ns[1], BENCH_LOWER_IS_BETTER);
+}
+
+static void bench_arrays(struct BenchReport *report, struct BenchConfig *config)
+{
+	uint32_t pass_count = config->quick ? 2000 : 20000;
+	double element_count = (double) pass_count * ARRAY_LENGTH;
+
+	struct Fixed64 *fixed_a = ALLOC_ARR(fixed_a, ARRAY_LENGTH);
+	struct Fixed64 *fixed_b = ALLOC_ARR(fixed_b, ARRAY_LENGTH);
+	struct Fixed64 *fixed_out = ALLOC_ARR(fixed_out, ARRAY_LENGTH);
+	struct Fixed32 *fixed32_a = ALLOC_ARR(fixed32_a, ARRAY_LENGTH);
+	struct Fixed32 *fixed32_b = ALLOC_ARR(fixed32_b, ARRAY_LENGTH);
+	struct Fixed32 *fixed32_out = ALLOC_ARR(fixed32_out, ARRAY_LENGTH);
+	double *double_a = ALLOC_ARR(double_a, ARRAY_LENGTH);
+	double *double_b = ALLOC_ARR(double_b, ARRAY_LENGTH);
+	double *double_out = ALLOC_ARR(double_out, ARRAY_LENGTH);
+
+	for (uint32_t index = 0; index < ARRAY_LENGTH; index++) {
+		double a = (index % 97) * 0.25 + config->seed % 7;
+		double b = (index % 31) * 0.125;
+
+		fixed_a[index] = fixed64_from_double(a);
+		fixed_b[index] = fixed64_from_double(b);
+		fixed32_a[index] = fixed32_from_double(a);
+		fixed32_b[index] = fixed32_from_double(b);
+		double_a[index] = a;
+		double_b[index] = b;
+	}
+
+	struct Fixed64 fixed_scale = fixed64_from_double(0.75);
+	struct Fixed32 fixed32_scale = fixed32_from_double(0.75);
+	uint64_t start_ns;
+	double ns[6];
+
+	start_ns = bench_now_ns();
+	for (uint32_t pass = 0; pass < pass_count; pass++) {
+		fixed64_add_array(fixed_out, fixed_a, fixed_b, ARRAY_LENGTH);
+		fixed_a[pass % ARRAY_LENGTH] = fixed_out[(pass * 7) % ARRAY_LENGTH];
+	}
+	ns[0] = (bench_now_ns() - start_ns) / element_count;
+
+	start_ns = bench_now_ns();
+	for (uint32_t pass = 0; pass < pass_count; pass++) {
+		fixed64_scale_array(fixed_out, fixed_a, fixed_scale, ARRAY_LENGTH);
+		fixed_a[pass % ARRAY_LENGTH] = fixed_out[(pass * 7) % ARRAY_LENGTH];
+	}
+	ns[1] = (bench_now_ns() - start_ns) / element_count;
+
+	start_ns = bench_now_ns();
+	for (uint32_t pass = 0; pass < pass_count; pass++) {
+		fixed32_add_array(fixed32_out, fixed32_a, fixed32_b, ARRAY_LENGTH);
+		fixed32_a[pass % ARRAY_LENGTH] = fixed32_out[(pass * 7) % ARRAY_LENGTH];
+	}
+	ns[2] = (bench_now_ns() - start_ns) / element_count;
+
+	start_ns = bench_now_ns();
+	for (uint32_t pass = 0; pass < pass_count; pass++) {
+		fixed32_scale_array(fixed32_out, fixed32_a, fixed32_scale, ARRAY_LENGTH);
+		fixed32_a[pass % ARRAY_LENGTH] = fixed32_out[(pass * 7) % ARRAY_LENGTH];
+	}
+	ns[3] = (bench_now_ns() - start_ns) / element_count;
+
+	start_ns = bench_now_ns();
+	for (uint32_t pass = 0; pass < pass_count; pass++) {
+		double_add_array(double_out, double_a, double_b, ARRAY_LENGTH);
+		double_a[pass % ARRAY_LENGTH] = double_out[(pass * 7) % ARRAY_LENGTH];
+	}
+	ns[4] = (bench_now_ns() - start_ns) / element_count;
+
+	start_ns = bench_now_ns();
+	for (uint32_t pass = 0; pass < pass_count; pass++) {
+		double_scale_array(double_out, double_a, 0.75, ARRAY_LENGTH);
+		double_a[pass % ARRAY_LENGTH] = double_out[(pass * 7) % ARRAY_LENGTH];
+	}
+	ns[5] = (bench_now_ns() - start_ns) / element_count;
+
+	result_sink = fixed64_to_double(fixed_out[1]) + fixed32_to_double(fixed32_out[1]) + double_out[1];
+
+	struct BenchResult *result = bench_report_add_result(report, "fixed64-array");
+	bench_result_add_metric(result, "add_ns_per_element", ns[0], BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "scale_ns_per_element", ns[1], BENCH_LOWER_IS_BETTER);
+
+	result = bench_report_add_result(report, "fixed32-array");
+	bench_result_add_metric(result, "add_ns_per_element", ns[2], BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "scale_ns_per_element", ns[3], BENCH_LOWER_IS_BETTER);
+
+	result = bench_report_add_result(report, "double-array");
+	bench_result_add_metric(result, "add_ns_per_element", ns[4], BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "scale_ns_per_element", ns[5], BENCH_LOWER_IS_BETTER);
+
+	free(fixed_a);
+	free(fixed_b);
+	free(fixed_out);
+	free(fixed32_a);
+	free(fixed32_b);
+	free(fixed32_out);
+	free(double_a);
+	free(double_b);
+	free(double_out);
+}
+
+static void double_add_array(double *out, const double *a, const double *b, size_t count)
+{
+	for (size_t index = 0; index < count; index++) {
+		out[index] = a[index] + b[index];
+	}
+}
+
+static void double_scale_array(double *out, const double *values, double scale, size_t count)
+{
+	for (size_t index = 0; index < count; index++) {
+		out[index] = values[index] * scale;
+	}
+}
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../flow-field/flow-field.h"
+#include "../mem-utils/mem-macros.h"
+#include "../raycast-engine/raycast-engine.h"
+#include "../rng/rng.h"
+#include "../scene/scene.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif // MEM_DEBUG
+
+#include "bench.h"
+
+#define BENCH_FLOW_FIELD_AGENTS 4096
+
+static volatile uint64_t distance_sink;
+
+struct Agent {
+	uint32_t x;
+	uint32_t y;
+};
+
+static void bench_flow_field_build(struct BenchReport *report, struct FlowField *field, uint32_t size,
+		uint32_t build_count);
+static void bench_flow_field_move(struct BenchReport *report, struct BenchConfig *config, struct FlowField *field,
+		uint32_t size, uint32_t move_count);
+static void bench_flow_field_agents(struct BenchReport *report, struct BenchConfig *config, struct FlowField *field,
+		uint32_t size, uint32_t frame_count);
+static void step_target(struct FlowField *field, struct Rng *rng, uint32_t *p_x, uint32_t *p_y);
+static void step(enum FlowFieldDirection direction, uint32_t *p_x, uint32_t *p_y);
+
+/* Pathfinding toward a moving target over the scene's maze, for a crowd of agents */
+void bench_flow_field_suite(struct BenchReport *report, struct BenchConfig *config)
+{
+	uint32_t size = config->quick ? 256 : 1024;
+
+	struct REMap *map = scene_create_maze_map(size, size, config->seed);
+	struct FlowField *field = flow_field_create(map, WALL_NONE);
+	if (field == NULL) {
+		fprintf(stderr, "raycast-bench: could not create a flow field, skipping flow-field\n");
+		re_map_destroy(map);
+		return;
+	}
+
+	bench_flow_field_build(report, field, size, config->quick ? 4 : 8);
+	bench_flow_field_move(report, config, field, size, config->quick ? 2000 : 20000);
+	bench_flow_field_agents(report, config, field, size, config->quick ? 200 : 2000);
+
+	flow_field_destroy(field);
+	re_map_destroy(map);
+}
+
+static void bench_flow_field_build(struct BenchReport *report, struct FlowField *field, uint32_t size,
+		uint32_t build_count)
+{
+	uint64_t cell_count = (uint64_t) size * size;
+
+	uint64_t start_ns = bench_now_ns();
+	for (uint32_t build = 0; build < build_count; build++) {
+		flow_field_set_target(field, (build * 37) % size, (build * 61) % size);
+	}
+	uint64_t elapsed_ns = bench_now_ns() - start_ns;
+	distance_sink = flow_field_get_distance(field, 0, 0);
+
+	char name[BENCH_NAME_SIZE];
+	snprintf(name, sizeof name, "flow-field-build-%u", size);
+
+	struct BenchResult *result = bench_report_add_result(report, name);
+	bench_result_add_metric(result, "build_ms", elapsed_ns / 1e6 / build_count, BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "cells_per_sec", cell_count * build_count / (elapsed_ns / 1e9),
+			BENCH_HIGHER_IS_BETTER);
+	bench_result_add_metric(result, "cells", cell_count, BENCH_INFORMATIONAL);
+}
+
+/* The target wanders a cell at a time, as a player would */
+static void bench_flow_field_move(struct BenchReport *report, struct BenchConfig *config, struct FlowField *field,
+		uint32_t size, uint32_t move_count)
+{
+	struct Rng rng;
+	rng_init(&rng, config->seed, 1);
+
+	uint32_t target_x = size / 2, target_y = size / 2;
+	flow_field_set_target(field, target_x, target_y);
+
+	uint64_t cells_updated = 0;
+	uint64_t start_ns = bench_now_ns();
+	for (uint32_t move = 0; move < move_count; move++) {
+		step_target(field, &rng, &target_x, &target_y);
+		cells_updated += field->cells_updated;
+	}
+	uint64_t elapsed_ns = bench_now_ns() - start_ns;
+	distance_sink = flow_field_get_distance(field, 0, 0);
+
+	char name[BENCH_NAME_SIZE];
+	snprintf(name, sizeof name, "flow-field-move-%u", size);
+
+	struct BenchResult *result = bench_report_add_result(report, name);
+	bench_result_add_metric(result, "us_per_move", elapsed_ns / 1e3 / move_count, BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "cells_updated_per_move", (double) cells_updated / move_count,
+			BENCH_INFORMATIONAL);
+}
+
+/* Each frame the target moves a cell and every agent steps toward it; agents that arrive start again elsewhere */
+static void bench_flow_field_agents(struct BenchReport *report, struct BenchConfig *config, struct FlowField *field,
+		uint32_t size, uint32_t frame_count)
+{
+	struct Rng rng;
+	rng_init(&rng, config->seed, 2);
+
+	uint32_t target_x = size / 2, target_y = size / 2;
+	flow_field_set_target(field, target_x, target_y);
+
+	struct Agent *agents = ALLOC_ARR(agents, BENCH_FLOW_FIELD_AGENTS);
+	for (uint32_t index = 0; index < BENCH_FLOW_FIELD_AGENTS; index++) {
+		agents[index] = (struct Agent) { rng_below(&rng, size), rng_below(&rng, size) };
+	}
+
+	uint64_t arrivals = 0;
+	uint64_t start_ns = bench_now_ns();
+	for (uint32_t frame = 0; frame < frame_count; frame++) {
+		step_target(field, &rng, &target_x, &target_y);
+
+		for (uint32_t index = 0; index < BENCH_FLOW_FIELD_AGENTS; index++) {
+			struct Agent *agent = &agents[index];
+			enum FlowFieldDirection direction = flow_field_get_direction(field, agent->x, agent->y);
+
+			if (direction == FLOW_FIELD_NONE) {
+				arrivals++;
+				agent->x = rng_below(&rng, size);
+				agent->y = rng_below(&rng, size);
+			} else {
+				step(direction, &agent->x, &agent->y);
+			}
+		}
+	}
+	uint64_t elapsed_ns = bench_now_ns() - start_ns;
+
+	char name[BENCH_NAME_SIZE];
+	snprintf(name, sizeof name, "flow-field-agents-%u", size);
+
+	struct BenchResult *result = bench_report_add_result(report, name);
+	bench_result_add_metric(result, "agent_steps_per_sec",
+			(double) BENCH_FLOW_FIELD_AGENTS * frame_count / (elapsed_ns / 1e9), BENCH_HIGHER_IS_BETTER);
+	bench_result_add_metric(result, "us_per_frame", elapsed_ns / 1e3 / frame_count, BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "agents", BENCH_FLOW_FIELD_AGENTS, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "arrivals", arrivals, BENCH_INFORMATIONAL);
+
+	free(agents);
+}
+
+/* Through a random open side; a maze cell always has one */
+static void step_target(struct FlowField *field, struct Rng *rng, uint32_t *p_x, uint32_t *p_y)
+{
+	enum FlowFieldDirection direction;
+	do {
+		direction = FLOW_FIELD_RIGHT + rng_below(rng, 4);
+	} while (!flow_field_is_open(field, *p_x, *p_y, direction));
+
+	step(direction, p_x, p_y);
+	flow_field_move_target(field, *p_x, *p_y);
+}
+
+static void step(enum FlowFieldDirection direction, uint32_t *p_x, uint32_t *p_y)
+{
+	switch (direction) {
+	case FLOW_FIELD_RIGHT:
+		(*p_x)++;
+		break;
+	case FLOW_FIELD_UP:
+		(*p_y)++;
+		break;
+	case FLOW_FIELD_LEFT:
+		(*p_x)--;
+		break;
+	case FLOW_FIELD_DOWN:
+		(*p_y)--;
+		break;
+	default:
+		break;
+	}
+}
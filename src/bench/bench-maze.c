@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../maze-gen/maze-gen.h"
+#include "../mem-utils/mem-macros.h"
+#include "../rng/rng.h"
+#include "../scene/scene.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif
+
+#include "bench.h"
+
+static volatile uint64_t wall_sink;
+
+static void bench_maze_generate(struct BenchReport *report, struct BenchConfig *config, uint32_t size);
+static void bench_maze_packed_generate(struct BenchReport *report, struct BenchConfig *config, uint32_t size);
+static void bench_maze_tiled_generate(struct BenchReport *report, struct BenchConfig *config, uint32_t size,
+		uint32_t thread_count);
+static void bench_maze_stream(struct BenchReport *report, struct BenchConfig *config, uint32_t width,
+		uint32_t row_count);
+static void bench_maze_stream_file(struct BenchReport *report, struct BenchConfig *config, uint32_t width,
+		uint32_t row_count);
+
+/* Generation throughput of the byte-per-cell maze against the bit-packed one */
+void bench_maze_suite(struct BenchReport *report, struct BenchConfig *config)
+{
+	uint32_t size = config->quick ? 1024 : 2048;
+
+	bench_maze_generate(report, config, size);
+	bench_maze_packed_generate(report, config, size);
+
+	// Tiled on one thread shows the cost of tiling itself; on every core, the scaling
+	bench_maze_tiled_generate(report, config, size, 1);
+	bench_maze_tiled_generate(report, config, size, 0);
+
+	bench_maze_stream(report, config, size, size);
+	bench_maze_stream_file(report, config, size, size);
+
+	// Too big for the unpacked maze's position stack to be comfortable
+	if (!config->quick) {
+		bench_maze_packed_generate(report, config, 8192);
+		bench_maze_tiled_generate(report, config, 8192, 0);
+		bench_maze_stream(report, config, 8192, 8192);
+	}
+}
+
+static void bench_maze_generate(struct BenchReport *report, struct BenchConfig *config, uint32_t size)
+{
+	uint64_t cell_count = (uint64_t) size * size;
+
+	srand(config->seed);
+	uint64_t start_ns = bench_now_ns();
+	struct Maze *maze = maze_create(size, size);
+	maze_generate(maze);
+	uint64_t elapsed_ns = bench_now_ns() - start_ns;
+	wall_sink = maze_has_wall(maze, size / 2, size / 2, MAZE_WALL_TOP);
+
+	char name[BENCH_NAME_SIZE];
+	snprintf(name, sizeof name, "maze-generate-%u", size);
+
+	struct BenchResult *result = bench_report_add_result(report, name);
+	bench_result_add_metric(result, "cells_per_sec", cell_count / (elapsed_ns / 1e9), BENCH_HIGHER_IS_BETTER);
+	bench_result_add_metric(result, "cells", cell_count, BENCH_INFORMATIONAL);
+
+	maze_destroy(maze);
+}
+
+static void bench_maze_packed_generate(struct BenchReport *report, struct BenchConfig *config, uint32_t size)
+{
+	uint64_t cell_count = (uint64_t) size * size;
+
+	struct Rng rng;
+	rng_init(&rng, config->seed, 0);
+	uint64_t start_ns = bench_now_ns();
+	struct PackedMaze *maze = maze_packed_create(size, size);
+	maze_packed_generate(maze, &rng);
+	uint64_t elapsed_ns = bench_now_ns() - start_ns;
+	wall_sink = maze_packed_has_wall(maze, size / 2, size / 2, MAZE_WALL_TOP);
+
+	char name[BENCH_NAME_SIZE];
+	snprintf(name, sizeof name, "maze-packed-%u", size);
+
+	struct BenchResult *result = bench_report_add_result(report, name);
+	bench_result_add_metric(result, "cells_per_sec", cell_count / (elapsed_ns / 1e9), BENCH_HIGHER_IS_BETTER);
+	bench_result_add_metric(result, "cells", cell_count, BENCH_INFORMATIONAL);
+
+	maze_packed_destroy(maze);
+}
+
+/*
+ * A thread_count of 0 uses every online core. The name says only which of the two it is, so results compare
+ * across machines with different core counts
+ */
+static void bench_maze_tiled_generate(struct BenchReport *report, struct BenchConfig *config, uint32_t size,
+		uint32_t thread_count)
+{
+	uint64_t cell_count = (uint64_t) size * size;
+	long core_count = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t used_thread_count = (thread_count > 0) ? thread_count : (core_count > 0) ? (uint32_t) core_count : 1;
+
+	uint64_t start_ns = bench_now_ns();
+	struct PackedMaze *maze = maze_packed_create(size, size);
+	maze_packed_generate_tiled(maze, config->seed, thread_count);
+	uint64_t elapsed_ns = bench_now_ns() - start_ns;
+	wall_sink = maze_packed_has_wall(maze, size / 2, size / 2, MAZE_WALL_TOP);
+
+	char name[BENCH_NAME_SIZE];
+	snprintf(name, sizeof name, "maze-tiled-%u%s", size, (thread_count == 1) ? "" : "-all-cores");
+
+	struct BenchResult *result = bench_report_add_result(report, name);
+	bench_result_add_metric(result, "cells_per_sec", cell_count / (elapsed_ns / 1e9), BENCH_HIGHER_IS_BETTER);
+	bench_result_add_metric(result, "cells", cell_count, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "threads", used_thread_count, BENCH_INFORMATIONAL);
+
+	maze_packed_destroy(maze);
+}
+
+/* Rows go to one scratch row and are dropped, so this is the stream alone */
+static void bench_maze_stream(struct BenchReport *report, struct BenchConfig *config, uint32_t width,
+		uint32_t row_count)
+{
+	uint64_t cell_count = (uint64_t) width * row_count;
+
+	uint64_t start_ns = bench_now_ns();
+	struct MazeRowStream *stream = maze_row_stream_create(width, config->seed);
+	uint64_t *right_walls = ALLOC_ARR(right_walls, stream->row_words);
+	uint64_t *bottom_walls = ALLOC_ARR(bottom_walls, stream->row_words);
+
+	uint64_t open_walls = 0;
+	for (uint32_t row = 0; row < row_count; row++) {
+		maze_row_stream_next(stream, right_walls, bottom_walls, row == row_count - 1);
+		open_walls += ~bottom_walls[0] & 1;
+	}
+	uint64_t elapsed_ns = bench_now_ns() - start_ns;
+	wall_sink = open_walls;
+
+	char name[BENCH_NAME_SIZE];
+	snprintf(name, sizeof name, "maze-stream-%u", width);
+
+	struct BenchResult *result = bench_report_add_result(report, name);
+	bench_result_add_metric(result, "cells_per_sec", cell_count / (elapsed_ns / 1e9), BENCH_HIGHER_IS_BETTER);
+	bench_result_add_metric(result, "cells", cell_count, BENCH_INFORMATIONAL);
+
+	free(right_walls);
+	free(bottom_walls);
+	maze_row_stream_destroy(stream);
+}
+
+/* The stream written out as a map file a row at a time, then loaded back to make sure it reads */
+static void bench_maze_stream_file(struct BenchReport *report, struct BenchConfig *config, uint32_t width,
+		uint32_t row_count)
+{
+	uint64_t cell_count = (uint64_t) width * row_count;
+
+	const char *temp_dir = getenv("TMPDIR");
+	char path[256];
+	snprintf(path, sizeof path, "%s/raycast-bench-%d.map", (temp_dir != NULL) ? temp_dir : "/tmp", (int) getpid());
+
+	uint64_t start_ns = bench_now_ns();
+	bool saved = scene_save_streamed_maze(path, width, row_count, config->seed);
+	uint64_t elapsed_ns = bench_now_ns() - start_ns;
+
+	struct REMap *map = saved ? re_map_load(path) : NULL;
+	if (map == NULL) {
+		fprintf(stderr, "raycast-bench: could not write and load '%s', skipping maze-stream-file\n", path);
+		remove(path);
+		return;
+	}
+	wall_sink = re_map_get_cell(map, width / 2, row_count / 2).material_top;
+
+	char name[BENCH_NAME_SIZE];
+	snprintf(name, sizeof name, "maze-stream-file-%u", width);
+
+	struct BenchResult *result = bench_report_add_result(report, name);
+	bench_result_add_metric(result, "cells_per_sec", cell_count / (elapsed_ns / 1e9), BENCH_HIGHER_IS_BETTER);
+	bench_result_add_metric(result, "cells", cell_count, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "file_bytes", (double) map->mapping_size, BENCH_INFORMATIONAL);
+
+	re_map_destroy(map);
+	remove(path);
+}
@@ -0,0 +1,602 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../frame-pacer/frame-pacer.h"
+#include "../mem-utils/mem-macros.h"
+#include "../perf-counters/perf-counters.h"
+#include "../raycast-engine/raycast-engine.h"
+#include "../ray-stats/ray-stats.h"
+#include "../rng/rng.h"
+#include "../scene/scene.h"
+#include "../simptg/simptg.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif // MEM_DEBUG
+
+#include "bench.h"
+
+#define PI 3.14159265358979323846
+
+#define FRAMES_PER_CELL 10
+#define YAW_SWEEP_AMPLITUDE 0.6
+#define YAW_SWEEP_RATE 0.05
+
+#define WORLD_CELLS_PER_FRAME 2.0
+#define WORLD_MEMORY_BUDGET (256 << 10) // 16 chunks, well under what the flight passes through
+#define WORLD_FRAME_RATE 500.0 // with prefetching; loaders work while the frame waits
+#define WORLD_PREFETCH_THREADS 2
+#define WORLD_VIEW_DISTANCE 48.0
+#define WORLD_LOOKAHEAD_FRAMES 30
+
+#define MAP_FILE_SIZE 2048 // 64 MiB of cells
+#define MAP_FILE_QUICK_SIZE 512
+
+#define SIGHT_MAZE_SIZE 256
+#define SIGHT_REACH 16.0 // cells either way from the looker, as far as an agent would care to see
+#define SIGHT_WORLD_MEMORY_BUDGET (1 << 20) // 64 chunks, all of the patch the world's queries cover
+
+struct CameraPose {
+	double x;
+	double y;
+	struct BinaryAngle angle;
+};
+
+struct StageCounters {
+	struct PerfCounters *cast;
+	struct PerfCounters *draw;
+	struct PerfCounters *encode;
+};
+
+static volatile double checksum_sink;
+
+static struct CameraPose *create_camera_path(struct REMap *map, uint32_t frame_count);
+static bool can_leave_cell(struct REMap *map, int64_t x, int64_t y, uint32_t direction);
+static void bench_maze(struct BenchReport *report, struct BenchConfig *config, struct StageCounters *counters,
+		uint32_t maze_size, bool masked);
+static void bench_world(struct BenchReport *report, struct BenchConfig *config);
+static void bench_world_prefetch(struct BenchReport *report, struct BenchConfig *config);
+static struct CameraPose get_world_camera(struct REMap *map, uint32_t frame);
+static void bench_map_file(struct BenchReport *report, struct BenchConfig *config);
+static void bench_line_of_sight(struct BenchReport *report, struct BenchConfig *config, bool chunked);
+static void count_stages(struct BenchResult *result, struct StageCounters *counters, struct REMap *map,
+		struct CameraPose *path, uint32_t frame_count, struct BinaryAngle *rel_angles, int32_t width, int32_t height);
+
+void bench_render_suite(struct BenchReport *report, struct BenchConfig *config)
+{
+	static const uint32_t MAZE_SIZES[] = { 16, 64, 256 };
+
+	// One group per stage so each can accumulate across interleaved frames
+	struct StageCounters counters = { NULL, NULL, NULL };
+	if (config->counters) {
+		counters.cast = perf_counters_create();
+		counters.draw = perf_counters_create();
+		counters.encode = perf_counters_create();
+
+		if (counters.cast == NULL || counters.draw == NULL || counters.encode == NULL) {
+			fprintf(stderr, "raycast-bench: hardware counters unavailable, reporting wall-clock metrics only\n");
+		}
+	}
+
+	for (size_t index = 0; index < sizeof MAZE_SIZES / sizeof MAZE_SIZES[0]; index++) {
+		bench_maze(report, config, &counters, MAZE_SIZES[index], false);
+		bench_maze(report, config, &counters, MAZE_SIZES[index], true);
+	}
+	bench_world(report, config);
+	bench_world_prefetch(report, config);
+	bench_map_file(report, config);
+	bench_line_of_sight(report, config, false);
+	bench_line_of_sight(report, config, true);
+
+	struct PerfCounters *groups[] = { counters.cast, counters.draw, counters.encode };
+	for (size_t index = 0; index < 3; index++) {
+		if (groups[index] != NULL) {
+			perf_counters_destroy(groups[index]);
+		}
+	}
+}
+
+/* Masked runs read the same maze's cells in place instead of expanded into a flat map */
+static void bench_maze(struct BenchReport *report, struct BenchConfig *config, struct StageCounters *counters,
+		uint32_t maze_size, bool masked)
+{
+	uint32_t frame_count = config->quick ? 600 : 6000;
+	int32_t width = config->width;
+	int32_t height = config->height;
+
+	uint64_t build_start_ns = bench_now_ns();
+	struct REMap *map;
+	if (masked) {
+		map = scene_create_maze_map(maze_size, maze_size, config->seed);
+	} else {
+		map = re_map_create(maze_size, maze_size);
+		scene_init_map(map, config->seed);
+	}
+	uint64_t build_ns = bench_now_ns() - build_start_ns;
+	double area = (double) maze_size * maze_size;
+	double map_bytes = masked ? area * sizeof (uint8_t) + sizeof *map->mask_source : area * sizeof (struct REMapCell);
+
+	struct CameraPose *path = create_camera_path(map, frame_count);
+
+	// Same per-column angles as scene_draw_frame
+	struct BinaryAngle *rel_angles = ALLOC_ARR(rel_angles, width);
+	for (int32_t line = 0; line < width; line++) {
+		rel_angles[line] = scene_column_angle(line, width, height);
+	}
+
+	// Cast only
+#ifdef RAY_STATS
+	ray_stats_reset();
+#endif // RAY_STATS
+	double checksum = 0;
+	uint64_t cast_start_ns = bench_now_ns();
+	for (uint32_t frame = 0; frame < frame_count; frame++) {
+		for (int32_t line = 0; line < width; line++) {
+			int material;
+			checksum += re_cast_ray(map, path[frame].x, path[frame].y, path[frame].angle, rel_angles[line],
+					WALL_NONE, WALL_OUT_OF_BOUNDS, &material);
+		}
+	}
+	uint64_t cast_ns = bench_now_ns() - cast_start_ns;
+	checksum_sink = checksum;
+#ifdef RAY_STATS
+	struct RayStatsSummary ray_summary = ray_stats_get_summary();
+#endif // RAY_STATS
+
+	// Full frame: cast, raster and ANSI encode, without writing to a terminal
+	struct SCGPixelBuffer *pixel_buffer = stg_pixel_buffer_create(width, height);
+	struct SCGPixelBuffer *printed_buffer = stg_pixel_buffer_create(width, height);
+	size_t total_bytes = 0;
+
+	uint64_t allocations_before = bench_get_allocation_count();
+	uint64_t frame_start_ns = bench_now_ns();
+	for (uint32_t frame = 0; frame < frame_count; frame++) {
+		scene_draw_frame(map, pixel_buffer, path[frame].x, path[frame].y, path[frame].angle);
+		total_bytes += stg_pixel_buffer_encode_changes(pixel_buffer, (frame > 0) ? printed_buffer : NULL);
+		stg_pixel_buffer_copy(printed_buffer, pixel_buffer);
+	}
+	uint64_t frame_ns = bench_now_ns() - frame_start_ns;
+	uint64_t allocations = bench_get_allocation_count() - allocations_before;
+
+	char name[BENCH_NAME_SIZE];
+	snprintf(name, sizeof name, masked ? "render-maze-masked-%u" : "render-maze-%u", maze_size);
+	struct BenchResult *result = bench_report_add_result(report, name);
+
+	double rays = (double) frame_count * width;
+	bench_result_add_metric(result, "rays_per_sec", rays / (cast_ns / 1e9), BENCH_HIGHER_IS_BETTER);
+	bench_result_add_metric(result, "frames_per_sec", frame_count / (frame_ns / 1e9), BENCH_HIGHER_IS_BETTER);
+	bench_result_add_metric(result, "bytes_per_frame", (double) total_bytes / frame_count, BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "allocations_per_frame", (double) allocations / frame_count,
+			BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "build_ms", build_ns / 1e6, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "map_bytes", map_bytes, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "frames", frame_count, BENCH_INFORMATIONAL);
+
+#ifdef RAY_STATS
+	// From the cast-only pass; the full-frame pass casts the same rays again
+	bench_result_add_metric(result, "dda_steps_per_ray", ray_summary.mean_steps, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "max_dda_steps", ray_summary.max_steps, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "cells_per_ray", (double) ray_summary.cells_visited / rays, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "bounds_failures_per_ray", (double) ray_summary.bounds_failures / rays,
+			BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "out_of_bounds_hits", ray_summary.out_of_bounds_hits, BENCH_INFORMATIONAL);
+#endif // RAY_STATS
+
+	if (counters->cast != NULL && counters->draw != NULL && counters->encode != NULL) {
+		count_stages(result, counters, map, path, frame_count, rel_angles, width, height);
+	}
+
+	stg_pixel_buffer_destroy(printed_buffer);
+	stg_pixel_buffer_destroy(pixel_buffer);
+	free(rel_angles);
+	free(path);
+	re_map_destroy(map);
+}
+
+/*
+ * Flies east through the chunked world, ignoring walls, with a budget small enough that chunks behind the camera
+ * are evicted on the way. Casting includes generating every chunk the rays reach.
+ */
+static void bench_world(struct BenchReport *report, struct BenchConfig *config)
+{
+	uint32_t frame_count = config->quick ? 600 : 6000;
+	int32_t width = config->width;
+	int32_t height = config->height;
+
+	struct REMap *map = scene_create_world(config->seed, WORLD_MEMORY_BUDGET);
+
+	struct BinaryAngle *rel_angles = ALLOC_ARR(rel_angles, width);
+	for (int32_t line = 0; line < width; line++) {
+		rel_angles[line] = scene_column_angle(line, width, height);
+	}
+
+	double checksum = 0;
+	uint64_t cast_start_ns = bench_now_ns();
+	for (uint32_t frame = 0; frame < frame_count; frame++) {
+		struct CameraPose camera = get_world_camera(map, frame);
+
+		for (int32_t line = 0; line < width; line++) {
+			int material;
+			checksum += re_cast_ray(map, camera.x, camera.y, camera.angle, rel_angles[line], WALL_NONE,
+					WALL_OUT_OF_BOUNDS, &material);
+		}
+	}
+	uint64_t cast_ns = bench_now_ns() - cast_start_ns;
+	checksum_sink = checksum;
+
+	struct REChunkStats stats = re_map_get_chunk_stats(map);
+
+	struct BenchResult *result = bench_report_add_result(report, "render-world");
+	double rays = (double) frame_count * width;
+	bench_result_add_metric(result, "rays_per_sec", rays / (cast_ns / 1e9), BENCH_HIGHER_IS_BETTER);
+	bench_result_add_metric(result, "chunk_lookups_per_ray", stats.lookups / rays, BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "chunks_generated", stats.generated, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "chunks_evicted", stats.evicted, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "resident_bytes", (double) stats.resident * RE_CHUNK_AREA * sizeof map->cells[0],
+			BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "frames", frame_count, BENCH_INFORMATIONAL);
+
+	free(rel_angles);
+	re_map_destroy(map);
+}
+
+/*
+ * The same flight with background loaders fed a view hint each frame, and frames paced so the loaders have time
+ * between them. Rays never generate chunks here; the fallbacks are rays that reached a chunk before the loaders did.
+ */
+static void bench_world_prefetch(struct BenchReport *report, struct BenchConfig *config)
+{
+	uint32_t frame_count = config->quick ? 600 : 6000;
+	int32_t width = config->width;
+	int32_t height = config->height;
+	double frame_seconds = 1 / WORLD_FRAME_RATE;
+
+	struct REMap *map = scene_create_world(config->seed, WORLD_MEMORY_BUDGET);
+
+	struct BinaryAngle *rel_angles = ALLOC_ARR(rel_angles, width);
+	for (int32_t line = 0; line < width; line++) {
+		rel_angles[line] = scene_column_angle(line, width, height);
+	}
+
+	re_map_start_prefetch(map, WORLD_PREFETCH_THREADS);
+	struct FramePacer *frame_pacer = frame_pacer_create(WORLD_FRAME_RATE);
+
+	double checksum = 0;
+	uint64_t cast_ns = 0;
+	uint64_t max_frame_cast_ns = 0;
+	for (uint32_t frame = 0; frame < frame_count; frame++) {
+		struct CameraPose camera = get_world_camera(map, frame);
+		struct CameraPose next_camera = get_world_camera(map, frame + 1);
+
+		struct REViewHint hint = {
+			.x = camera.x,
+			.y = camera.y,
+			.velocity_x = (next_camera.x - camera.x) / frame_seconds,
+			.velocity_y = (next_camera.y - camera.y) / frame_seconds,
+			.forward_angle = camera.angle,
+			.angular_velocity = binary_angle_difference(camera.angle, next_camera.angle)
+				/ BINARY_ANGLE_UNITS_PER_RADIAN / frame_seconds,
+			.half_fov = binary_angle_to_radians(rel_angles[0]),
+			.view_distance = WORLD_VIEW_DISTANCE,
+			.frame_seconds = frame_seconds,
+			.lookahead_frames = WORLD_LOOKAHEAD_FRAMES
+		};
+		re_map_hint_view(map, hint);
+
+		uint64_t frame_start_ns = bench_now_ns();
+		for (int32_t line = 0; line < width; line++) {
+			int material;
+			checksum += re_cast_ray(map, camera.x, camera.y, camera.angle, rel_angles[line], WALL_NONE,
+					WALL_OUT_OF_BOUNDS, &material);
+		}
+		uint64_t frame_cast_ns = bench_now_ns() - frame_start_ns;
+
+		cast_ns += frame_cast_ns;
+		if (frame_cast_ns > max_frame_cast_ns) {
+			max_frame_cast_ns = frame_cast_ns;
+		}
+
+		frame_pacer_wait(frame_pacer);
+	}
+	checksum_sink = checksum;
+
+	re_map_stop_prefetch(map);
+	struct REChunkStats stats = re_map_get_chunk_stats(map);
+
+	struct BenchResult *result = bench_report_add_result(report, "render-world-prefetch");
+	double rays = (double) frame_count * width;
+	bench_result_add_metric(result, "cast_ns_per_ray", cast_ns / rays, BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "max_frame_cast_us", max_frame_cast_ns / 1e3, BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "fallbacks_per_ray", stats.fallbacks / rays, BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "chunks_prefetched", stats.prefetched, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "chunks_generated", stats.generated, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "chunks_evicted", stats.evicted, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "frames", frame_count, BENCH_INFORMATIONAL);
+
+	frame_pacer_destroy(frame_pacer);
+	free(rel_angles);
+	re_map_destroy(map);
+}
+
+/*
+ * Generating a maze map against loading the same map from a file. The file was just written, so its pages come
+ * from the page cache: first_frame_us is the cost of faulting in what one frame's rays read, not of the disk.
+ */
+static void bench_map_file(struct BenchReport *report, struct BenchConfig *config)
+{
+	uint32_t frame_count = config->quick ? 600 : 6000;
+	uint32_t map_size = config->quick ? MAP_FILE_QUICK_SIZE : MAP_FILE_SIZE;
+	int32_t width = config->width;
+	int32_t height = config->height;
+
+	const char *temp_dir = getenv("TMPDIR");
+	char path[256];
+	snprintf(path, sizeof path, "%s/raycast-bench-%d.map", (temp_dir != NULL) ? temp_dir : "/tmp", (int) getpid());
+
+	uint64_t init_start_ns = bench_now_ns();
+	struct REMap *generated_map = re_map_create(map_size, map_size);
+	scene_init_map(generated_map, config->seed);
+	uint64_t init_ns = bench_now_ns() - init_start_ns;
+
+	uint64_t save_start_ns = bench_now_ns();
+	bool saved = re_map_save(generated_map, path);
+	uint64_t save_ns = bench_now_ns() - save_start_ns;
+	re_map_destroy(generated_map);
+
+	uint64_t load_start_ns = bench_now_ns();
+	struct REMap *map = saved ? re_map_load(path) : NULL;
+	uint64_t load_ns = bench_now_ns() - load_start_ns;
+
+	if (map == NULL) {
+		fprintf(stderr, "raycast-bench: could not save and load '%s', skipping map-file\n", path);
+		remove(path);
+		return;
+	}
+
+	struct CameraPose *path_poses = create_camera_path(map, frame_count);
+	struct BinaryAngle *rel_angles = ALLOC_ARR(rel_angles, width);
+	for (int32_t line = 0; line < width; line++) {
+		rel_angles[line] = scene_column_angle(line, width, height);
+	}
+
+	double checksum = 0;
+	uint64_t first_frame_ns = 0;
+	uint64_t cast_start_ns = bench_now_ns();
+	for (uint32_t frame = 0; frame < frame_count; frame++) {
+		for (int32_t line = 0; line < width; line++) {
+			int material;
+			checksum += re_cast_ray(map, path_poses[frame].x, path_poses[frame].y, path_poses[frame].angle,
+					rel_angles[line], WALL_NONE, WALL_OUT_OF_BOUNDS, &material);
+		}
+		if (frame == 0) {
+			first_frame_ns = bench_now_ns() - cast_start_ns;
+		}
+	}
+	uint64_t cast_ns = bench_now_ns() - cast_start_ns;
+	checksum_sink = checksum;
+
+	struct BenchResult *result = bench_report_add_result(report, "map-file");
+	double rays = (double) frame_count * width;
+	bench_result_add_metric(result, "generate_ms", init_ns / 1e6, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "save_ms", save_ns / 1e6, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "load_us", load_ns / 1e3, BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "first_frame_us", first_frame_ns / 1e3, BENCH_LOWER_IS_BETTER);
+	bench_result_add_metric(result, "rays_per_sec", rays / (cast_ns / 1e9), BENCH_HIGHER_IS_BETTER);
+	bench_result_add_metric(result, "file_bytes", (double) map->mapping_size, BENCH_INFORMATIONAL);
+
+	free(rel_angles);
+	free(path_poses);
+	re_map_destroy(map);
+	remove(path);
+}
+
+/*
+ * Random pairs of nearby points in the scene's maze, answered one at a time, as a batch on every core, and by
+ * casting a full ray from one toward the other and comparing how far it got. Chunked runs put the points in a patch
+ * of the world the size of the maze, which the table holds whole, so the batch measures how lookups scale across
+ * threads rather than chunk generation.
+ */
+static void bench_line_of_sight(struct BenchReport *report, struct BenchConfig *config, bool chunked)
+{
+	size_t query_count = config->quick ? 100000 : 1000000;
+
+	struct REMap *map = chunked
+		? scene_create_world(config->seed, SIGHT_WORLD_MEMORY_BUDGET)
+		: scene_create_maze_map(SIGHT_MAZE_SIZE, SIGHT_MAZE_SIZE, config->seed);
+	double origin = chunked ? SCENE_WORLD_SIZE / 2.0 : 0;
+
+	struct Rng rng;
+	rng_init(&rng, config->seed, 0);
+	struct RESightQuery *queries = ALLOC_ARR(queries, query_count);
+	for (size_t index = 0; index < query_count; index++) {
+		double from_x = rng_next(&rng) / 4294967296.0 * SIGHT_MAZE_SIZE;
+		double from_y = rng_next(&rng) / 4294967296.0 * SIGHT_MAZE_SIZE;
+		double to_x = from_x + (rng_next(&rng) / 2147483648.0 - 1) * SIGHT_REACH;
+		double to_y = from_y + (rng_next(&rng) / 2147483648.0 - 1) * SIGHT_REACH;
+
+		queries[index] = (struct RESightQuery) {
+			origin + from_x, origin + from_y,
+			origin + fmin(fmax(to_x, 0), SIGHT_MAZE_SIZE - 0.5), origin + fmin(fmax(to_y, 0), SIGHT_MAZE_SIZE - 0.5)
+		};
+	}
+	bool *results = ALLOC_ARR(results, query_count);
+
+	if (chunked) {
+		re_has_lines_of_sight(map, queries, results, query_count, WALL_NONE, 1);
+	}
+
+	uint64_t visible_count = 0;
+	uint64_t single_start_ns = bench_now_ns();
+	for (size_t index = 0; index < query_count; index++) {
+		struct RESightQuery *query = &queries[index];
+		visible_count += re_has_line_of_sight(map, query->from_x, query->from_y, query->to_x, query->to_y, WALL_NONE);
+	}
+	uint64_t single_ns = bench_now_ns() - single_start_ns;
+
+	uint64_t batch_start_ns = bench_now_ns();
+	re_has_lines_of_sight(map, queries, results, query_count, WALL_NONE, 0);
+	uint64_t batch_ns = bench_now_ns() - batch_start_ns;
+
+	uint64_t cast_visible_count = 0;
+	uint64_t cast_start_ns = bench_now_ns();
+	for (size_t index = 0; index < query_count; index++) {
+		struct RESightQuery *query = &queries[index];
+		double delta_x = query->to_x - query->from_x;
+		double delta_y = query->to_y - query->from_y;
+
+		int material;
+		double distance = re_cast_ray(map, query->from_x, query->from_y,
+				binary_angle_from_radians(atan2(delta_y, delta_x)), (struct BinaryAngle) { 0 }, WALL_NONE,
+				WALL_OUT_OF_BOUNDS, &material);
+		cast_visible_count += (distance >= sqrt(delta_x * delta_x + delta_y * delta_y));
+	}
+	uint64_t cast_ns = bench_now_ns() - cast_start_ns;
+	checksum_sink = cast_visible_count + results[query_count / 2];
+
+	char name[BENCH_NAME_SIZE];
+	snprintf(name, sizeof name, chunked ? "line-of-sight-world-%u" : "line-of-sight-%u", SIGHT_MAZE_SIZE);
+
+	long core_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	struct BenchResult *result = bench_report_add_result(report, name);
+	bench_result_add_metric(result, "queries_per_sec", query_count / (single_ns / 1e9), BENCH_HIGHER_IS_BETTER);
+	bench_result_add_metric(result, "batch_queries_per_sec", query_count / (batch_ns / 1e9),
+			BENCH_HIGHER_IS_BETTER);
+	bench_result_add_metric(result, "batch_speedup", (double) single_ns / batch_ns, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "batch_threads", (core_count > 0) ? core_count : 1, BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "cast_ray_queries_per_sec", query_count / (cast_ns / 1e9),
+			BENCH_INFORMATIONAL);
+	bench_result_add_metric(result, "visible_fraction", (double) visible_count / query_count, BENCH_INFORMATIONAL);
+
+	free(results);
+	free(queries);
+	re_map_destroy(map);
+}
+
+/* East along the chunk row second from the top, yawing from side to side */
+static struct CameraPose get_world_camera(struct REMap *map, uint32_t frame)
+{
+	return (struct CameraPose) {
+		.x = 0.5 + frame * WORLD_CELLS_PER_FRAME,
+		.y = map->height - RE_CHUNK_SIZE * 1.5,
+		.angle = binary_angle_from_radians(YAW_SWEEP_AMPLITUDE * sin(frame * YAW_SWEEP_RATE))
+	};
+}
+
+/*
+ * Repeats the cast-only and full-frame passes with hardware counters. This is a separate pass so the enable and
+ * disable calls around every stage don't distort the wall-clock numbers above.
+ */
+static void count_stages(struct BenchResult *result, struct StageCounters *counters, struct REMap *map,
+		struct CameraPose *path, uint32_t frame_count, struct BinaryAngle *rel_angles, int32_t width, int32_t height)
+{
+	struct PerfCounterValues values;
+	double checksum = 0;
+
+	perf_counters_reset(counters->cast);
+	perf_counters_enable(counters->cast);
+	for (uint32_t frame = 0; frame < frame_count; frame++) {
+		for (int32_t line = 0; line < width; line++) {
+			int material;
+			checksum += re_cast_ray(map, path[frame].x, path[frame].y, path[frame].angle, rel_angles[line],
+					WALL_NONE, WALL_OUT_OF_BOUNDS, &material);
+		}
+	}
+	perf_counters_disable(counters->cast);
+	checksum_sink = checksum;
+
+	if (perf_counters_read(counters->cast, &values)) {
+		bench_result_add_counter_metrics(result, "cast", "ray", &values, (double) frame_count * width);
+	}
+
+	struct SCGPixelBuffer *pixel_buffer = stg_pixel_buffer_create(width, height);
+	struct SCGPixelBuffer *printed_buffer = stg_pixel_buffer_create(width, height);
+
+	perf_counters_reset(counters->draw);
+	perf_counters_reset(counters->encode);
+	for (uint32_t frame = 0; frame < frame_count; frame++) {
+		perf_counters_enable(counters->draw);
+		scene_draw_frame(map, pixel_buffer, path[frame].x, path[frame].y, path[frame].angle);
+		perf_counters_disable(counters->draw);
+
+		perf_counters_enable(counters->encode);
+		stg_pixel_buffer_encode_changes(pixel_buffer, (frame > 0) ? printed_buffer : NULL);
+		perf_counters_disable(counters->encode);
+
+		stg_pixel_buffer_copy(printed_buffer, pixel_buffer);
+	}
+
+	if (perf_counters_read(counters->draw, &values)) {
+		bench_result_add_counter_metrics(result, "draw", "frame", &values, frame_count);
+	}
+	if (perf_counters_read(counters->encode, &values)) {
+		bench_result_add_counter_metrics(result, "encode", "frame", &values, frame_count);
+	}
+
+	stg_pixel_buffer_destroy(printed_buffer);
+	stg_pixel_buffer_destroy(pixel_buffer);
+}
+
+/*
+ * Walks the maze with the right hand on the wall, gliding between cell centres while the yaw sweeps
+ * from side to side. The path only depends on the map, so runs with the same seed are comparable.
+ * Directions: 0 is +x, 1 is +y, 2 is -x, 3 is -y
+ */
+static struct CameraPose *create_camera_path(struct REMap *map, uint32_t frame_count)
+{
+	static const int64_t DIRECTION_X[] = { 1, 0, -1, 0 };
+	static const int64_t DIRECTION_Y[] = { 0, 1, 0, -1 };
+
+	struct CameraPose *path = ALLOC_ARR(path, frame_count);
+
+	int64_t cell_x = 0;
+	int64_t cell_y = map->height - 1;
+	uint32_t direction = 0;
+	uint32_t next_direction = 0;
+
+	for (uint32_t frame = 0; frame < frame_count; frame++) {
+		uint32_t step = frame % FRAMES_PER_CELL;
+
+		if (step == 0) {
+			// Prefer right, then straight, then left, then back
+			static const uint32_t TURNS[] = { 3, 0, 1, 2 };
+			for (size_t turn = 0; turn < 4; turn++) {
+				next_direction = (direction + TURNS[turn]) % 4;
+				if (can_leave_cell(map, cell_x, cell_y, next_direction)) {
+					break;
+				}
+			}
+			direction = next_direction;
+		}
+
+		double progress = (double) step / FRAMES_PER_CELL;
+		path[frame].x = cell_x + 0.5 + DIRECTION_X[direction] * progress;
+		path[frame].y = cell_y + 0.5 + DIRECTION_Y[direction] * progress;
+		path[frame].angle = binary_angle_from_radians(direction * (PI / 2)
+				+ YAW_SWEEP_AMPLITUDE * sin(frame * YAW_SWEEP_RATE));
+
+		if (step == FRAMES_PER_CELL - 1) {
+			cell_x += DIRECTION_X[direction];
+			cell_y += DIRECTION_Y[direction];
+		}
+	}
+
+	return path;
+}
+
+static bool can_leave_cell(struct REMap *map, int64_t x, int64_t y, uint32_t direction)
+{
+	static const int64_t DIRECTION_X[] = { 1, 0, -1, 0 };
+	static const int64_t DIRECTION_Y[] = { 0, 1, 0, -1 };
+
+	if (!re_map_coords_in_bounds(map, x + DIRECTION_X[direction], y + DIRECTION_Y[direction])) {
+		return false;
+	}
+
+	struct REMapCell cell = re_map_get_cell(map, x, y);
+	int side_materials[] = { cell.material_right, cell.material_top, cell.material_left, cell.material_bottom };
+
+	return side_materials[direction] == WALL_NONE;
+}
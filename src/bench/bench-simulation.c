@@ -0,0 +1,48 @@
+#include <stdio.h>
+
+#include "../raycast-engine/raycast-engine.h"
+#include "../scene/scene.h"
+#include "../simulation/simulation.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif
+
+#include "bench.h"
+
+#define SIMULATION_TICK_RATE 120.0
+#define MAZE_SIZE 64
+
+static volatile double position_sink;
+
+/* Headless ticks with a scripted key stream: forward every few ticks, turning now and then */
+void bench_simulation_suite(struct BenchReport *report, struct BenchConfig *config)
+{
+	uint32_t tick_count = config->quick ? 1000000 : 10000000;
+
+	struct REMap *map = re_map_create(MAZE_SIZE, MAZE_SIZE);
+	scene_init_map(map, config->seed);
+
+	struct Player player = { .x = 0.5, .y = map->height - 0.5, .rotation = { 0 } };
+	struct Simulation *simulation = simulation_create(map, WALL_NONE, player, SIMULATION_TICK_RATE);
+
+	uint64_t start_ns = bench_now_ns();
+	for (uint32_t tick = 0; tick < tick_count; tick++) {
+		if (tick % 4 == 0) {
+			simulation_apply_input(simulation, 'w');
+		}
+		if (tick % 90 < 10) {
+			simulation_apply_input(simulation, ((tick / 90) % 2 == 0) ? 'j' : 'l');
+		}
+		simulation_step(simulation);
+	}
+	uint64_t elapsed_ns = bench_now_ns() - start_ns;
+	position_sink = simulation->player.x + simulation->player.y;
+
+	struct BenchResult *result = bench_report_add_result(report, "simulation");
+	bench_result_add_metric(result, "ticks_per_sec", tick_count / (elapsed_ns / 1e9), BENCH_HIGHER_IS_BETTER);
+	bench_result_add_metric(result, "ticks", tick_count, BENCH_INFORMATIONAL);
+
+	simulation_destroy(simulation);
+	re_map_destroy(map);
+}
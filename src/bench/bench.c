@@ -0,0 +1,330 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../mem-utils/mem-macros.h"
+#include "../option-map/option-map.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif // MEM_DEBUG
+
+#include "bench.h"
+
+#define NS_PER_SEC 1000000000L
+#define DEFAULT_THRESHOLD_PERCENT 10.0
+
+struct BenchOptions {
+	struct BenchConfig config;
+	char *json_path;
+	char *baseline_path;
+	double threshold_percent;
+};
+
+static atomic_uint_fast64_t allocation_count = 0;
+
+// The bench binary is linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc so that every allocation made by
+// the engine and terminal code passes through these counters
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+static struct BenchOptions parse_options(int argc, char **argv);
+static void print_report(struct BenchReport *report);
+static bool write_json(struct BenchReport *report, const char *path);
+static uint32_t compare_with_baseline(struct BenchReport *report, const char *path, double threshold_percent);
+static bool find_baseline_value(const char *line, const char *key, double *value);
+
+int main(int argc, char **argv)
+{
+	struct BenchOptions options = parse_options(argc - 1, &argv[1]);
+	struct BenchReport report = { 0, 0, NULL };
+
+	bench_render_suite(&report, &options.config);
+	bench_simulation_suite(&report, &options.config);
+	bench_fixed_suite(&report, &options.config);
+	bench_maze_suite(&report, &options.config);
+	bench_flow_field_suite(&report, &options.config);
+
+	print_report(&report);
+
+	int exit_code = EXIT_SUCCESS;
+
+	if (options.json_path != NULL && !write_json(&report, options.json_path)) {
+		fprintf(stderr, "raycast-bench: could not write '%s'\n", options.json_path);
+		exit_code = EXIT_FAILURE;
+	}
+
+	if (options.baseline_path != NULL) {
+		uint32_t regression_count = compare_with_baseline(&report, options.baseline_path, options.threshold_percent);
+		if (regression_count > 0) {
+			fprintf(stderr, "raycast-bench: %u regression(s) beyond %.1f%%\n", regression_count,
+					options.threshold_percent);
+			exit_code = EXIT_FAILURE;
+		}
+	}
+
+	free(report.results);
+	free(options.json_path);
+	free(options.baseline_path);
+
+	return exit_code;
+}
+
+struct BenchResult *bench_report_add_result(struct BenchReport *report, const char *name)
+{
+	if (report->result_count == report->result_size) {
+		report->result_size = (report->result_size > 0) ? report->result_size * 2 : 16;
+		report->results = REALLOC_ARR(report->results, report->result_size);
+	}
+
+	struct BenchResult *result = &report->results[report->result_count];
+	report->result_count++;
+
+	snprintf(result->name, sizeof result->name, "%s", name);
+	result->metric_count = 0;
+
+	return result;
+}
+
+void bench_result_add_metric(struct BenchResult *result, const char *key, double value, enum BenchMetricGoal goal)
+{
+	if (result->metric_count == BENCH_MAX_METRICS) {
+		return;
+	}
+
+	struct BenchMetric *metric = &result->metrics[result->metric_count];
+	snprintf(metric->key, sizeof metric->key, "%s", key);
+	metric->value = value;
+	metric->goal = goal;
+	result->metric_count++;
+}
+
+/*
+ * Adds <stage>_<counter>_per_<unit> for every counter that could be opened, plus <stage>_ipc. Counter metrics
+ * depend on the CPU, so they are informational and never fail a baseline comparison.
+ */
+void bench_result_add_counter_metrics(struct BenchResult *result, const char *stage, const char *unit,
+		struct PerfCounterValues *values, double unit_count)
+{
+	char key[BENCH_KEY_SIZE];
+
+	for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+		if (values->valid[counter]) {
+			snprintf(key, sizeof key, "%s_%s_per_%s", stage, perf_counter_name(counter), unit);
+			bench_result_add_metric(result, key, values->counts[counter] / unit_count, BENCH_INFORMATIONAL);
+		}
+	}
+
+	if (values->valid[PERF_COUNTER_INSTRUCTIONS] && values->counts[PERF_COUNTER_CYCLES] > 0) {
+		snprintf(key, sizeof key, "%s_ipc", stage);
+		bench_result_add_metric(result, key,
+				(double) values->counts[PERF_COUNTER_INSTRUCTIONS] / values->counts[PERF_COUNTER_CYCLES],
+				BENCH_INFORMATIONAL);
+	}
+}
+
+uint64_t bench_now_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+uint64_t bench_get_allocation_count()
+{
+	return atomic_load_explicit(&allocation_count, memory_order_relaxed);
+}
+
+void *__wrap_malloc(size_t size)
+{
+	atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+	return __real_realloc(ptr, size);
+}
+
+static struct BenchOptions parse_options(int argc, char **argv)
+{
+	char *quick_aliases[] = { "--quick", "-q", NULL };
+	char *no_counters_aliases[] = { "--no-counters", NULL };
+	char *seed_aliases[] = { "--seed", NULL };
+	char *size_aliases[] = { "--size", "-s", NULL };
+	char *json_aliases[] = { "--json", NULL };
+	char *baseline_aliases[] = { "--baseline", NULL };
+	char *threshold_aliases[] = { "--threshold", NULL };
+
+	struct OptionMapOption option_arr[] = {
+		{ .aliases = quick_aliases, .takes_value = false },
+		{ .aliases = no_counters_aliases, .takes_value = false },
+		{ .aliases = seed_aliases, .takes_value = true },
+		{ .aliases = size_aliases, .takes_value = true },
+		{ .aliases = json_aliases, .takes_value = true },
+		{ .aliases = baseline_aliases, .takes_value = true },
+		{ .aliases = threshold_aliases, .takes_value = true }
+	};
+	size_t option_count = 7;
+
+	struct OptionMap *option_map = option_map_create(option_arr, option_count);
+	struct OptionMapError error = option_map_set_options(option_map, argc, argv);
+
+	if (error.error_code != OM_NO_ERROR) {
+		option_map_print_error_message(stderr, "raycast-bench: ", error);
+
+		exit(EXIT_FAILURE);
+	}
+
+	struct BenchOptions options = {
+		.config = { .quick = false, .counters = true, .seed = 1, .width = 64, .height = 48 },
+		.json_path = NULL,
+		.baseline_path = NULL,
+		.threshold_percent = DEFAULT_THRESHOLD_PERCENT
+	};
+
+	options.config.quick = option_map_is_option_given(option_map, "--quick");
+	options.config.counters = !option_map_is_option_given(option_map, "--no-counters");
+
+	if (option_map_is_option_given(option_map, "--seed")) {
+		unsigned long long seed;
+		sscanf(option_map_get_option_value(option_map, "--seed"), "%llu", &seed);
+		options.config.seed = seed;
+	}
+
+	if (option_map_is_option_given(option_map, "--size")) {
+		char *size = option_map_get_option_value(option_map, "--size");
+		sscanf(size, "%hux%hu", &options.config.width, &options.config.height);
+	}
+
+	if (option_map_is_option_given(option_map, "--threshold")) {
+		sscanf(option_map_get_option_value(option_map, "--threshold"), "%lf", &options.threshold_percent);
+	}
+
+	options.json_path = option_map_copy_option_value(option_map, "--json");
+	options.baseline_path = option_map_copy_option_value(option_map, "--baseline");
+
+	option_map_destroy(option_map);
+
+	return options;
+}
+
+static void print_report(struct BenchReport *report)
+{
+	for (size_t index = 0; index < report->result_count; index++) {
+		struct BenchResult *result = &report->results[index];
+
+		printf("%s\n", result->name);
+		for (uint32_t metric = 0; metric < result->metric_count; metric++) {
+			printf("  %-36s %16.3f\n", result->metrics[metric].key, result->metrics[metric].value);
+		}
+	}
+}
+
+/* One result object per line, which is what compare_with_baseline expects back */
+static bool write_json(struct BenchReport *report, const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+
+	fprintf(file, "{\"benchmarks\": [\n");
+	for (size_t index = 0; index < report->result_count; index++) {
+		struct BenchResult *result = &report->results[index];
+
+		fprintf(file, "{\"name\": \"%s\"", result->name);
+		for (uint32_t metric = 0; metric < result->metric_count; metric++) {
+			double value = result->metrics[metric].value;
+			if (isfinite(value)) {
+				fprintf(file, ", \"%s\": %.6g", result->metrics[metric].key, value);
+			} else {
+				fprintf(file, ", \"%s\": null", result->metrics[metric].key);
+			}
+		}
+		fprintf(file, "}%s\n", (index + 1 < report->result_count) ? "," : "");
+	}
+	fprintf(file, "]}\n");
+
+	return fclose(file) == 0;
+}
+
+/* Returns the number of metrics that got worse than the baseline by more than threshold_percent */
+static uint32_t compare_with_baseline(struct BenchReport *report, const char *path, double threshold_percent)
+{
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "raycast-bench: could not read baseline '%s'\n", path);
+		return 0;
+	}
+
+	double threshold = threshold_percent / 100;
+	uint32_t regression_count = 0;
+	char line[4096];
+
+	printf("\ncompared with %s:\n", path);
+	while (fgets(line, sizeof line, file) != NULL) {
+		for (size_t index = 0; index < report->result_count; index++) {
+			struct BenchResult *result = &report->results[index];
+
+			char name_field[BENCH_NAME_SIZE + 16];
+			snprintf(name_field, sizeof name_field, "{\"name\": \"%s\"", result->name);
+			if (strncmp(line, name_field, strlen(name_field)) != 0) {
+				continue;
+			}
+
+			for (uint32_t metric = 0; metric < result->metric_count; metric++) {
+				struct BenchMetric *current = &result->metrics[metric];
+				double baseline;
+
+				if (current->goal == BENCH_INFORMATIONAL || !find_baseline_value(line, current->key, &baseline)) {
+					continue;
+				}
+
+				double change = (baseline != 0) ? (current->value - baseline) / fabs(baseline) : 0;
+				bool regressed = (current->goal == BENCH_HIGHER_IS_BETTER)
+					? current->value < baseline * (1 - threshold)
+					: current->value > baseline * (1 + threshold) + (baseline == 0 ? 0.5 : 0);
+
+				printf("  %-20s %-24s %+8.1f%%%s\n", result->name, current->key, change * 100,
+						regressed ? "  REGRESSION" : "");
+				regression_count += regressed;
+			}
+		}
+	}
+
+	fclose(file);
+
+	return regression_count;
+}
+
+static bool find_baseline_value(const char *line, const char *key, double *value)
+{
+	char key_field[BENCH_KEY_SIZE + 8];
+	snprintf(key_field, sizeof key_field, "\"%s\": ", key);
+
+	const char *field = strstr(line, key_field);
+	if (field == NULL) {
+		return false;
+	}
+
+	char *end;
+	*value = strtod(field + strlen(key_field), &end);
+
+	return end != field + strlen(key_field);
+}
@@ -0,0 +1,62 @@
+#ifndef bench_h
+#define bench_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../perf-counters/perf-counters.h"
+
+#define BENCH_NAME_SIZE 64
+#define BENCH_KEY_SIZE 48
+#define BENCH_MAX_METRICS 32
+
+// Hides an integer's value from the optimizer so a loop of dependent operations can't be folded into one
+#define BENCH_OPAQUE(value) __asm__ volatile ("" : "+r" (value) : : "memory")
+
+enum BenchMetricGoal {
+	BENCH_HIGHER_IS_BETTER,
+	BENCH_LOWER_IS_BETTER,
+	BENCH_INFORMATIONAL // reported, never compared
+};
+
+struct BenchResult {
+	char name[BENCH_NAME_SIZE];
+	uint32_t metric_count;
+	struct BenchMetric {
+		char key[BENCH_KEY_SIZE];
+		double value;
+		enum BenchMetricGoal goal;
+	} metrics[BENCH_MAX_METRICS];
+};
+
+struct BenchReport {
+	size_t result_count;
+	size_t result_size;
+	struct BenchResult *results;
+};
+
+struct BenchConfig {
+	bool quick;
+	bool counters; // hardware performance counters, where the machine allows them
+	uint64_t seed;
+	uint16_t width;
+	uint16_t height;
+};
+
+struct BenchResult *bench_report_add_result(struct BenchReport *report, const char *name);
+void bench_result_add_metric(struct BenchResult *result, const char *key, double value, enum BenchMetricGoal goal);
+void bench_result_add_counter_metrics(struct BenchResult *result, const char *stage, const char *unit,
+		struct PerfCounterValues *values, double unit_count);
+
+uint64_t bench_now_ns();
+uint64_t bench_get_allocation_count();
+
+/* Suites */
+void bench_render_suite(struct BenchReport *report, struct BenchConfig *config);
+void bench_simulation_suite(struct BenchReport *report, struct BenchConfig *config);
+void bench_fixed_suite(struct BenchReport *report, struct BenchConfig *config);
+void bench_maze_suite(struct BenchReport *report, struct BenchConfig *config);
+void bench_flow_field_suite(struct BenchReport *report, struct BenchConfig *config);
+
+#endif // bench_h
@@ -0,0 +1,54 @@
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif
+
+#include "event-signal.h"
+
+struct EventSignal *event_signal_create()
+{
+	int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct EventSignal *signal = malloc(sizeof *signal);
+	signal->fd = fd;
+
+	return signal;
+}
+
+void event_signal_destroy(struct EventSignal *signal)
+{
+	close(signal->fd);
+	free(signal);
+}
+
+/* Async-signal-safe, so it may be called from a signal handler */
+void event_signal_notify(struct EventSignal *signal)
+{
+	uint64_t increment = 1;
+	ssize_t written = write(signal->fd, &increment, sizeof increment);
+	(void) written; // only fails if the counter would overflow, in which case a wakeup is already pending
+}
+
+/*
+ * Blocks until notified or timeout_ms elapses (EVENT_SIGNAL_WAIT_FOREVER to never time out) and consumes all
+ * pending notifications. Returns false on timeout or when interrupted by a signal.
+ */
+bool event_signal_wait(struct EventSignal *signal, int timeout_ms)
+{
+	struct pollfd poll_fd = { .fd = signal->fd, .events = POLLIN };
+
+	if (poll(&poll_fd, 1, timeout_ms) <= 0) {
+		return false;
+	}
+
+	uint64_t count;
+	return read(signal->fd, &count, sizeof count) == sizeof count;
+}
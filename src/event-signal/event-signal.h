@@ -0,0 +1,19 @@
+#ifndef event_signal_h
+#define event_signal_h
+
+#include <stdbool.h>
+
+#define EVENT_SIGNAL_WAIT_FOREVER -1
+
+/* Counting wakeup backed by an eventfd; notifications sent while nobody is waiting are not lost */
+struct EventSignal {
+	int fd;
+};
+
+struct EventSignal *event_signal_create();
+void event_signal_destroy(struct EventSignal *signal);
+
+void event_signal_notify(struct EventSignal *signal);
+bool event_signal_wait(struct EventSignal *signal, int timeout_ms);
+
+#endif // event_signal_h
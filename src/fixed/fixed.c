@@ -1,216 +1,422 @@
-#include <math.h>
+#include <stdbool.h>
 
 #include "fixed.h"
 
-#define TWO_TO_32 (1L << 32)
-#define TWO_TO_16 (1 << 16)
-#define TWO_TO_8 (1 << 8)
+/*
+ * Plain indexed loops over whole arrays, with no early exits, so that the compiler can vectorize them. Scaling
+ * keeps the rounding of the scalar multiplies.
+ */
 
-/*** 32-bit ***/
-
-double fixed32_to_double(struct Fixed32 value)
+void fixed32_add_array(struct Fixed32 *out, const struct Fixed32 *a, const struct Fixed32 *b, size_t count)
 {
-	return (double) value.as_int / TWO_TO_16;
+	for (size_t index = 0; index < count; index++) {
+		out[index].as_int = a[index].as_int + b[index].as_int;
+	}
 }
 
-struct Fixed32 fixed32_from_double(double value)
+void fixed32_scale_array(struct Fixed32 *out, const struct Fixed32 *values, struct Fixed32 scale, size_t count)
 {
-	return (struct Fixed32) { .as_int = (int32_t) (value * TWO_TO_16) };
-}
+	int64_t scale_int = scale.as_int;
 
-double ufixed32_to_double(struct UFixed32 value)
-{
-	return (double) value.as_uint / TWO_TO_16;
+	for (size_t index = 0; index < count; index++) {
+		int64_t product = values[index].as_int * scale_int + (1 << 15);
+		out[index].as_int = (int32_t) (product >> 16);
+	}
 }
 
-struct UFixed32 ufixed32_from_double(double value)
+void fixed64_add_array(struct Fixed64 *out, const struct Fixed64 *a, const struct Fixed64 *b, size_t count)
 {
-	return (struct UFixed32) { .as_uint = (uint32_t) (value * TWO_TO_16) };
+	for (size_t index = 0; index < count; index++) {
+		out[index].as_int = a[index].as_int + b[index].as_int;
+	}
 }
 
-struct Fixed32 fixed32_add(struct Fixed32 a, struct Fixed32 b)
+void fixed64_scale_array(struct Fixed64 *out, const struct Fixed64 *values, struct Fixed64 scale, size_t count)
 {
-	return (struct Fixed32) { .as_int = a.as_int + b.as_int };
+	for (size_t index = 0; index < count; index++) {
+		out[index] = fixed64_multiply(values[index], scale);
+	}
 }
 
-struct Fixed32 fixed32_subtract(struct Fixed32 a, struct Fixed32 b)
-{
-	return (struct Fixed32) { .as_int = a.as_int - b.as_int };
-}
+/*
+ * Square roots use Newton-Raphson on the reciprocal square root, which needs only multiplies. The input is first
+ * normalised by an even power of two to m in [1, 4) (Q2.62), so that
+ *   value = m * 4^e,  sqrt(value) = sqrt(m) * 2^e,  1 / sqrt(value) = (1 / sqrt(m)) * 2^-e
+ */
 
-struct Fixed32 fixed32_multiply(struct Fixed32 a, struct Fixed32 b)
-{
-	int64_t product = (int64_t) a.as_int * (int64_t) b.as_int;
+#define RSQRT_ITERATIONS 4 // a ~4-bit table guess doubles its precision each iteration
+#define Q62_ONE (1UL << 62)
 
-	product += (1 << 15); // round
-	
-	return (struct Fixed32) { .as_int = (int32_t) (product >> 16) };
-}
+// 1 / sqrt(m) in Q2.62 at the centre of each sixteenth of [0, 4); only entries 4..15 are used since m >= 1
+static const uint64_t RSQRT_GUESSES[16] = {
+	0, 0, 0, 0,
+	0x3c56fbbbfdf4ce00, 0x369452783b2a9e00, 0x3234aac2a2ec3800, 0x2ebd2e8d41613000,
+	0x2be754ce7f522000, 0x298757d2779ee800, 0x27806ca1c01c0600, 0x25bec18bbe593c00,
+	0x243430a3fec61400, 0x22d651eabae5a800, 0x219d4c62e30db800, 0x208314900dbcfa00
+};
 
-struct Fixed32 fixed32_divide(struct Fixed32 a, struct Fixed32 b)
+static uint64_t normalize_q62(uint64_t raw, int32_t *shift);
+static uint64_t rsqrt_q62(uint64_t m);
+
+struct Fixed64 fixed64_sqrt(struct Fixed64 value)
 {
-	int64_t a_shifted = ((int64_t) a.as_int) << 17;
-	int64_t quotient = a_shifted / b.as_int;
-	quotient += 1; // round
-	quotient >>= 1;
+	if (value.as_int <= 0) {
+		return (struct Fixed64) { .as_int = 0 };
+	}
 
-	return (struct Fixed32) { .as_int = quotient };
-}
+	struct UFixed64 root = ufixed64_sqrt((struct UFixed64) { .as_uint = (uint64_t) value.as_int });
 
-struct UFixed32 ufixed32_add(struct UFixed32 a, struct UFixed32 b)
-{
-	return (struct UFixed32) { .as_uint = a.as_uint + b.as_uint };
+	return (struct Fixed64) { .as_int = (int64_t) root.as_uint };
 }
 
-struct UFixed32 ufixed32_subtract(struct UFixed32 a, struct UFixed32 b)
+struct UFixed64 ufixed64_sqrt(struct UFixed64 value)
 {
-	return (struct UFixed32) { .as_uint = a.as_uint - b.as_uint };
-}
+	if (value.as_uint == 0) {
+		return value;
+	}
 
-struct UFixed32 ufixed32_multiply(struct UFixed32 a, struct UFixed32 b)
-{
-	uint64_t product = (uint64_t) a.as_uint * (uint64_t) b.as_uint;
+	int32_t shift;
+	uint64_t m = normalize_q62(value.as_uint, &shift);
+	uint64_t root_m = (uint64_t) (((fixed_uint128_t) m * rsqrt_q62(m)) >> 62); // sqrt(m) in Q2.62
 
-	product += (1 << 15); // round
-	
-	return (struct UFixed32) { .as_uint = (uint32_t) (product >> 16) };
+	// Q2.62 * 2^e to Q32.32, where e = (30 - shift) / 2
+	uint32_t result_shift = (30 + shift) / 2;
+
+	return (struct UFixed64) { .as_uint = (root_m + (1UL << (result_shift - 1))) >> result_shift };
 }
- 
-struct UFixed32 ufixed32_divide(struct UFixed32 a, struct UFixed32 b)
-{
 
-     uint64_t a_shifted = ((uint64_t) a.as_uint) << 17;
-     uint64_t quotient = a_shifted / b.as_uint;
-     quotient += 1; // round
-     quotient >>= 1;
+struct UFixed64 ufixed64_rsqrt(struct UFixed64 value)
+{
+	if (value.as_uint == 0) {
+		return (struct UFixed64) { .as_uint = UINT64_MAX };
+	}
 
-     return (struct UFixed32) { .as_uint = quotient };
-}
+	int32_t shift;
+	uint64_t m = normalize_q62(value.as_uint, &shift);
 
-/*** 64-bit ***/
+	// Q2.62 * 2^-e to Q32.32
+	uint32_t result_shift = (90 - shift) / 2;
 
-double fixed64_to_double(struct Fixed64 value)
-{
-	return (double) value.as_int / TWO_TO_32;
+	return (struct UFixed64) { .as_uint = (rsqrt_q62(m) + (1UL << (result_shift - 1))) >> result_shift };
 }
 
-struct Fixed64 fixed64_from_double(double value)
+/* Shifts a non-zero Q32.32 value left by an even amount so that it reads as m in [1, 4) in Q2.62 */
+static uint64_t normalize_q62(uint64_t raw, int32_t *shift)
 {
-	return (struct Fixed64) { .as_int = (int64_t) (value * TWO_TO_32) };
-}
+	int32_t top_bit = 63 - __builtin_clzll(raw);
 
-double ufixed64_to_double(struct UFixed64 value)
-{
-	return (double) value.as_uint / TWO_TO_32;
-}
+	*shift = (62 - top_bit) + ((62 - top_bit) & 1); // rounded up to even; -1 becomes 0
 
-struct UFixed64 ufixed64_from_double(double value)
-{
-	return (struct UFixed64) { .as_uint = (uint64_t) (value * TWO_TO_32) };
+	return raw << *shift;
 }
 
-struct Fixed64 fixed64_add(struct Fixed64 a, struct Fixed64 b)
+/* 1 / sqrt(m) in Q2.62 for m in [1, 4) in Q2.62 */
+static uint64_t rsqrt_q62(uint64_t m)
 {
-	return (struct Fixed64) { .as_int = a.as_int + b.as_int };
+	uint64_t y = RSQRT_GUESSES[m >> 60];
+
+	for (int iteration = 0; iteration < RSQRT_ITERATIONS; iteration++) {
+		// y = y * (3 - m * y^2) / 2
+		uint64_t y_squared = (uint64_t) (((fixed_uint128_t) y * y) >> 62);
+		uint64_t error = (uint64_t) (((fixed_uint128_t) m * y_squared) >> 62);
+		y = (uint64_t) (((fixed_uint128_t) y * (3 * Q62_ONE - error)) >> 63);
+	}
+
+	return y;
 }
 
-struct Fixed64 fixed64_subtract(struct Fixed64 a, struct Fixed64 b)
+/*
+ * Binary angles: sin and cos come from one quarter-wave table. The angle is split into the nearest table point
+ * x0 and a remainder h of at most half a step (pi / 1024), and
+ *   sin(x0 + h) = sin x0 + h cos x0 - h^2 / 2 sin x0 - h^3 / 6 cos x0
+ * leaves an error below h^4 / 24 ~ 4e-12, under one fixed64 ulp. cos x0 comes from the same table.
+ */
+
+#define SIN_TABLE_BITS 8 // table points per quarter turn, as a power of two
+#define SIN_TABLE_SHIFT (32 - 2 - SIN_TABLE_BITS) // binary angle bits below a table step
+#define TWO_PI_Q32 0x6487ed511L // 2 pi in Q32.32; one binary angle unit is 2 pi / 2^32 radians
+#define CORDIC_ITERATIONS 31
+#define ATAN_TABLE_BITS 8 // table points per unit ratio, as a power of two
+#define ATAN_TABLE_SHIFT (32 - ATAN_TABLE_BITS) // Q32.32 bits below a table step
+
+// sin(i * pi / 512) in Q32.32, for i in [0, 256]
+static const int64_t SIN_TABLE[(1 << SIN_TABLE_BITS) + 1] = {
+	0x000000000, 0x001921f10, 0x003243a40, 0x004b64daf,
+	0x00648557e, 0x007da4dcc, 0x0096c32bb, 0x00afe0069,
+	0x00c8fb2f9, 0x00e214689, 0x00fb2b73d, 0x011440135,
+	0x012d52093, 0x014661179, 0x015f6d00b, 0x01787586a,
+	0x01917a6bc, 0x01aa7b724, 0x01c3785c8, 0x01dc70ecc,
+	0x01f564e57, 0x020e5408f, 0x02273e19e, 0x024022daa,
+	0x0259020dd, 0x0271db762, 0x028aaed62, 0x02a37bf0b,
+	0x02bc42889, 0x02d50260a, 0x02edbb3bd, 0x03066cdd1,
+	0x031f17079, 0x0337b97e6, 0x03505404b, 0x0368e65de,
+	0x0381704d5, 0x0399f1966, 0x03b269fcb, 0x03cad943c,
+	0x03e33f2f6, 0x03fb9b836, 0x0413ee039, 0x042c3673f,
+	0x04447498b, 0x045ca835e, 0x0474d10fd, 0x048ceeeaf,
+	0x04a5018bb, 0x04bd08b6c, 0x04d50430c, 0x04ecf3be8,
+	0x0504d7250, 0x051cae295, 0x05347890a, 0x054c36203,
+	0x0563e69d7, 0x057b89cde, 0x05931f775, 0x05aaa75f7,
+	0x05c2214c4, 0x05d98d03d, 0x05f0ea4c4, 0x060838ec1,
+	0x061f78a9b, 0x0636a94bb, 0x064dca98f, 0x0664dc585,
+	0x067bde50f, 0x0692d049f, 0x06a9b20ae, 0x06c0835b2,
+	0x06d744028, 0x06edf3c8c, 0x070492760, 0x071b1fd26,
+	0x07319ba65, 0x074805ba4, 0x075e5dd6e, 0x0774a3c52,
+	0x078ad74e0, 0x07a0f83ac, 0x07b70654c, 0x07cd01659,
+	0x07e2e9370, 0x07f8bd930, 0x080e7e43a, 0x08242b135,
+	0x0839c3cc9, 0x084f483a1, 0x0864b826b, 0x087a135d9,
+	0x088f59aa1, 0x08a48ad7a, 0x08b9a6b1f, 0x08cead050,
+	0x08e39d9cd, 0x08f87845e, 0x090d3ccca, 0x0921eafdd,
+	0x093682a67, 0x094b0393b, 0x095f6d930, 0x0973c071f,
+	0x0987fbfe7, 0x099c20068, 0x09b02c588, 0x09c420c2f,
+	0x09d7fd149, 0x09ebc11c6, 0x09ff6ca9a, 0x0a12ff8bc,
+	0x0a2679928, 0x0a39da8dd, 0x0a4d224dd, 0x0a6050a2f,
+	0x0a73655df, 0x0a86604fb, 0x0a9941495, 0x0aac081c5,
+	0x0abeb49a4, 0x0ad146953, 0x0ae3bddf3, 0x0af61a4ac,
+	0x0b085baa9, 0x0b1a81d19, 0x0b2c8c930, 0x0b3e7bc25,
+	0x0b504f334, 0x0b6206b9e, 0x0b73a22a7, 0x0b8521599,
+	0x0b96841bf, 0x0ba7ca46d, 0x0bb8f3af8, 0x0bca002ba,
+	0x0bdaef913, 0x0bebc1b66, 0x0bfc7671b, 0x0c0d0d99e,
+	0x0c1d87060, 0x0c2de28d7, 0x0c3e2007e, 0x0c4e3f4d2,
+	0x0c5e40359, 0x0c6e22999, 0x0c7de651f, 0x0c8d8b37f,
+	0x0c9d1124d, 0x0cac77f24, 0x0cbbbf7a6, 0x0ccae7977,
+	0x0cd9f0240, 0x0ce8d8faf, 0x0cf7a1f79, 0x0d064af56,
+	0x0d14d3d02, 0x0d233c641, 0x0d31848d8, 0x0d3fac295,
+	0x0d4db3148, 0x0d5b992c9, 0x0d695e4f1, 0x0d77025a2,
+	0x0d84852c1, 0x0d91e6a38, 0x0d9f269f8, 0x0dac44ff5,
+	0x0db941a29, 0x0dc61c694, 0x0dd2d533a, 0x0ddf6be25,
+	0x0debe0563, 0x0df83270b, 0x0e0462134, 0x0e106f1fd,
+	0x0e1c5978c, 0x0e2821009, 0x0e33c59a4, 0x0e3f47291,
+	0x0e4aa590a, 0x0e55e0b4d, 0x0e60f87a0, 0x0e6becc4c,
+	0x0e76bd7a2, 0x0e816a7f6, 0x0e8bf3ba2, 0x0e9659107,
+	0x0ea09a68a, 0x0eaab7a97, 0x0eb4b0b9e, 0x0ebe85816,
+	0x0ec835e7a, 0x0ed1c1d4b, 0x0edb29312, 0x0ee46be5a,
+	0x0eed89db6, 0x0ef682fbf, 0x0eff57311, 0x0f0806651,
+	0x0f1090828, 0x0f18f5744, 0x0f2135259, 0x0f294f824,
+	0x0f3144762, 0x0f3913edb, 0x0f40bdd5a, 0x0f48421b1,
+	0x0f4fa0ab6, 0x0f56d9747, 0x0f5dec647, 0x0f64d969e,
+	0x0f6ba073b, 0x0f7241713, 0x0f78bc51f, 0x0f7f11060,
+	0x0f853f7dd, 0x0f8b47aa0, 0x0f91297bc, 0x0f96e4e48,
+	0x0f9c79d63, 0x0fa1e8430, 0x0fa7301d8, 0x0fac5158c,
+	0x0fb14be80, 0x0fb61fbf0, 0x0fbaccd1d, 0x0fbf5314f,
+	0x0fc3b27d4, 0x0fc7eaffd, 0x0fcbfc926, 0x0fcfe72ad,
+	0x0fd3aabf8, 0x0fd747472, 0x0fdabcb8d, 0x0fde0b0bf,
+	0x0fe132387, 0x0fe432368, 0x0fe70afeb, 0x0fe9bc8a1,
+	0x0fec46d1f, 0x0feea9d00, 0x0ff0e57e6, 0x0ff2f9d79,
+	0x0ff4e6d68, 0x0ff6ac766, 0x0ff84ab2c, 0x0ff9c187c,
+	0x0ffb10f1c, 0x0ffc38ed7, 0x0ffd39780, 0x0ffe128f0,
+	0x0ffec4304, 0x0fff4e5a2, 0x0fffb10b5, 0x0fffec42c,
+	0x100000000
+};
+
+// atan(i / 256) as binary angles, for i in [-1, 257]; the extra point at each end serves the centred differences
+static const int32_t ATAN_TABLE[(1 << ATAN_TABLE_BITS) + 3] = {
+	-2670163, 0, 2670163, 5340245, 8010164, 10679838,
+	13349187, 16018129, 18686582, 21354465, 24021698, 26688200,
+	29353889, 32018685, 34682507, 37345276, 40006910, 42667331,
+	45326458, 47984212, 50640513, 53295284, 55948444, 58599915,
+	61249621, 63897482, 66543421, 69187361, 71829226, 74468939,
+	77106424, 79741605, 82374407, 85004756, 87632577, 90257796,
+	92880340, 95500135, 98117110, 100731191, 103342309, 105950391,
+	108555367, 111157167, 113755721, 116350962, 118942819, 121531227,
+	124116117, 126697423, 129275078, 131849018, 134419178, 136985493,
+	139547900, 142106335, 144660738, 147211045, 149757197, 152299132,
+	154836791, 157370116, 159899047, 162423527, 164943499, 167458907,
+	169969696, 172475810, 174977196, 177473799, 179965568, 182452450,
+	184934394, 187411349, 189883266, 192350096, 194811789, 197268300,
+	199719579, 202165583, 204606264, 207041579, 209471483, 211895933,
+	214314887, 216728303, 219136141, 221538359, 223934919, 226325781,
+	228710908, 231090262, 233463808, 235831508, 238193329, 240549235,
+	242899194, 245243172, 247581137, 249913059, 252238905, 254558647,
+	256872255, 259179700, 261480955, 263775993, 266064788, 268347313,
+	270623543, 272893455, 275157025, 277414230, 279665048, 281909457,
+	284147437, 286378966, 288604026, 290822599, 293034664, 295240206,
+	297439207, 299631651, 301817523, 303996806, 306169488, 308335554,
+	310494991, 312647786, 314793928, 316933406, 319066208, 321192324,
+	323311746, 325424463, 327530468, 329629752, 331722309, 333808132,
+	335887214, 337959550, 340025134, 342083962, 344136031, 346181336,
+	348219874, 350251643, 352276640, 354294865, 356306316, 358310992,
+	360308894, 362300021, 364284375, 366261957, 368232767, 370196809,
+	372154086, 374104599, 376048352, 377985350, 379915596, 381839095,
+	383755852, 385665872, 387569162, 389465727, 391355574, 393238710,
+	395115141, 396984877, 398847924, 400704291, 402553986, 404397019,
+	406233399, 408063135, 409886237, 411702716, 413512582, 415315845,
+	417112518, 418902610, 420686135, 422463104, 424233528, 425997422,
+	427754796, 429505665, 431250041, 432987938, 434719370, 436444350,
+	438162893, 439875013, 441580724, 443280042, 444972981, 446659557,
+	448339785, 450013680, 451681259, 453342536, 454997530, 456646255,
+	458288728, 459924966, 461554985, 463178803, 464796437, 466407904,
+	468013221, 469612406, 471205476, 472792449, 474373344, 475948178,
+	477516969, 479079736, 480636498, 482187271, 483732076, 485270931,
+	486803855, 488330866, 489851983, 491367227, 492876615, 494380167,
+	495877903, 497369841, 498856002, 500336404, 501811068, 503280012,
+	504743258, 506200824, 507652730, 509098996, 510539643, 511974689,
+	513404156, 514828063, 516246430, 517659277, 519066625, 520468494,
+	521864904, 523255875, 524641427, 526021581, 527396357, 528765775,
+	530129856, 531488619, 532842087, 534190278, 535533213, 536870912,
+	538203396
+};
+
+// atan(2^-i) as binary angles
+static const uint32_t CORDIC_ANGLES[CORDIC_ITERATIONS] = {
+	0x20000000, 0x12e4051e, 0x09fb385b, 0x051111d4,
+	0x028b0d43, 0x0145d7e1, 0x00a2f61e, 0x00517c55,
+	0x0028be53, 0x00145f2f, 0x000a2f98, 0x000517cc,
+	0x00028be6, 0x000145f3, 0x0000a2fa, 0x0000517d,
+	0x000028be, 0x0000145f, 0x00000a30, 0x00000518,
+	0x0000028c, 0x00000146, 0x000000a3, 0x00000051,
+	0x00000029, 0x00000014, 0x0000000a, 0x00000005,
+	0x00000003, 0x00000001, 0x00000001
+};
+
+static int64_t table_sin(uint32_t point);
+static int64_t multiply_small(int64_t a, int64_t b);
+
+/*
+ * Third-order Taylor expansion about the nearest table point x0, so sin(x0 + h) and cos(x0 + h) share the lookups
+ * and powers of h.
+ */
+void binary_angle_sin_cos(struct BinaryAngle angle, struct Fixed64 *p_sin, struct Fixed64 *p_cos)
 {
-	return (struct Fixed64) { .as_int = a.as_int - b.as_int };
+	// Nearest table point on the whole circle; wraps to 0 past the last one
+	uint32_t point = (angle.as_uint + (1U << (SIN_TABLE_SHIFT - 1))) >> SIN_TABLE_SHIFT;
+	int32_t remainder = (int32_t) (angle.as_uint - (point << SIN_TABLE_SHIFT));
+
+	int64_t sin_x0 = table_sin(point);
+	int64_t cos_x0 = table_sin(point + (1 << SIN_TABLE_BITS));
+
+	int64_t h = (remainder * TWO_PI_Q32) >> 32; // radians
+	int64_t h_squared = multiply_small(h, h);
+	int64_t h_cubed = multiply_small(h_squared, h);
+	int64_t h_squared_half = h_squared / 2;
+	int64_t h_cubed_sixth = h_cubed / 6;
+
+	p_sin->as_int = sin_x0 + multiply_small(h, cos_x0) - multiply_small(h_squared_half, sin_x0)
+		- multiply_small(h_cubed_sixth, cos_x0);
+	p_cos->as_int = cos_x0 - multiply_small(h, sin_x0) - multiply_small(h_squared_half, cos_x0)
+		+ multiply_small(h_cubed_sixth, sin_x0);
 }
 
-struct Fixed64 fixed64_multiply(struct Fixed64 a, struct Fixed64 b)
+struct Fixed64 binary_angle_sin(struct BinaryAngle angle)
 {
-	int64_t a_int = (a.as_int >> 32); // Gets only left 32 bits
-	int64_t a_frac = a.as_int & UINT32_MAX; // Gets only right 32 bits
-	int64_t b_int = (b.as_int >> 32); // Gets only left 32 bits
-	int64_t b_frac = b.as_int & UINT32_MAX; // Gets only right 32 bits
+	struct Fixed64 sin, cos;
+	binary_angle_sin_cos(angle, &sin, &cos);
 
-	int64_t int_product = a_int * b_int;
-	int64_t mixed_product = a_int * b_frac + a_frac * b_int;
-	int64_t frac_product = a_frac * b_frac; // Used only for the carry
-	frac_product += (1L << 31); // Rounds the carry
-
-	int64_t ab_product =
-		(int_product << 32)
-		+ mixed_product
-		+ (frac_product >> 32);
-	
-	return (struct Fixed64) { .as_int = ab_product };
+	return sin;
 }
 
-struct Fixed64 fixed64_divide(struct Fixed64 a, struct Fixed64 b)
+struct Fixed64 binary_angle_cos(struct BinaryAngle angle)
 {
-	int64_t a_int = a.as_int;
-	int64_t b_int = b.as_int;
-
-	int64_t answer = a_int / b_int;
-	a_int %= b_int;
-
+	struct Fixed64 sin, cos;
+	binary_angle_sin_cos(angle, &sin, &cos);
 
-	for (int_fast8_t shift_num = 0; shift_num < 32; shift_num++) {
-		answer <<= 1;
-		a_int <<= 1;
+	return cos;
+}
 
-		answer += a_int / b_int;
-		a_int %= b_int;
+struct Fixed64 binary_angle_tan(struct BinaryAngle angle)
+{
+	struct Fixed64 sin, cos;
+	binary_angle_sin_cos(angle, &sin, &cos);
+	if (cos.as_int == 0) {
+		return (struct Fixed64) { .as_int = FIXED64_UNDEFINED };
 	}
 
-	answer += (a_int << 1) / b_int; // round
-
-	return (struct Fixed64) { answer };
+	return fixed64_divide(sin, cos);
 }
 
-struct UFixed64 ufixed64_add(struct UFixed64 a, struct UFixed64 b)
+/*
+ * Quadratic through the nearest table point and its neighbours, for ratios up to 1; larger ones use
+ * atan(t) = quarter turn - atan(1 / t). The error stays under 8 binary angle units (~1e-8 radians).
+ */
+struct BinaryAngle binary_angle_atan(struct Fixed64 ratio)
 {
-	return (struct UFixed64) { .as_uint = a.as_uint + b.as_uint };
-}
+	bool negative = (ratio.as_int < 0);
+	struct UFixed64 magnitude = { .as_uint = negative ? -(uint64_t) ratio.as_int : (uint64_t) ratio.as_int };
 
-struct UFixed64 ufixed64_subtract(struct UFixed64 a, struct UFixed64 b)
-{
-	return (struct UFixed64) { .as_uint = a.as_uint - b.as_uint };
-}
+	bool inverted = (magnitude.as_uint > FIXED_TWO_TO_32);
+	if (inverted) {
+		magnitude = ufixed64_reciprocal(magnitude);
+	}
 
-struct UFixed64 ufixed64_multiply(struct UFixed64 a, struct UFixed64 b)
-{
-	uint64_t a_uint = (a.as_uint >> 32); // Gets only left 32 bits
-	uint64_t a_frac = a.as_uint & UINT32_MAX; // Gets only right 32 bits
-	uint64_t b_uint = (b.as_uint >> 32); // Gets only left 32 bits
-	uint64_t b_frac = b.as_uint & UINT32_MAX; // Gets only right 32 bits
+	uint32_t point = (uint32_t) ((magnitude.as_uint + (1UL << (ATAN_TABLE_SHIFT - 1))) >> ATAN_TABLE_SHIFT);
+	int64_t remainder = (int64_t) (magnitude.as_uint - ((uint64_t) point << ATAN_TABLE_SHIFT));
 
-	uint64_t uint_product = a_uint * b_uint;
-	uint64_t mixed_product = a_uint * b_frac + a_frac * b_uint;
-	uint64_t frac_product = a_frac * b_frac; // Used only for the carry
-	frac_product += (1L << 31); // Rounds the carry
+	const int32_t *p_value = &ATAN_TABLE[point + 1];
+	int64_t slope = p_value[1] - p_value[-1]; // twice the first difference
+	int64_t curvature = p_value[1] - 2 * p_value[0] + p_value[-1];
 
-	uint64_t ab_product =
-		(uint_product << 32)
-		+ mixed_product
-		+ (frac_product >> 32);
+	int64_t angle = p_value[0]
+		+ ((remainder * slope + (1L << ATAN_TABLE_SHIFT)) >> (ATAN_TABLE_SHIFT + 1))
+		+ ((remainder * remainder / (1L << ATAN_TABLE_SHIFT) * curvature) >> (ATAN_TABLE_SHIFT + 1));
 
-	return (struct UFixed64) { .as_uint = ab_product };
+	uint32_t result = inverted ? BINARY_ANGLE_QUARTER_TURN - (uint32_t) angle : (uint32_t) angle;
+
+	return (struct BinaryAngle) { .as_uint = negative ? -result : result };
 }
- 
-struct UFixed64 ufixed64_divide(struct UFixed64 a, struct UFixed64 b)
+
+/*
+ * CORDIC in vectoring mode: rotates (x, y) onto the positive x axis by +-atan(2^-i) steps using only shifts and
+ * adds, summing the steps. atan2(0, 0) is 0.
+ */
+struct BinaryAngle binary_angle_atan2(struct Fixed64 y, struct Fixed64 x)
 {
-	uint64_t a_uint = a.as_uint;
-	uint64_t b_uint = b.as_uint;
+	int64_t vector_x = x.as_int;
+	int64_t vector_y = y.as_int;
+	uint32_t angle = 0;
+
+	// CORDIC converges within +-99 degrees, so start from the right half-plane
+	if (vector_x < 0) {
+		vector_x = -vector_x;
+		vector_y = -vector_y;
+		angle = BINARY_ANGLE_HALF_TURN;
+	}
 
-	uint64_t answer = a_uint / b_uint;
-	a_uint %= b_uint;
+	uint64_t magnitude_bits = (uint64_t) vector_x | (uint64_t) (vector_y < 0 ? -vector_y : vector_y);
+	if (magnitude_bits == 0) {
+		return (struct BinaryAngle) { .as_uint = 0 };
+	}
 
+	// Normalise to bit 60 for precision, leaving headroom for the CORDIC gain of ~1.65
+	int32_t shift = __builtin_clzll(magnitude_bits) - 3;
+	if (shift > 0) {
+		vector_x *= (int64_t) 1 << shift;
+		vector_y *= (int64_t) 1 << shift;
+	} else {
+		vector_x >>= -shift;
+		vector_y >>= -shift;
+	}
 
-	for (uint_fast8_t shift_num = 0; shift_num < 32; shift_num++) {
-		answer <<= 1;
-		a_uint <<= 1;
+	for (int iteration = 0; iteration < CORDIC_ITERATIONS; iteration++) {
+		int64_t next_x;
 
-		answer += a_uint / b_uint;
-		a_uint %= b_uint;
+		if (vector_y > 0) {
+			next_x = vector_x + (vector_y >> iteration);
+			vector_y -= vector_x >> iteration;
+			angle += CORDIC_ANGLES[iteration];
+		} else {
+			next_x = vector_x - (vector_y >> iteration);
+			vector_y += vector_x >> iteration;
+			angle -= CORDIC_ANGLES[iteration];
+		}
+
+		vector_x = next_x;
 	}
 
-	answer += (a_uint << 1) / b_uint; // round
+	return (struct BinaryAngle) { .as_uint = angle };
+}
 
-	return (struct UFixed64) { answer };
+/* Q32.32 product for operands small enough that it fits in 64 bits; |h| < 2^25 and table values are <= 2^32 */
+static int64_t multiply_small(int64_t a, int64_t b)
+{
+	return (a * b + (1L << 31)) >> 32;
 }
 
+/* sin of table point index point (mod a full turn) by quarter-wave symmetry */
+static int64_t table_sin(uint32_t point)
+{
+	uint32_t quarter = (point >> SIN_TABLE_BITS) & 3;
+	uint32_t index = point & ((1 << SIN_TABLE_BITS) - 1);
+
+	int64_t value = (quarter & 1) ? SIN_TABLE[(1 << SIN_TABLE_BITS) - index] : SIN_TABLE[index];
 
+	return (quarter & 2) ? -value : value;
+}
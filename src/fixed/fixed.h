@@ -1,6 +1,7 @@
 #ifndef fixed_h
 #define fixed_h
 
+#include <stddef.h>
 #include <stdint.h>
 
 /*** 32-bit ***/
@@ -13,20 +14,6 @@ struct UFixed32 {
 	uint32_t as_uint;
 };
 
-double fixed32_to_double(struct Fixed32 value);
-struct Fixed32 fixed32_from_double(double value);
-double ufixed32_to_double(struct UFixed32 value);
-struct UFixed32 ufixed32_from_double(double value);
-
-struct Fixed32 fixed32_add(struct Fixed32 a, struct Fixed32 b);
-struct Fixed32 fixed32_subtract(struct Fixed32 a, struct Fixed32 b);
-struct Fixed32 fixed32_multiply(struct Fixed32 a, struct Fixed32 b);
-struct Fixed32 fixed32_divide(struct Fixed32 a, struct Fixed32 b);
-struct UFixed32 ufixed32_add(struct UFixed32 a, struct UFixed32 b);
-struct UFixed32 ufixed32_subtract(struct UFixed32 a, struct UFixed32 b);
-struct UFixed32 ufixed32_multiply(struct UFixed32 a, struct UFixed32 b);
-struct UFixed32 ufixed32_divide(struct UFixed32 a, struct UFixed32 b);
-
 /*** 64-bit ***/
 
 struct Fixed64 {
@@ -37,19 +24,282 @@ struct UFixed64 {
 	uint64_t as_uint;
 };
 
-double fixed64_to_double(struct Fixed64 value);
-struct Fixed64 fixed64_from_double(double value);
-double ufixed64_to_double(struct UFixed64 value);
-struct UFixed64 ufixed64_from_double(double value);
+/*** Binary angles ***/
 
-struct Fixed64 fixed64_add(struct Fixed64 a, struct Fixed64 b);
-struct Fixed64 fixed64_subtract(struct Fixed64 a, struct Fixed64 b);
-struct Fixed64 fixed64_multiply(struct Fixed64 a, struct Fixed64 b);
-struct Fixed64 fixed64_divide(struct Fixed64 a, struct Fixed64 b);
-struct UFixed64 ufixed64_add(struct UFixed64 a, struct UFixed64 b);
-struct UFixed64 ufixed64_subtract(struct UFixed64 a, struct UFixed64 b);
-struct UFixed64 ufixed64_multiply(struct UFixed64 a, struct UFixed64 b);
-struct UFixed64 ufixed64_divide(struct UFixed64 a, struct UFixed64 b);
+// A full turn is 2^32, so angles wrap for free on integer overflow
+struct BinaryAngle {
+	uint32_t as_uint;
+};
 
-#endif // fixed_h
+#define BINARY_ANGLE_QUARTER_TURN (1U << 30)
+#define BINARY_ANGLE_HALF_TURN (1U << 31)
+
+/*** Batch (fixed.c) ***/
+
+// Element-wise over count values; out may alias an input only if it is the same array
+void fixed32_add_array(struct Fixed32 *out, const struct Fixed32 *a, const struct Fixed32 *b, size_t count);
+void fixed32_scale_array(struct Fixed32 *out, const struct Fixed32 *values, struct Fixed32 scale, size_t count);
+void fixed64_add_array(struct Fixed64 *out, const struct Fixed64 *a, const struct Fixed64 *b, size_t count);
+void fixed64_scale_array(struct Fixed64 *out, const struct Fixed64 *values, struct Fixed64 scale, size_t count);
+
+/*** Square roots (fixed.c) ***/
+
+// Negative inputs give 0; the reciprocal square root of 0 saturates to the largest value
+struct Fixed64 fixed64_sqrt(struct Fixed64 value);
+struct UFixed64 ufixed64_sqrt(struct UFixed64 value);
+struct UFixed64 ufixed64_rsqrt(struct UFixed64 value);
+
+/*** Binary angle trigonometry (fixed.c) ***/
+
+// tan is undefined at odd quarter turns; it returns FIXED64_UNDEFINED there
+#define FIXED64_UNDEFINED INT64_MIN
+
+struct Fixed64 binary_angle_sin(struct BinaryAngle angle);
+struct Fixed64 binary_angle_cos(struct BinaryAngle angle);
+void binary_angle_sin_cos(struct BinaryAngle angle, struct Fixed64 *p_sin, struct Fixed64 *p_cos);
+struct Fixed64 binary_angle_tan(struct BinaryAngle angle);
+struct BinaryAngle binary_angle_atan(struct Fixed64 ratio);
+struct BinaryAngle binary_angle_atan2(struct Fixed64 y, struct Fixed64 x);
+
+/*
+ * Scalar operations are defined here so they inline into hot loops without LTO. The 64-bit divides do a single
+ * division with a 128-bit intermediate.
+ */
+
+#define FIXED_TWO_TO_32 (1L << 32)
+#define FIXED_TWO_TO_16 (1 << 16)
+
+__extension__ typedef __int128 fixed_int128_t;
+__extension__ typedef unsigned __int128 fixed_uint128_t;
+
+/*** 32-bit operations ***/
+
+static inline double fixed32_to_double(struct Fixed32 value)
+{
+	return (double) value.as_int / FIXED_TWO_TO_16;
+}
+
+static inline struct Fixed32 fixed32_from_double(double value)
+{
+	return (struct Fixed32) { .as_int = (int32_t) (value * FIXED_TWO_TO_16) };
+}
+
+static inline double ufixed32_to_double(struct UFixed32 value)
+{
+	return (double) value.as_uint / FIXED_TWO_TO_16;
+}
+
+static inline struct UFixed32 ufixed32_from_double(double value)
+{
+	return (struct UFixed32) { .as_uint = (uint32_t) (value * FIXED_TWO_TO_16) };
+}
+
+static inline struct Fixed32 fixed32_add(struct Fixed32 a, struct Fixed32 b)
+{
+	return (struct Fixed32) { .as_int = a.as_int + b.as_int };
+}
+
+static inline struct Fixed32 fixed32_subtract(struct Fixed32 a, struct Fixed32 b)
+{
+	return (struct Fixed32) { .as_int = a.as_int - b.as_int };
+}
+
+static inline struct Fixed32 fixed32_multiply(struct Fixed32 a, struct Fixed32 b)
+{
+	int64_t product = (int64_t) a.as_int * (int64_t) b.as_int;
+
+	product += (1 << 15); // round
+	
+	return (struct Fixed32) { .as_int = (int32_t) (product >> 16) };
+}
+
+static inline struct Fixed32 fixed32_divide(struct Fixed32 a, struct Fixed32 b)
+{
+	int64_t a_shifted = ((int64_t) a.as_int) << 17;
+	int64_t quotient = a_shifted / b.as_int;
+	quotient += 1; // round
+	quotient >>= 1;
+
+	return (struct Fixed32) { .as_int = quotient };
+}
+
+static inline struct UFixed32 ufixed32_add(struct UFixed32 a, struct UFixed32 b)
+{
+	return (struct UFixed32) { .as_uint = a.as_uint + b.as_uint };
+}
+
+static inline struct UFixed32 ufixed32_subtract(struct UFixed32 a, struct UFixed32 b)
+{
+	return (struct UFixed32) { .as_uint = a.as_uint - b.as_uint };
+}
+
+static inline struct UFixed32 ufixed32_multiply(struct UFixed32 a, struct UFixed32 b)
+{
+	uint64_t product = (uint64_t) a.as_uint * (uint64_t) b.as_uint;
+
+	product += (1 << 15); // round
+	
+	return (struct UFixed32) { .as_uint = (uint32_t) (product >> 16) };
+}
+
+static inline struct UFixed32 ufixed32_divide(struct UFixed32 a, struct UFixed32 b)
+{
+	uint64_t a_shifted = ((uint64_t) a.as_uint) << 17;
+	uint64_t quotient = a_shifted / b.as_uint;
+	quotient += 1; // round
+	quotient >>= 1;
+
+	return (struct UFixed32) { .as_uint = quotient };
+}
+
+/*** 64-bit operations ***/
+
+static inline double fixed64_to_double(struct Fixed64 value)
+{
+	return (double) value.as_int / FIXED_TWO_TO_32;
+}
 
+static inline struct Fixed64 fixed64_from_double(double value)
+{
+	return (struct Fixed64) { .as_int = (int64_t) (value * FIXED_TWO_TO_32) };
+}
+
+static inline double ufixed64_to_double(struct UFixed64 value)
+{
+	return (double) value.as_uint / FIXED_TWO_TO_32;
+}
+
+static inline struct UFixed64 ufixed64_from_double(double value)
+{
+	return (struct UFixed64) { .as_uint = (uint64_t) (value * FIXED_TWO_TO_32) };
+}
+
+static inline struct Fixed64 fixed64_from_int(int64_t value)
+{
+	return (struct Fixed64) { .as_int = value * FIXED_TWO_TO_32 };
+}
+
+static inline struct Fixed64 fixed64_add(struct Fixed64 a, struct Fixed64 b)
+{
+	return (struct Fixed64) { .as_int = a.as_int + b.as_int };
+}
+
+static inline struct Fixed64 fixed64_subtract(struct Fixed64 a, struct Fixed64 b)
+{
+	return (struct Fixed64) { .as_int = a.as_int - b.as_int };
+}
+
+static inline struct Fixed64 fixed64_multiply(struct Fixed64 a, struct Fixed64 b)
+{
+	fixed_int128_t product = (fixed_int128_t) a.as_int * b.as_int;
+
+	product += (1L << 31); // round
+
+	return (struct Fixed64) { .as_int = (int64_t) (product >> 32) };
+}
+
+static inline struct Fixed64 fixed64_divide(struct Fixed64 a, struct Fixed64 b)
+{
+	fixed_int128_t dividend = (fixed_int128_t) a.as_int * FIXED_TWO_TO_32;
+	int64_t quotient = (int64_t) (dividend / b.as_int);
+	int64_t remainder = (int64_t) (dividend - (fixed_int128_t) quotient * b.as_int);
+
+	// Round half away from zero: step away from zero when |remainder| >= |b| / 2
+	uint64_t remainder_magnitude = (remainder < 0) ? -(uint64_t) remainder : (uint64_t) remainder;
+	uint64_t b_magnitude = (b.as_int < 0) ? -(uint64_t) b.as_int : (uint64_t) b.as_int;
+	int64_t direction = ((remainder ^ b.as_int) < 0) ? -1 : 1;
+	quotient += (remainder_magnitude >= b_magnitude - remainder_magnitude) ? direction : 0;
+
+	return (struct Fixed64) { .as_int = quotient };
+}
+
+/* Like ufixed64_rsqrt, the reciprocal of 0 saturates to the largest value instead of dividing by zero */
+static inline struct Fixed64 fixed64_reciprocal(struct Fixed64 value)
+{
+	if (value.as_int == 0) {
+		return (struct Fixed64) { .as_int = INT64_MAX };
+	}
+
+	return fixed64_divide((struct Fixed64) { .as_int = FIXED_TWO_TO_32 }, value);
+}
+
+static inline struct UFixed64 ufixed64_add(struct UFixed64 a, struct UFixed64 b)
+{
+	return (struct UFixed64) { .as_uint = a.as_uint + b.as_uint };
+}
+
+static inline struct UFixed64 ufixed64_subtract(struct UFixed64 a, struct UFixed64 b)
+{
+	return (struct UFixed64) { .as_uint = a.as_uint - b.as_uint };
+}
+
+static inline struct UFixed64 ufixed64_multiply(struct UFixed64 a, struct UFixed64 b)
+{
+	fixed_uint128_t product = (fixed_uint128_t) a.as_uint * b.as_uint;
+
+	product += (1L << 31); // round
+
+	return (struct UFixed64) { .as_uint = (uint64_t) (product >> 32) };
+}
+
+static inline struct UFixed64 ufixed64_divide(struct UFixed64 a, struct UFixed64 b)
+{
+	fixed_uint128_t dividend = (fixed_uint128_t) a.as_uint << 32;
+	uint64_t quotient = (uint64_t) (dividend / b.as_uint);
+	uint64_t remainder = (uint64_t) (dividend - (fixed_uint128_t) quotient * b.as_uint);
+
+	quotient += (remainder >= b.as_uint - remainder); // round
+
+	return (struct UFixed64) { .as_uint = quotient };
+}
+
+/* The reciprocal of 0 saturates to the largest value */
+static inline struct UFixed64 ufixed64_reciprocal(struct UFixed64 value)
+{
+	if (value.as_uint == 0) {
+		return (struct UFixed64) { .as_uint = UINT64_MAX };
+	}
+
+	return ufixed64_divide((struct UFixed64) { .as_uint = FIXED_TWO_TO_32 }, value);
+}
+
+/*** Binary angle operations ***/
+
+#define BINARY_ANGLE_UNITS_PER_RADIAN (4294967296.0 / 6.28318530717958647692)
+
+static inline struct BinaryAngle binary_angle_from_radians(double radians)
+{
+	double units = radians * BINARY_ANGLE_UNITS_PER_RADIAN;
+	units += (units < 0) ? -0.5 : 0.5; // round
+
+	return (struct BinaryAngle) { .as_uint = (uint32_t) (int64_t) units };
+}
+
+/* In [0, 2 pi) */
+static inline double binary_angle_to_radians(struct BinaryAngle angle)
+{
+	return angle.as_uint / BINARY_ANGLE_UNITS_PER_RADIAN;
+}
+
+static inline struct BinaryAngle binary_angle_add(struct BinaryAngle a, struct BinaryAngle b)
+{
+	return (struct BinaryAngle) { .as_uint = a.as_uint + b.as_uint };
+}
+
+static inline struct BinaryAngle binary_angle_subtract(struct BinaryAngle a, struct BinaryAngle b)
+{
+	return (struct BinaryAngle) { .as_uint = a.as_uint - b.as_uint };
+}
+
+static inline struct BinaryAngle binary_angle_negate(struct BinaryAngle angle)
+{
+	return (struct BinaryAngle) { .as_uint = -angle.as_uint };
+}
+
+/* Signed shortest turn from a to b, in binary angle units */
+static inline int32_t binary_angle_difference(struct BinaryAngle a, struct BinaryAngle b)
+{
+	return (int32_t) (b.as_uint - a.as_uint);
+}
+
+#endif // fixed_h
@@ -0,0 +1,524 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mem-utils/mem-macros.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif // MEM_DEBUG
+
+#include "flow-field.h"
+
+#define FLOW_FIELD_MAX_AREA (1ull << 30) // distances and their offset stay well inside int32_t levels
+#define FLOW_FIELD_MAX_OFFSET (1ll << 30)
+
+#define FLOW_FIELD_NO_LEVEL INT32_MAX
+#define FLOW_FIELD_NEARER 1
+#define FLOW_FIELD_SETTLED 2 // getting further, or staying put
+
+static void search_from_target(struct FlowField *field);
+static uint64_t reach_word(struct FlowField *field, uint64_t word);
+static void update_nearer(struct FlowField *field, uint32_t nearer_count, uint32_t further_count);
+static void update_further(struct FlowField *field, uint32_t nearer_count, uint32_t further_count);
+static uint32_t get_open_neighbors(struct FlowField *field, uint32_t cell, uint32_t *neighbors);
+static int64_t get_level_distance(struct FlowField *field, uint32_t cell);
+static void open_passage(struct FlowField *field, uint64_t *plane, uint32_t x, uint32_t y,
+		enum FlowFieldDirection direction);
+
+/*
+ * Returns NULL for a chunked map, or one over FLOW_FIELD_MAX_AREA cells. A side between two cells is open when
+ * both cells show transparent_material there, as rays see it.
+ */
+struct FlowField *flow_field_create(struct REMap *map, int transparent_material)
+{
+	uint64_t area = (uint64_t) map->width * map->height;
+	if (map->chunk_table != NULL || area == 0 || area > FLOW_FIELD_MAX_AREA) {
+		return NULL;
+	}
+
+	struct FlowField *field = malloc(sizeof *field);
+
+	field->width = map->width;
+	field->height = map->height;
+	field->row_words = (map->width + 63) / 64;
+
+	uint64_t plane_words = field->row_words * map->height;
+	field->open_right = CALLOC_ARR(field->open_right, plane_words);
+	field->open_up = CALLOC_ARR(field->open_up, plane_words);
+
+	field->visited = CALLOC_ARR(field->visited, plane_words);
+	field->frontier = CALLOC_ARR(field->frontier, plane_words);
+	field->next_frontier = CALLOC_ARR(field->next_frontier, plane_words);
+	field->frontier_words = ALLOC_ARR(field->frontier_words, plane_words);
+	field->next_frontier_words = ALLOC_ARR(field->next_frontier_words, plane_words);
+	field->word_stamps = CALLOC_ARR(field->word_stamps, plane_words);
+	field->stamp = 0;
+	field->marks = CALLOC_ARR(field->marks, area);
+	field->nearer_cells = ALLOC_ARR(field->nearer_cells, area);
+	field->further_cells = ALLOC_ARR(field->further_cells, area);
+
+	field->open_sides = CALLOC_ARR(field->open_sides, area);
+	field->levels = ALLOC_ARR(field->levels, area);
+	for (uint64_t cell = 0; cell < area; cell++) {
+		field->levels[cell] = FLOW_FIELD_NO_LEVEL;
+	}
+	field->has_target = false;
+	field->level_offset = 0;
+	field->cells_updated = 0;
+
+	for (uint32_t y = 0; y < map->height; y++) {
+		for (uint32_t x = 0; x < map->width; x++) {
+			struct REMapCell cell = re_map_get_cell(map, x, y);
+
+			if (x + 1 < map->width && cell.material_right == transparent_material
+					&& re_map_get_cell(map, x + 1, y).material_left == transparent_material) {
+				open_passage(field, field->open_right, x, y, FLOW_FIELD_RIGHT);
+			}
+			if (y + 1 < map->height && cell.material_top == transparent_material
+					&& re_map_get_cell(map, x, y + 1).material_bottom == transparent_material) {
+				open_passage(field, field->open_up, x, y, FLOW_FIELD_UP);
+			}
+		}
+	}
+
+	return field;
+}
+
+void flow_field_destroy(struct FlowField *field)
+{
+	free(field->open_right);
+	free(field->open_up);
+	free(field->open_sides);
+	free(field->visited);
+	free(field->frontier);
+	free(field->next_frontier);
+	free(field->frontier_words);
+	free(field->next_frontier_words);
+	free(field->word_stamps);
+	free(field->marks);
+	free(field->nearer_cells);
+	free(field->further_cells);
+	free(field->levels);
+	free(field);
+}
+
+/* Builds the whole field afresh */
+void flow_field_set_target(struct FlowField *field, uint32_t x, uint32_t y)
+{
+	field->target_x = x;
+	field->target_y = y;
+	field->has_target = true;
+
+	search_from_target(field);
+}
+
+/*
+ * A move to a neighboring cell through an open side is an update; any other move, or a first target, builds the
+ * field afresh.
+ */
+void flow_field_move_target(struct FlowField *field, uint32_t x, uint32_t y)
+{
+	if (!field->has_target || field->level_offset > FLOW_FIELD_MAX_OFFSET
+			|| field->level_offset < -FLOW_FIELD_MAX_OFFSET) {
+		flow_field_set_target(field, x, y);
+		return;
+	}
+
+	uint32_t old_target = field->target_y * field->width + field->target_x;
+	uint32_t new_target = y * field->width + x;
+
+	uint32_t neighbors[4];
+	uint32_t neighbor_count = get_open_neighbors(field, old_target, neighbors);
+	bool is_step = false;
+	for (uint32_t index = 0; index < neighbor_count; index++) {
+		is_step |= (neighbors[index] == new_target);
+	}
+	if (!is_step) {
+		flow_field_set_target(field, x, y);
+		return;
+	}
+
+	field->target_x = x;
+	field->target_y = y;
+
+	/*
+	 * Cells whose shortest paths to the old target include one through the new target get one step nearer; the
+	 * rest, all of whose shortest paths run through the old target from the other side, get up to one step further.
+	 * The two groups are found a level at a time side by side, from the new and old targets, until the smaller has
+	 * been found whole. Only its cells are rewritten.
+	 */
+	field->nearer_cells[0] = new_target;
+	field->marks[new_target] |= FLOW_FIELD_NEARER;
+	field->further_cells[0] = old_target;
+	field->marks[old_target] |= FLOW_FIELD_SETTLED;
+
+	uint32_t nearer_start = 0, nearer_count = 1;
+	uint32_t further_start = 0, further_count = 1;
+
+	while (true) {
+		uint32_t nearer_end = nearer_count;
+		for (uint32_t index = nearer_start; index < nearer_end; index++) {
+			uint32_t cell = field->nearer_cells[index];
+			int64_t child_distance = get_level_distance(field, cell) + 1;
+
+			neighbor_count = get_open_neighbors(field, cell, neighbors);
+			for (uint32_t neighbor_index = 0; neighbor_index < neighbor_count; neighbor_index++) {
+				uint32_t neighbor = neighbors[neighbor_index];
+				if (!(field->marks[neighbor] & FLOW_FIELD_NEARER)
+						&& get_level_distance(field, neighbor) == child_distance) {
+					field->marks[neighbor] |= FLOW_FIELD_NEARER;
+					field->nearer_cells[nearer_count++] = neighbor;
+				}
+			}
+		}
+		nearer_start = nearer_end;
+		if (nearer_start == nearer_count) {
+			update_nearer(field, nearer_count, further_count);
+			return;
+		}
+
+		// A cell is further only once every neighbor a step nearer the old target is
+		uint32_t further_end = further_count;
+		for (uint32_t index = further_start; index < further_end; index++) {
+			uint32_t cell = field->further_cells[index];
+			int64_t parent_distance = get_level_distance(field, cell);
+
+			neighbor_count = get_open_neighbors(field, cell, neighbors);
+			for (uint32_t neighbor_index = 0; neighbor_index < neighbor_count; neighbor_index++) {
+				uint32_t neighbor = neighbors[neighbor_index];
+				if (neighbor == new_target || (field->marks[neighbor] & FLOW_FIELD_SETTLED)
+						|| get_level_distance(field, neighbor) != parent_distance + 1) {
+					continue;
+				}
+
+				uint32_t parents[4];
+				uint32_t parent_count = get_open_neighbors(field, neighbor, parents);
+				bool all_parents_further = true;
+				for (uint32_t parent_index = 0; parent_index < parent_count; parent_index++) {
+					uint32_t parent = parents[parent_index];
+					if (get_level_distance(field, parent) == parent_distance
+							&& !(field->marks[parent] & FLOW_FIELD_SETTLED)) {
+						all_parents_further = false;
+					}
+				}
+
+				if (all_parents_further) {
+					field->marks[neighbor] |= FLOW_FIELD_SETTLED;
+					field->further_cells[further_count++] = neighbor;
+				}
+			}
+		}
+		further_start = further_end;
+		if (further_start == further_count) {
+			update_further(field, nearer_count, further_count);
+			return;
+		}
+	}
+}
+
+uint32_t flow_field_get_distance(struct FlowField *field, uint32_t x, uint32_t y)
+{
+	uint32_t cell = y * field->width + x;
+	if (field->levels[cell] == FLOW_FIELD_NO_LEVEL) {
+		return FLOW_FIELD_UNREACHED;
+	}
+
+	return (uint32_t) get_level_distance(field, cell);
+}
+
+/* The way to a neighbor one step nearer the target. Levels share one offset, so they compare as they are */
+enum FlowFieldDirection flow_field_get_direction(struct FlowField *field, uint32_t x, uint32_t y)
+{
+	uint32_t cell = y * field->width + x;
+	int32_t level = field->levels[cell];
+	if (level == FLOW_FIELD_NO_LEVEL || level + field->level_offset == 0) {
+		return FLOW_FIELD_NONE;
+	}
+
+	uint8_t open_sides = field->open_sides[cell];
+	if ((open_sides & (1u << FLOW_FIELD_RIGHT)) && field->levels[cell + 1] < level) {
+		return FLOW_FIELD_RIGHT;
+	}
+	if ((open_sides & (1u << FLOW_FIELD_UP)) && field->levels[cell + field->width] < level) {
+		return FLOW_FIELD_UP;
+	}
+	if ((open_sides & (1u << FLOW_FIELD_LEFT)) && field->levels[cell - 1] < level) {
+		return FLOW_FIELD_LEFT;
+	}
+	if ((open_sides & (1u << FLOW_FIELD_DOWN)) && field->levels[cell - field->width] < level) {
+		return FLOW_FIELD_DOWN;
+	}
+
+	return FLOW_FIELD_NONE;
+}
+
+bool flow_field_is_open(struct FlowField *field, uint32_t x, uint32_t y, enum FlowFieldDirection direction)
+{
+	return field->open_sides[y * field->width + x] & (1u << direction);
+}
+
+/*
+ * Level by level, the frontier is a bit plane and a list of its nonzero words. Only words in or beside the frontier
+ * can be reached next, so each level costs in proportion to the frontier, not the map: a maze's corridors keep the
+ * frontier to a few words however deep the search goes.
+ */
+void search_from_target(struct FlowField *field)
+{
+	uint64_t area = (uint64_t) field->width * field->height;
+	for (uint64_t cell = 0; cell < area; cell++) {
+		field->levels[cell] = FLOW_FIELD_NO_LEVEL;
+	}
+	field->level_offset = 0;
+
+	uint32_t target = field->target_y * field->width + field->target_x;
+	uint64_t target_word = field->target_y * field->row_words + field->target_x / 64;
+	uint64_t target_bit = 1ull << (field->target_x % 64);
+
+	field->levels[target] = 0;
+	field->visited[target_word] = target_bit;
+	field->frontier[target_word] = target_bit;
+	field->frontier_words[0] = target_word;
+	uint64_t frontier_count = 1;
+	uint64_t reached_count = 1;
+
+	uint64_t last_word = field->row_words * field->height - 1;
+	for (int32_t level = 1; frontier_count > 0; level++) {
+		if (++field->stamp == 0) {
+			memset(field->word_stamps, 0, (last_word + 1) * sizeof field->word_stamps[0]);
+			field->stamp = 1;
+		}
+
+		uint64_t next_count = 0;
+		for (uint64_t index = 0; index < frontier_count; index++) {
+			uint64_t word = field->frontier_words[index];
+			uint64_t column = word % field->row_words;
+
+			uint64_t candidates[5] = { word, word, word, word, word };
+			if (column > 0) {
+				candidates[1] = word - 1;
+			}
+			if (column + 1 < field->row_words) {
+				candidates[2] = word + 1;
+			}
+			if (word >= field->row_words) {
+				candidates[3] = word - field->row_words;
+			}
+			if (word + field->row_words <= last_word) {
+				candidates[4] = word + field->row_words;
+			}
+
+			for (uint32_t candidate_index = 0; candidate_index < 5; candidate_index++) {
+				uint64_t candidate = candidates[candidate_index];
+				if (field->word_stamps[candidate] == field->stamp) {
+					continue;
+				}
+				field->word_stamps[candidate] = field->stamp;
+
+				uint64_t reached = reach_word(field, candidate) & ~field->visited[candidate];
+				if (reached == 0) {
+					continue;
+				}
+
+				field->visited[candidate] |= reached;
+				field->next_frontier[candidate] = reached;
+				field->next_frontier_words[next_count++] = candidate;
+
+				uint32_t row = (uint32_t) (candidate / field->row_words);
+				uint32_t first_x = (uint32_t) (candidate % field->row_words) * 64;
+				int32_t *row_levels = &field->levels[(uint64_t) row * field->width + first_x];
+				for (uint64_t bits = reached; bits != 0; bits &= bits - 1) {
+					row_levels[__builtin_ctzll(bits)] = level;
+					reached_count++;
+				}
+			}
+		}
+
+		for (uint64_t index = 0; index < frontier_count; index++) {
+			field->frontier[field->frontier_words[index]] = 0;
+		}
+
+		uint64_t *plane = field->frontier;
+		field->frontier = field->next_frontier;
+		field->next_frontier = plane;
+
+		uint64_t *words = field->frontier_words;
+		field->frontier_words = field->next_frontier_words;
+		field->next_frontier_words = words;
+		frontier_count = next_count;
+	}
+
+	memset(field->visited, 0, (last_word + 1) * sizeof field->visited[0]);
+	field->cells_updated = reached_count;
+}
+
+/* Cells of the word with a frontier cell beside them through an open side */
+uint64_t reach_word(struct FlowField *field, uint64_t word)
+{
+	uint64_t column = word % field->row_words;
+	uint64_t row_words = field->row_words;
+	uint64_t *frontier = field->frontier;
+
+	uint64_t frontier_bits = frontier[word];
+	uint64_t open_right = field->open_right[word];
+
+	// From the left: bit x - 1 of the frontier through x - 1's right side, carrying across words
+	uint64_t reached = (frontier_bits & open_right) << 1;
+	if (column > 0) {
+		reached |= (frontier[word - 1] & field->open_right[word - 1]) >> 63;
+	}
+
+	// From the right: bit x + 1 of the frontier through x's right side
+	uint64_t from_right = frontier_bits >> 1;
+	if (column + 1 < row_words) {
+		from_right |= frontier[word + 1] << 63;
+	}
+	reached |= from_right & open_right;
+
+	if (word >= row_words) {
+		reached |= frontier[word - row_words] & field->open_up[word - row_words];
+	}
+	if (word + row_words < row_words * field->height) {
+		reached |= frontier[word + row_words] & field->open_up[word];
+	}
+
+	return reached;
+}
+
+/*
+ * The nearer cells were found whole: everything else gets one step further by the offset, the nearer cells are
+ * taken two steps back from that, and further cells that a nearer cell at their own distance reaches stay where
+ * they were, as do further cells a step beyond those.
+ */
+void update_nearer(struct FlowField *field, uint32_t nearer_count, uint32_t further_count)
+{
+	uint32_t neighbors[4];
+
+	for (uint32_t index = 0; index < further_count; index++) {
+		field->marks[field->further_cells[index]] &= ~FLOW_FIELD_SETTLED;
+	}
+
+	uint32_t kept_count = 0;
+	uint32_t *kept_cells = field->further_cells;
+	for (uint32_t index = 0; index < nearer_count; index++) {
+		uint32_t cell = field->nearer_cells[index];
+		int64_t distance = get_level_distance(field, cell);
+
+		uint32_t neighbor_count = get_open_neighbors(field, cell, neighbors);
+		for (uint32_t neighbor_index = 0; neighbor_index < neighbor_count; neighbor_index++) {
+			uint32_t neighbor = neighbors[neighbor_index];
+			if (!(field->marks[neighbor] & FLOW_FIELD_NEARER) && !(field->marks[neighbor] & FLOW_FIELD_SETTLED)
+					&& get_level_distance(field, neighbor) == distance) {
+				field->marks[neighbor] |= FLOW_FIELD_SETTLED;
+				kept_cells[kept_count++] = neighbor;
+			}
+		}
+	}
+
+	for (uint32_t index = 0; index < nearer_count; index++) {
+		field->levels[field->nearer_cells[index]] -= 2;
+	}
+	field->level_offset++;
+
+	for (uint32_t index = 0; index < kept_count; index++) {
+		uint32_t cell = kept_cells[index];
+		field->levels[cell]--;
+		int64_t child_distance = get_level_distance(field, cell) + 1;
+
+		// Unsettled further cells still read one more than their old distance
+		uint32_t neighbor_count = get_open_neighbors(field, cell, neighbors);
+		for (uint32_t neighbor_index = 0; neighbor_index < neighbor_count; neighbor_index++) {
+			uint32_t neighbor = neighbors[neighbor_index];
+			if (!(field->marks[neighbor] & FLOW_FIELD_NEARER) && !(field->marks[neighbor] & FLOW_FIELD_SETTLED)
+					&& get_level_distance(field, neighbor) - 1 == child_distance) {
+				field->marks[neighbor] |= FLOW_FIELD_SETTLED;
+				kept_cells[kept_count++] = neighbor;
+			}
+		}
+	}
+
+	for (uint32_t index = 0; index < nearer_count; index++) {
+		field->marks[field->nearer_cells[index]] &= ~FLOW_FIELD_NEARER;
+	}
+	for (uint32_t index = 0; index < kept_count; index++) {
+		field->marks[kept_cells[index]] &= ~FLOW_FIELD_SETTLED;
+	}
+
+	field->cells_updated = nearer_count + kept_count;
+}
+
+/*
+ * The further cells were found whole, in order of distance: everything else gets one step nearer by the offset,
+ * and each further cell takes one more than its nearest neighbor that is already right, which is at most one more
+ * than its old distance.
+ */
+void update_further(struct FlowField *field, uint32_t nearer_count, uint32_t further_count)
+{
+	uint32_t neighbors[4];
+
+	for (uint32_t index = 0; index < nearer_count; index++) {
+		field->marks[field->nearer_cells[index]] &= ~FLOW_FIELD_NEARER;
+	}
+
+	field->level_offset--;
+
+	// Settled marks the further cells not yet redone; every other cell already reads its new distance
+	for (uint32_t index = 0; index < further_count; index++) {
+		uint32_t cell = field->further_cells[index];
+		int64_t distance = get_level_distance(field, cell) + 2; // one for the offset, one further
+
+		uint32_t neighbor_count = get_open_neighbors(field, cell, neighbors);
+		for (uint32_t neighbor_index = 0; neighbor_index < neighbor_count; neighbor_index++) {
+			uint32_t neighbor = neighbors[neighbor_index];
+			if (!(field->marks[neighbor] & FLOW_FIELD_SETTLED) && get_level_distance(field, neighbor) + 1 < distance) {
+				distance = get_level_distance(field, neighbor) + 1;
+			}
+		}
+
+		field->levels[cell] = (int32_t) (distance - field->level_offset);
+		field->marks[cell] &= ~FLOW_FIELD_SETTLED;
+	}
+
+	field->cells_updated = further_count;
+}
+
+uint32_t get_open_neighbors(struct FlowField *field, uint32_t cell, uint32_t *neighbors)
+{
+	uint32_t count = 0;
+	uint8_t open_sides = field->open_sides[cell];
+
+	if (open_sides & (1u << FLOW_FIELD_RIGHT)) {
+		neighbors[count++] = cell + 1;
+	}
+	if (open_sides & (1u << FLOW_FIELD_UP)) {
+		neighbors[count++] = cell + field->width;
+	}
+	if (open_sides & (1u << FLOW_FIELD_LEFT)) {
+		neighbors[count++] = cell - 1;
+	}
+	if (open_sides & (1u << FLOW_FIELD_DOWN)) {
+		neighbors[count++] = cell - field->width;
+	}
+
+	return count;
+}
+
+/* Only for reached cells */
+int64_t get_level_distance(struct FlowField *field, uint32_t cell)
+{
+	return field->levels[cell] + field->level_offset;
+}
+
+/* Toward the right or up only; the cell beyond gets the opposite side */
+void open_passage(struct FlowField *field, uint64_t *plane, uint32_t x, uint32_t y, enum FlowFieldDirection direction)
+{
+	plane[y * field->row_words + x / 64] |= 1ull << (x % 64);
+
+	uint32_t cell = y * field->width + x;
+	if (direction == FLOW_FIELD_RIGHT) {
+		field->open_sides[cell] |= 1u << FLOW_FIELD_RIGHT;
+		field->open_sides[cell + 1] |= 1u << FLOW_FIELD_LEFT;
+	} else {
+		field->open_sides[cell] |= 1u << FLOW_FIELD_UP;
+		field->open_sides[cell + field->width] |= 1u << FLOW_FIELD_DOWN;
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef flow_field_h
+#define flow_field_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../raycast-engine/raycast-engine.h"
+
+#define FLOW_FIELD_UNREACHED UINT32_MAX
+
+enum FlowFieldDirection {
+	FLOW_FIELD_NONE = 0, // at the target, or no way to it
+	FLOW_FIELD_RIGHT,
+	FLOW_FIELD_UP, // toward higher y
+	FLOW_FIELD_LEFT,
+	FLOW_FIELD_DOWN
+};
+
+/*
+ * Steps from every cell of a map to one target cell, so any number of agents can each find their next cell toward
+ * the target with a few lookups. Walls are read from the map once, into bit planes of the passages between cells,
+ * and the field is built by a breadth-first search whose frontier is itself a bit plane, 64 cells to a word.
+ *
+ * Moving the target to a neighboring cell changes every distance by at most one: cells that reach the new target
+ * through the old one get further, the rest get nearer. Distances are kept as levels plus a shared offset, so an
+ * update only rewrites the smaller of the two groups and shifts the other by changing the offset.
+ */
+struct FlowField {
+	uint32_t width;
+	uint32_t height;
+	uint64_t row_words; // plane words per row; every row starts on a word
+	uint64_t *open_right; // bit x of row y set: passage between (x, y) and (x + 1, y)
+	uint64_t *open_up; // bit x of row y set: passage between (x, y) and (x, y + 1)
+	uint8_t *open_sides; // per cell, bit 1 << direction for each open side; the same passages, for the updates
+
+	uint32_t target_x;
+	uint32_t target_y;
+	bool has_target;
+	int64_t level_offset; // a cell's distance is its level plus this
+	int32_t *levels; // INT32_MAX where unreached
+
+	// Search scratch. The planes are all clear between calls
+	uint64_t *visited;
+	uint64_t *frontier;
+	uint64_t *next_frontier;
+	uint64_t *frontier_words; // indices of the nonzero frontier words
+	uint64_t *next_frontier_words;
+	uint32_t *word_stamps; // the stamp a word was last queued under, so each is queued once per level
+	uint32_t stamp;
+	uint8_t *marks; // per cell, whether it is getting nearer or is settled, during an update
+	uint32_t *nearer_cells;
+	uint32_t *further_cells;
+
+	uint64_t cells_updated; // levels written by the last change of target
+};
+
+struct FlowField *flow_field_create(struct REMap *map, int transparent_material);
+void flow_field_destroy(struct FlowField *field);
+
+void flow_field_set_target(struct FlowField *field, uint32_t x, uint32_t y);
+void flow_field_move_target(struct FlowField *field, uint32_t x, uint32_t y);
+
+uint32_t flow_field_get_distance(struct FlowField *field, uint32_t x, uint32_t y);
+enum FlowFieldDirection flow_field_get_direction(struct FlowField *field, uint32_t x, uint32_t y);
+bool flow_field_is_open(struct FlowField *field, uint32_t x, uint32_t y, enum FlowFieldDirection direction);
+
+#endif // flow_field_h
@@ -0,0 +1,117 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif
+
+#include "frame-pacer.h"
+
+#define NS_PER_SEC 1000000000L
+
+static void sleep_until_ns(uint64_t deadline_ns);
+
+/* A target_rate <= 0 (FRAME_PACER_UNCAPPED) never sleeps */
+struct FramePacer *frame_pacer_create(double target_rate)
+{
+	struct FramePacer *pacer = malloc(sizeof *pacer);
+
+	pacer->period_ns = (target_rate > 0) ? (uint64_t) (NS_PER_SEC / target_rate) : 0;
+	frame_pacer_reset(pacer);
+
+	return pacer;
+}
+
+void frame_pacer_destroy(struct FramePacer *pacer)
+{
+	free(pacer);
+}
+
+/*
+ * Ends the current frame and sleeps until the next absolute deadline. If the frame overran by one or more whole
+ * periods, the missed deadlines are skipped rather than rendered back to back; their count is returned.
+ */
+uint32_t frame_pacer_wait(struct FramePacer *pacer)
+{
+	pacer->frame_count++;
+
+	if (frame_pacer_is_uncapped(pacer)) {
+		return 0;
+	}
+
+	uint64_t now_ns = frame_pacer_now_ns();
+	pacer->next_deadline_ns += pacer->period_ns;
+
+	uint32_t skipped = 0;
+	if (now_ns >= pacer->next_deadline_ns + pacer->period_ns) {
+		skipped = (now_ns - pacer->next_deadline_ns) / pacer->period_ns;
+		pacer->next_deadline_ns += (uint64_t) skipped * pacer->period_ns;
+		pacer->skipped_count += skipped;
+	}
+
+	if (now_ns < pacer->next_deadline_ns) {
+		sleep_until_ns(pacer->next_deadline_ns);
+	}
+
+	return skipped;
+}
+
+void frame_pacer_reset(struct FramePacer *pacer)
+{
+	pacer->start_ns = frame_pacer_now_ns();
+	pacer->next_deadline_ns = pacer->start_ns;
+	pacer->frame_count = 0;
+	pacer->skipped_count = 0;
+}
+
+/* Restarts the deadline sequence from now without clearing statistics, e.g. after deliberately idling */
+void frame_pacer_resync(struct FramePacer *pacer)
+{
+	pacer->next_deadline_ns = frame_pacer_now_ns();
+}
+
+bool frame_pacer_is_uncapped(struct FramePacer *pacer)
+{
+	return pacer->period_ns == 0;
+}
+
+double frame_pacer_get_target_rate(struct FramePacer *pacer)
+{
+	return frame_pacer_is_uncapped(pacer) ? 0 : (double) NS_PER_SEC / pacer->period_ns;
+}
+
+/* Frames per second since creation or the last reset */
+double frame_pacer_get_achieved_rate(struct FramePacer *pacer)
+{
+	uint64_t elapsed_ns = frame_pacer_now_ns() - pacer->start_ns;
+
+	return (elapsed_ns > 0) ? (double) pacer->frame_count * NS_PER_SEC / elapsed_ns : 0;
+}
+
+uint64_t frame_pacer_get_frame_count(struct FramePacer *pacer)
+{
+	return pacer->frame_count;
+}
+
+uint64_t frame_pacer_get_skipped_count(struct FramePacer *pacer)
+{
+	return pacer->skipped_count;
+}
+
+uint64_t frame_pacer_now_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+void sleep_until_ns(uint64_t deadline_ns)
+{
+	struct timespec deadline = { .tv_sec = deadline_ns / NS_PER_SEC, .tv_nsec = deadline_ns % NS_PER_SEC };
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+		// Interrupted by a signal; resume sleeping until the same deadline
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef frame_pacer_h
+#define frame_pacer_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FRAME_PACER_UNCAPPED 0
+
+struct FramePacer {
+	uint64_t period_ns; // 0 when uncapped
+	uint64_t start_ns;
+	uint64_t next_deadline_ns;
+	uint64_t frame_count;
+	uint64_t skipped_count;
+};
+
+struct FramePacer *frame_pacer_create(double target_rate);
+void frame_pacer_destroy(struct FramePacer *pacer);
+
+uint32_t frame_pacer_wait(struct FramePacer *pacer);
+void frame_pacer_reset(struct FramePacer *pacer);
+void frame_pacer_resync(struct FramePacer *pacer);
+
+bool frame_pacer_is_uncapped(struct FramePacer *pacer);
+double frame_pacer_get_target_rate(struct FramePacer *pacer);
+double frame_pacer_get_achieved_rate(struct FramePacer *pacer);
+uint64_t frame_pacer_get_frame_count(struct FramePacer *pacer);
+uint64_t frame_pacer_get_skipped_count(struct FramePacer *pacer);
+
+uint64_t frame_pacer_now_ns();
+
+#endif // frame_pacer_h
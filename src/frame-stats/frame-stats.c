@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "frame-stats.h"
+
+#define NS_PER_SEC 1000000000L
+
+// Rolling window of exact samples, for the overlay
+#define WINDOW_SIZE 256
+
+// Session-long log-linear histogram: values below LINEAR_LIMIT ns get their own bucket, larger values are split
+// into SUB_BUCKETS buckets per power of two (at most ~12% error)
+#define SUB_BUCKET_BITS 3
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define LINEAR_LIMIT (SUB_BUCKETS * 2)
+#define BUCKET_COUNT (LINEAR_LIMIT + (64 - SUB_BUCKET_BITS - 1) * SUB_BUCKETS)
+
+struct StageStats {
+	uint64_t window[WINDOW_SIZE];
+	uint32_t window_length;
+	uint32_t window_next;
+
+	uint64_t buckets[BUCKET_COUNT];
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+};
+
+static struct StageStats stage_stats[FRAME_STAGE_COUNT];
+
+static const char *STAGE_NAMES[FRAME_STAGE_COUNT] = {
+	[FRAME_STAGE_CAST]   = "cast",
+	[FRAME_STAGE_RASTER] = "raster",
+	[FRAME_STAGE_ENCODE] = "encode",
+	[FRAME_STAGE_WRITE]  = "write",
+	[FRAME_STAGE_FLUSH]  = "flush",
+	[FRAME_STAGE_FRAME]  = "frame"
+};
+
+static uint32_t bucket_of(uint64_t value);
+static uint64_t bucket_midpoint(uint32_t bucket);
+static double histogram_percentile(struct StageStats *stats, double percentile);
+static int compare_uint64(const void *a, const void *b);
+
+uint64_t frame_stats_now_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+void frame_stats_record(enum FrameStatsStage stage, uint64_t duration_ns)
+{
+	struct StageStats *stats = &stage_stats[stage];
+
+	stats->window[stats->window_next] = duration_ns;
+	stats->window_next = (stats->window_next + 1) % WINDOW_SIZE;
+	if (stats->window_length < WINDOW_SIZE) {
+		stats->window_length++;
+	}
+
+	stats->buckets[bucket_of(duration_ns)]++;
+	stats->count++;
+	stats->total_ns += duration_ns;
+	if (duration_ns > stats->max_ns) {
+		stats->max_ns = duration_ns;
+	}
+}
+
+const char *frame_stats_stage_name(enum FrameStatsStage stage)
+{
+	return STAGE_NAMES[stage];
+}
+
+/* Exact percentiles over the last WINDOW_SIZE frames */
+struct FrameStatsSummary frame_stats_get_window_summary(enum FrameStatsStage stage)
+{
+	struct StageStats *stats = &stage_stats[stage];
+	uint32_t length = stats->window_length;
+
+	if (length == 0) {
+		return (struct FrameStatsSummary) { 0 };
+	}
+
+	uint64_t sorted[WINDOW_SIZE];
+	memcpy(sorted, stats->window, length * sizeof sorted[0]);
+	qsort(sorted, length, sizeof sorted[0], compare_uint64);
+
+	uint64_t total = 0;
+	for (uint32_t index = 0; index < length; index++) {
+		total += sorted[index];
+	}
+
+	return (struct FrameStatsSummary) {
+		.count = length,
+		.mean_ns = (double) total / length,
+		.p50_ns = sorted[(length - 1) * 50 / 100],
+		.p95_ns = sorted[(length - 1) * 95 / 100],
+		.p99_ns = sorted[(length - 1) * 99 / 100],
+		.max_ns = sorted[length - 1]
+	};
+}
+
+/* Approximate percentiles over every recorded frame */
+struct FrameStatsSummary frame_stats_get_session_summary(enum FrameStatsStage stage)
+{
+	struct StageStats *stats = &stage_stats[stage];
+
+	if (stats->count == 0) {
+		return (struct FrameStatsSummary) { 0 };
+	}
+
+	return (struct FrameStatsSummary) {
+		.count = stats->count,
+		.mean_ns = (double) stats->total_ns / stats->count,
+		.p50_ns = histogram_percentile(stats, 0.50),
+		.p95_ns = histogram_percentile(stats, 0.95),
+		.p99_ns = histogram_percentile(stats, 0.99),
+		.max_ns = stats->max_ns
+	};
+}
+
+/* One line of "<stage> p50/p95/p99" in microseconds for every stage */
+void frame_stats_format_overlay(char *text, size_t size)
+{
+	size_t length = 0;
+	text[0] = '\0';
+
+	for (enum FrameStatsStage stage = 0; stage < FRAME_STAGE_COUNT && length < size; stage++) {
+		struct FrameStatsSummary summary = frame_stats_get_window_summary(stage);
+
+		int written = snprintf(text + length, size - length, "%s%s %.0f/%.0f/%.0f", (stage > 0) ? " " : "",
+				STAGE_NAMES[stage], summary.p50_ns / 1000, summary.p95_ns / 1000, summary.p99_ns / 1000);
+		if (written < 0) {
+			break;
+		}
+		length += written;
+	}
+}
+
+bool frame_stats_write_csv(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+
+	fprintf(file, "stage,count,mean_us,p50_us,p95_us,p99_us,max_us\n");
+	for (enum FrameStatsStage stage = 0; stage < FRAME_STAGE_COUNT; stage++) {
+		struct FrameStatsSummary summary = frame_stats_get_session_summary(stage);
+
+		fprintf(file, "%s,%llu,%.3f,%.3f,%.3f,%.3f,%.3f\n", STAGE_NAMES[stage], (unsigned long long) summary.count,
+				summary.mean_ns / 1000, summary.p50_ns / 1000, summary.p95_ns / 1000, summary.p99_ns / 1000,
+				summary.max_ns / 1000);
+	}
+
+	return fclose(file) == 0;
+}
+
+uint32_t bucket_of(uint64_t value)
+{
+	if (value < LINEAR_LIMIT) {
+		return value;
+	}
+
+	uint32_t magnitude = 63 - __builtin_clzll(value); // >= SUB_BUCKET_BITS + 1
+	uint32_t sub_bucket = (value >> (magnitude - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+
+	return LINEAR_LIMIT + (magnitude - SUB_BUCKET_BITS - 1) * SUB_BUCKETS + sub_bucket;
+}
+
+uint64_t bucket_midpoint(uint32_t bucket)
+{
+	if (bucket < LINEAR_LIMIT) {
+		return bucket;
+	}
+
+	uint32_t magnitude = (bucket - LINEAR_LIMIT) / SUB_BUCKETS + SUB_BUCKET_BITS + 1;
+	uint64_t sub_bucket = (bucket - LINEAR_LIMIT) % SUB_BUCKETS;
+	uint64_t width = 1ULL << (magnitude - SUB_BUCKET_BITS);
+	uint64_t lower = (1ULL << magnitude) + sub_bucket * width;
+
+	return lower + width / 2;
+}
+
+double histogram_percentile(struct StageStats *stats, double percentile)
+{
+	uint64_t rank = (uint64_t) (percentile * (stats->count - 1)) + 1;
+	uint64_t seen = 0;
+
+	for (uint32_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+		seen += stats->buckets[bucket];
+		if (seen >= rank) {
+			uint64_t midpoint = bucket_midpoint(bucket);
+			return (midpoint < stats->max_ns) ? midpoint : stats->max_ns;
+		}
+	}
+
+	return stats->max_ns;
+}
+
+int compare_uint64(const void *a, const void *b)
+{
+	uint64_t value_a = *(const uint64_t *) a;
+	uint64_t value_b = *(const uint64_t *) b;
+
+	return (value_a > value_b) - (value_a < value_b);
+}
@@ -0,0 +1,55 @@
+#ifndef frame_stats_h
+#define frame_stats_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../trace/trace.h"
+
+enum FrameStatsStage {
+	FRAME_STAGE_CAST = 0,
+	FRAME_STAGE_RASTER,
+	FRAME_STAGE_ENCODE,
+	FRAME_STAGE_WRITE,
+	FRAME_STAGE_FLUSH,
+	FRAME_STAGE_FRAME, // everything above, excluding pacing
+	FRAME_STAGE_COUNT
+};
+
+struct FrameStatsSummary {
+	uint64_t count;
+	double mean_ns;
+	double p50_ns;
+	double p95_ns;
+	double p99_ns;
+	double max_ns;
+};
+
+/*
+ * Stage timing compiles to nothing unless FRAME_STATS is defined (make stats). BEGIN and END must be in the same
+ * scope, and each stage may be timed only once per scope.
+ */
+#ifdef FRAME_STATS
+#define FRAME_STATS_BEGIN(stage) uint64_t frame_stats_start_##stage = frame_stats_now_ns()
+#define FRAME_STATS_END(stage) frame_stats_record(stage, frame_stats_now_ns() - frame_stats_start_##stage)
+#else
+#define FRAME_STATS_BEGIN(stage)
+#define FRAME_STATS_END(stage)
+#endif // FRAME_STATS
+
+/* Times a frame stage for both frame stats and the trace */
+#define FRAME_STAGE_BEGIN(stage) FRAME_STATS_BEGIN(stage); TRACE_BEGIN(frame_stats_stage_name(stage))
+#define FRAME_STAGE_END(stage) FRAME_STATS_END(stage); TRACE_END(frame_stats_stage_name(stage))
+
+uint64_t frame_stats_now_ns();
+void frame_stats_record(enum FrameStatsStage stage, uint64_t duration_ns);
+
+const char *frame_stats_stage_name(enum FrameStatsStage stage);
+struct FrameStatsSummary frame_stats_get_window_summary(enum FrameStatsStage stage);
+struct FrameStatsSummary frame_stats_get_session_summary(enum FrameStatsStage stage);
+
+void frame_stats_format_overlay(char *text, size_t size);
+bool frame_stats_write_csv(const char *path);
+
+#endif // frame_stats_h
@@ -0,0 +1,62 @@
+#include <stdlib.h>
+
+#include "../mem-utils/mem-macros.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif
+
+#include "input-queue.h"
+
+struct InputQueue *input_queue_create(uint32_t min_capacity)
+{
+	uint32_t capacity = 1;
+	while (capacity < min_capacity) {
+		capacity <<= 1;
+	}
+
+	struct InputQueue *queue = ALLOC_FLEX_STRUCT(queue, events, capacity);
+
+	queue->mask = capacity - 1;
+	atomic_init(&queue->head, 0);
+	atomic_init(&queue->tail, 0);
+
+	return queue;
+}
+
+void input_queue_destroy(struct InputQueue *queue)
+{
+	free(queue);
+}
+
+/* Producer only. Returns false (dropping the event) when the queue is full. */
+bool input_queue_push(struct InputQueue *queue, struct InputEvent event)
+{
+	uint_fast32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	uint_fast32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+	if (tail - head > queue->mask) {
+		return false;
+	}
+
+	queue->events[tail & queue->mask] = event;
+	atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+	return true;
+}
+
+/* Consumer only. Returns false when the queue is empty. */
+bool input_queue_pop(struct InputQueue *queue, struct InputEvent *event)
+{
+	uint_fast32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	uint_fast32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+	if (head == tail) {
+		return false;
+	}
+
+	*event = queue->events[head & queue->mask];
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+	return true;
+}
@@ -0,0 +1,35 @@
+#ifndef input_queue_h
+#define input_queue_h
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define INPUT_QUEUE_CACHE_LINE 64
+
+struct InputEvent {
+	uint64_t time_ns;
+	char key;
+};
+
+/* Lock-free ring for exactly one producer thread and one consumer thread */
+struct InputQueue {
+	uint32_t mask; // capacity - 1; capacity is a power of two
+
+	// head and tail live on separate cache lines so the two threads don't share one
+	char head_padding[INPUT_QUEUE_CACHE_LINE];
+	atomic_uint_fast32_t head; // next slot to pop; written only by the consumer
+	char tail_padding[INPUT_QUEUE_CACHE_LINE];
+	atomic_uint_fast32_t tail; // next slot to push; written only by the producer
+	char events_padding[INPUT_QUEUE_CACHE_LINE];
+
+	struct InputEvent events[];
+};
+
+struct InputQueue *input_queue_create(uint32_t min_capacity);
+void input_queue_destroy(struct InputQueue *queue);
+
+bool input_queue_push(struct InputQueue *queue, struct InputEvent event);
+bool input_queue_pop(struct InputQueue *queue, struct InputEvent *event);
+
+#endif // input_queue_h
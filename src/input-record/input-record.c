@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mem-utils/mem-macros.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif
+
+#include "input-record.h"
+
+#define NS_PER_SEC 1000000000L
+
+static const char *const MAP_KIND_NAMES[INPUT_RECORD_MAP_KIND_COUNT] = { "maze", "world", "file" };
+
+static bool parse_map_kind(const char *name, enum InputRecordMapKind *p_map_kind);
+static void apply_events_until(struct InputReplay *replay, uint64_t tick);
+
+struct InputRecord *input_record_create(enum InputRecordMapKind map_kind, uint64_t seed, uint32_t map_width,
+		uint32_t map_height, double tick_rate)
+{
+	struct InputRecord *record = malloc(sizeof *record);
+
+	record->map_kind = map_kind;
+	record->seed = seed;
+	record->map_width = map_width;
+	record->map_height = map_height;
+	record->tick_rate = tick_rate;
+
+	record->event_count = 0;
+	record->event_size = 0;
+	record->events = NULL;
+
+	record->end_tick = 0;
+	record->end_time_ns = 0;
+
+	return record;
+}
+
+void input_record_destroy(struct InputRecord *record)
+{
+	free(record->events);
+	free(record);
+}
+
+void input_record_add(struct InputRecord *record, uint64_t tick, uint64_t time_ns, char key)
+{
+	if (record->event_count == record->event_size) {
+		record->event_size = (record->event_size > 0) ? record->event_size * 2 : 256;
+		record->events = REALLOC_ARR(record->events, record->event_size);
+	}
+
+	record->events[record->event_count] = (struct RecordedInput) { .tick = tick, .time_ns = time_ns, .key = key };
+	record->event_count++;
+
+	record->end_tick = tick;
+	record->end_time_ns = time_ns;
+}
+
+void input_record_finish(struct InputRecord *record, uint64_t tick, uint64_t time_ns)
+{
+	record->end_tick = tick;
+	record->end_time_ns = time_ns;
+}
+
+/*
+ * Plain text, one entry per line:
+ *   raycast-input-record <version>
+ *   seed <seed>
+ *   map <maze|world|file> <width> <height>
+ *   tick-rate <rate>
+ *   key <tick> <time_ns> <key code>   (repeated)
+ *   end <tick> <time_ns>
+ */
+bool input_record_save(struct InputRecord *record, const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+
+	fprintf(file, "raycast-input-record %d\n", INPUT_RECORD_VERSION);
+	fprintf(file, "seed %llu\n", (unsigned long long) record->seed);
+	fprintf(file, "map %s %u %u\n", MAP_KIND_NAMES[record->map_kind], record->map_width, record->map_height);
+	fprintf(file, "tick-rate %.17g\n", record->tick_rate);
+
+	for (size_t index = 0; index < record->event_count; index++) {
+		struct RecordedInput *event = &record->events[index];
+		fprintf(file, "key %llu %llu %d\n", (unsigned long long) event->tick, (unsigned long long) event->time_ns,
+				(unsigned char) event->key);
+	}
+
+	fprintf(file, "end %llu %llu\n", (unsigned long long) record->end_tick,
+			(unsigned long long) record->end_time_ns);
+
+	return fclose(file) == 0;
+}
+
+/* Returns NULL if the file can't be read or isn't a version INPUT_RECORD_VERSION recording */
+struct InputRecord *input_record_load(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		return NULL;
+	}
+
+	int version;
+	unsigned long long seed;
+	char map_kind_name[8];
+	enum InputRecordMapKind map_kind;
+	uint32_t map_width, map_height;
+	double tick_rate;
+
+	if (fscanf(file, "raycast-input-record %d seed %llu map %7s %u %u tick-rate %lf", &version, &seed,
+				map_kind_name, &map_width, &map_height, &tick_rate) != 6 || version != INPUT_RECORD_VERSION
+			|| !parse_map_kind(map_kind_name, &map_kind) || tick_rate <= 0) {
+		fclose(file);
+		return NULL;
+	}
+
+	struct InputRecord *record = input_record_create(map_kind, seed, map_width, map_height, tick_rate);
+
+	char tag[8];
+	unsigned long long tick, time_ns;
+	bool ended = false;
+
+	while (!ended && fscanf(file, "%7s %llu %llu", tag, &tick, &time_ns) == 3) {
+		int key;
+
+		if (tag[0] == 'k' && fscanf(file, "%d", &key) == 1) {
+			input_record_add(record, tick, time_ns, (char) key);
+		} else if (tag[0] == 'e') {
+			input_record_finish(record, tick, time_ns);
+			ended = true;
+		} else {
+			break;
+		}
+	}
+
+	fclose(file);
+
+	if (!ended) {
+		input_record_destroy(record);
+		return NULL;
+	}
+
+	return record;
+}
+
+/* The simulation must start from the same map (record->seed) and player state as the recorded session */
+struct InputReplay *input_replay_create(struct InputRecord *record, struct Simulation *simulation)
+{
+	struct InputReplay *replay = malloc(sizeof *replay);
+
+	replay->record = record;
+	replay->simulation = simulation;
+	replay->next_event = 0;
+	replay->step_pending = false;
+
+	replay->tick_ns = NS_PER_SEC / record->tick_rate;
+	replay->base_tick = simulation->tick_count;
+	replay->base_time_ns = 0;
+
+	return replay;
+}
+
+void input_replay_destroy(struct InputReplay *replay)
+{
+	free(replay);
+}
+
+/*
+ * Runs the simulation forward until its recorded clock would pass until_ns or max_ticks have run, returning the
+ * number of ticks run. Idle stretches, where the live simulation stopped ticking, are jumped over.
+ */
+uint32_t input_replay_advance(struct InputReplay *replay, uint64_t until_ns, uint32_t max_ticks)
+{
+	struct InputRecord *record = replay->record;
+	struct Simulation *simulation = replay->simulation;
+	uint32_t ticks = 0;
+
+	while (ticks < max_ticks && !input_replay_is_finished(replay)) {
+		// Live, the simulation slept here until the next key press and resumed its clock from it
+		if (!replay->step_pending && simulation_is_at_rest(simulation)) {
+			if (replay->next_event == record->event_count) {
+				break;
+			}
+
+			struct RecordedInput *event = &record->events[replay->next_event];
+			if (event->time_ns > until_ns) {
+				break;
+			}
+
+			replay->base_tick = simulation->tick_count;
+			replay->base_time_ns = event->time_ns;
+			apply_events_until(replay, event->tick);
+		}
+
+		apply_events_until(replay, simulation->tick_count);
+
+		uint64_t tick_time_ns = replay->base_time_ns
+			+ (uint64_t) ((simulation->tick_count + 1 - replay->base_tick) * replay->tick_ns);
+		if (tick_time_ns > until_ns) {
+			break;
+		}
+
+		simulation_step(simulation);
+		replay->step_pending = false;
+		ticks++;
+	}
+
+	return ticks;
+}
+
+/* Recorded time of the simulation's latest tick, relative to the start of the session */
+uint64_t input_replay_get_tick_time_ns(struct InputReplay *replay)
+{
+	return replay->base_time_ns
+		+ (uint64_t) ((replay->simulation->tick_count - replay->base_tick) * replay->tick_ns);
+}
+
+bool input_replay_is_finished(struct InputReplay *replay)
+{
+	struct Simulation *simulation = replay->simulation;
+
+	if (replay->next_event < replay->record->event_count || replay->step_pending) {
+		return false;
+	}
+
+	return simulation->tick_count >= replay->record->end_tick || simulation_is_at_rest(simulation);
+}
+
+static bool parse_map_kind(const char *name, enum InputRecordMapKind *p_map_kind)
+{
+	for (int kind = 0; kind < INPUT_RECORD_MAP_KIND_COUNT; kind++) {
+		if (strcmp(name, MAP_KIND_NAMES[kind]) == 0) {
+			*p_map_kind = kind;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void apply_events_until(struct InputReplay *replay, uint64_t tick)
+{
+	struct InputRecord *record = replay->record;
+
+	while (replay->next_event < record->event_count && record->events[replay->next_event].tick <= tick) {
+		simulation_apply_input(replay->simulation, record->events[replay->next_event].key);
+		replay->next_event++;
+		replay->step_pending = true;
+	}
+}
@@ -0,0 +1,73 @@
+#ifndef input_record_h
+#define input_record_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../simulation/simulation.h"
+
+#define INPUT_RECORD_VERSION 2
+
+/* How the recorded session's map was made; only generated maps can be rebuilt from the seed */
+enum InputRecordMapKind {
+	INPUT_RECORD_MAP_MAZE = 0,
+	INPUT_RECORD_MAP_WORLD, // the chunked world of --infinite
+	INPUT_RECORD_MAP_FILE,
+	INPUT_RECORD_MAP_KIND_COUNT
+};
+
+/*
+ * Everything needed to reproduce a session: the map's kind and seed and every key press tagged with the simulation tick it
+ * was applied on. time_ns is relative to the start of the session and only used to pace a replay.
+ */
+struct InputRecord {
+	enum InputRecordMapKind map_kind;
+	uint64_t seed;
+	uint32_t map_width;
+	uint32_t map_height;
+	double tick_rate;
+
+	size_t event_count;
+	size_t event_size;
+	struct RecordedInput {
+		uint64_t tick;
+		uint64_t time_ns;
+		char key;
+	} *events;
+
+	uint64_t end_tick;
+	uint64_t end_time_ns;
+};
+
+/* Feeds a recording back into a simulation on the ticks the keys were originally applied */
+struct InputReplay {
+	struct InputRecord *record;
+	struct Simulation *simulation;
+	size_t next_event;
+	bool step_pending; // input was applied this tick, so the tick must run even if the player is at rest
+
+	// Tick base_tick ran at base_time_ns; ticks after it follow at tick_ns until the player comes to rest
+	double tick_ns;
+	uint64_t base_tick;
+	uint64_t base_time_ns;
+};
+
+struct InputRecord *input_record_create(enum InputRecordMapKind map_kind, uint64_t seed, uint32_t map_width,
+		uint32_t map_height, double tick_rate);
+void input_record_destroy(struct InputRecord *record);
+
+void input_record_add(struct InputRecord *record, uint64_t tick, uint64_t time_ns, char key);
+void input_record_finish(struct InputRecord *record, uint64_t tick, uint64_t time_ns);
+
+bool input_record_save(struct InputRecord *record, const char *path);
+struct InputRecord *input_record_load(const char *path);
+
+struct InputReplay *input_replay_create(struct InputRecord *record, struct Simulation *simulation);
+void input_replay_destroy(struct InputReplay *replay);
+
+uint32_t input_replay_advance(struct InputReplay *replay, uint64_t until_ns, uint32_t max_ticks);
+uint64_t input_replay_get_tick_time_ns(struct InputReplay *replay);
+bool input_replay_is_finished(struct InputReplay *replay);
+
+#endif // input_record_h
@@ -1,16 +1,30 @@
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "../mem-utils/mem-macros.h"
 
 #include "maze-gen.h"
 
+// A multiple of 64, so tiles side by side never share a bit plane word
+#define MAZE_TILE_SIZE 256
+
 struct MazeCellPosition {
 	uint32_t col;
 	uint32_t row;
 	enum MazeCellWall shared_wall;
 };
 
+struct TileJob {
+	struct PackedMaze *maze;
+	uint64_t seed;
+	uint32_t tile_columns;
+	uint32_t tile_rows;
+	atomic_uint_fast32_t next_tile;
+};
+
 static void maze_init(struct Maze *maze, uint32_t width, uint32_t height);
 static bool cell_has_wall(struct MazeCell *cell, enum MazeCellWall wall);
 static void cell_add_wall(struct MazeCell *cell, enum MazeCellWall wall);
@@ -21,6 +35,16 @@ static uint8_t get_cell_neighbor_positions(struct Maze *maze, uint32_t col, uint
 		struct MazeCellPosition *neighbor_positions);
 static uint8_t get_cell_unvisited_neighbor_positions(struct Maze *maze, uint32_t col, uint32_t row,
 		struct MazeCellPosition *unvisited_neighbor_positions);
+static void carve_region(struct PackedMaze *maze, uint32_t region_col, uint32_t region_row, uint32_t width,
+		uint32_t height, struct Rng *rng);
+static void *tile_worker_func(void *data);
+static void join_tiles(struct PackedMaze *maze, uint32_t tile_columns, uint32_t tile_rows, uint64_t seed);
+static uint32_t find_set_root(uint32_t *parents, uint32_t index);
+static uint64_t draw_coins(struct Rng *rng);
+static uint64_t get_bit_plane_words(uint64_t bit_count);
+static bool bit_plane_get(const uint64_t *plane, uint64_t index);
+static void bit_plane_set(uint64_t *plane, uint64_t index);
+static void bit_plane_clear(uint64_t *plane, uint64_t index);
 
 struct Maze *maze_create(uint32_t width, uint32_t height)
 {
@@ -77,6 +101,265 @@ void maze_generate(struct Maze *maze)
 	free(position_stack);
 }
 
+/* NULL if either dimension is 0 */
+struct PackedMaze *maze_packed_create(uint32_t width, uint32_t height)
+{
+	if (width == 0 || height == 0) {
+		return NULL;
+	}
+
+	struct PackedMaze *maze = malloc(sizeof *maze);
+
+	maze->width = width;
+	maze->height = height;
+	maze->row_words = get_bit_plane_words(width);
+
+	uint64_t word_count = maze->row_words * height;
+	maze->right_walls = ALLOC_ARR(maze->right_walls, word_count);
+	maze->bottom_walls = ALLOC_ARR(maze->bottom_walls, word_count);
+
+	for (uint64_t word = 0; word < word_count; word++) {
+		maze->right_walls[word] = ~0ULL;
+		maze->bottom_walls[word] = ~0ULL;
+	}
+
+	return maze;
+}
+
+void maze_packed_destroy(struct PackedMaze *maze)
+{
+	free(maze->right_walls);
+	free(maze->bottom_walls);
+	free(maze);
+}
+
+void maze_packed_generate(struct PackedMaze *maze, struct Rng *rng)
+{
+	carve_region(maze, 0, 0, maze->width, maze->height, rng);
+}
+
+/*
+ * Carves a perfect maze in each tile, in parallel, then joins the tiles with a random spanning tree over the tile
+ * grid: a union-find pass over the tile borders opens one wall for each border it accepts. Tile i draws from
+ * stream i + 1 of the seed and the joining pass from stream 0, so the maze depends only on the seed and not on
+ * thread_count. A thread_count of 0 uses every online core.
+ */
+void maze_packed_generate_tiled(struct PackedMaze *maze, uint64_t seed, uint32_t thread_count)
+{
+	struct TileJob job = {
+		.maze = maze,
+		.seed = seed,
+		.tile_columns = (maze->width + MAZE_TILE_SIZE - 1) / MAZE_TILE_SIZE,
+		.tile_rows = (maze->height + MAZE_TILE_SIZE - 1) / MAZE_TILE_SIZE
+	};
+	atomic_init(&job.next_tile, 0);
+	uint32_t tile_count = job.tile_columns * job.tile_rows;
+
+	if (thread_count == 0) {
+		long core_count = sysconf(_SC_NPROCESSORS_ONLN);
+		thread_count = (core_count > 0) ? (uint32_t) core_count : 1;
+	}
+	if (thread_count > tile_count) {
+		thread_count = tile_count;
+	}
+
+	// The calling thread takes tiles too, so it picks up any a thread that failed to start would have taken
+	pthread_t *threads = ALLOC_ARR(threads, thread_count);
+	uint32_t started_count = 1;
+	while (started_count < thread_count
+			&& pthread_create(&threads[started_count], NULL, tile_worker_func, &job) == 0) {
+		started_count++;
+	}
+	tile_worker_func(&job);
+	for (uint32_t thread = 1; thread < started_count; thread++) {
+		pthread_join(threads[thread], NULL);
+	}
+	free(threads);
+
+	join_tiles(maze, job.tile_columns, job.tile_rows, seed);
+}
+
+/* Writes each row straight into the planes, so the maze never exists in any other form */
+void maze_packed_generate_streamed(struct PackedMaze *maze, uint64_t seed)
+{
+	struct MazeRowStream *stream = maze_row_stream_create(maze->width, seed);
+	if (stream == NULL) {
+		return;
+	}
+
+	for (uint32_t row = 0; row < maze->height; row++) {
+		uint64_t offset = row * maze->row_words;
+		maze_row_stream_next(stream, &maze->right_walls[offset], &maze->bottom_walls[offset], row == maze->height - 1);
+	}
+
+	maze_row_stream_destroy(stream);
+}
+
+bool maze_packed_has_wall(struct PackedMaze *maze, uint32_t col, uint32_t row, enum MazeCellWall wall)
+{
+	uint64_t row_bits = maze->row_words * 64;
+	uint64_t index = row * row_bits + col;
+
+	switch (wall) {
+	case MAZE_WALL_TOP:
+		return row == 0 || bit_plane_get(maze->bottom_walls, index - row_bits);
+	case MAZE_WALL_RIGHT:
+		return (col == maze->width - 1) ? (row != maze->height - 1) : bit_plane_get(maze->right_walls, index);
+	case MAZE_WALL_BOTTOM:
+		return row == maze->height - 1 || bit_plane_get(maze->bottom_walls, index);
+	case MAZE_WALL_LEFT:
+	default:
+		return (col == 0) ? (row != 0) : bit_plane_get(maze->right_walls, index - 1);
+	}
+}
+
+/* NULL for a width of 0 */
+struct MazeRowStream *maze_row_stream_create(uint32_t width, uint64_t seed)
+{
+	if (width == 0) {
+		return NULL;
+	}
+
+	struct MazeRowStream *stream = malloc(sizeof *stream);
+
+	stream->width = width;
+	stream->row_words = get_bit_plane_words(width);
+	rng_init(&stream->rng, seed, 0);
+
+	stream->set_count = 0;
+	stream->sets = ALLOC_ARR(stream->sets, width);
+	stream->parents = ALLOC_ARR(stream->parents, width);
+	stream->member_counts = ALLOC_ARR(stream->member_counts, width);
+	stream->down_cells = ALLOC_ARR(stream->down_cells, width);
+	stream->goes_down = ALLOC_ARR(stream->goes_down, width);
+
+	for (uint32_t col = 0; col < width; col++) {
+		stream->sets[col] = MAZE_ROW_STREAM_NO_SET;
+	}
+
+	return stream;
+}
+
+void maze_row_stream_destroy(struct MazeRowStream *stream)
+{
+	free(stream->sets);
+	free(stream->parents);
+	free(stream->member_counts);
+	free(stream->down_cells);
+	free(stream->goes_down);
+	free(stream);
+}
+
+void maze_row_stream_next(struct MazeRowStream *stream, uint64_t *right_walls, uint64_t *bottom_walls, bool last)
+{
+	uint32_t width = stream->width;
+	uint32_t *sets = stream->sets;
+	uint32_t *parents = stream->parents;
+	struct Rng rng = stream->rng; // a local copy, so stores to the arrays don't force reloads
+	uint64_t coins = 0;
+
+	for (uint64_t word = 0; word < stream->row_words; word++) {
+		right_walls[word] = ~0ULL;
+		bottom_walls[word] = ~0ULL;
+	}
+
+	// Cells closed off from above start sets of their own
+	uint32_t set_count = stream->set_count;
+	for (uint32_t col = 0; col < width; col++) {
+		if (sets[col] == MAZE_ROW_STREAM_NO_SET) {
+			sets[col] = set_count++;
+		}
+	}
+	for (uint32_t set = 0; set < set_count; set++) {
+		parents[set] = set;
+	}
+
+	/*
+	 * Join neighbours from different sets at random; the last row must join them all. The coin flips are
+	 * unpredictable, so the loops below apply them with selects and masks rather than branches, and draw them
+	 * a word at a time.
+	 */
+	uint32_t root = find_set_root(parents, sets[0]);
+	for (uint32_t col = 0; col + 1 < width; col++) {
+		if (col % 64 == 0) {
+			coins = draw_coins(&rng);
+		}
+
+		uint32_t next_root = find_set_root(parents, sets[col + 1]);
+		bool join = (root != next_root) & (last | ((coins >> (col % 64)) & 1));
+
+		parents[next_root] = join ? root : next_root;
+		right_walls[col / 64] &= ~((uint64_t) join << (col % 64));
+		root = join ? root : next_root;
+	}
+
+	if (last) {
+		stream->rng = rng;
+		for (uint32_t col = 0; col < width; col++) {
+			sets[col] = MAZE_ROW_STREAM_NO_SET;
+		}
+		stream->set_count = 0;
+
+		return;
+	}
+
+	// Open walls below at random, then give every set that got none a way down through a random member
+	uint32_t *member_counts = stream->member_counts;
+	uint32_t *down_cells = stream->down_cells;
+	bool *goes_down = stream->goes_down;
+	for (uint32_t set = 0; set < set_count; set++) {
+		member_counts[set] = 0;
+		goes_down[set] = false;
+	}
+	for (uint32_t col = 0; col < width; col++) {
+		if (col % 64 == 0) {
+			coins = draw_coins(&rng);
+			bottom_walls[col / 64] = ~coins;
+		}
+
+		uint32_t set = find_set_root(parents, sets[col]);
+		sets[col] = set;
+
+		member_counts[set]++;
+		goes_down[set] |= (coins >> (col % 64)) & 1;
+	}
+
+	// Closed sets are rare past a few members, so this is mostly singletons and a cheap scan
+	bool any_closed = false;
+	for (uint32_t set = 0; set < set_count; set++) {
+		if (parents[set] == set && !goes_down[set]) {
+			down_cells[set] = rng_below(&rng, member_counts[set]); // which member, counting from the left
+			any_closed = true;
+		}
+	}
+	for (uint32_t col = 0; any_closed && col < width; col++) {
+		uint32_t set = sets[col];
+
+		if (!goes_down[set] && down_cells[set]-- == 0) {
+			bit_plane_clear(bottom_walls, col);
+		}
+	}
+	stream->rng = rng;
+
+	// Renumber the sets that continue down from 0, reusing member_counts for the mapping
+	uint32_t *numbers = member_counts;
+	for (uint32_t set = 0; set < set_count; set++) {
+		numbers[set] = MAZE_ROW_STREAM_NO_SET;
+	}
+	uint32_t number_count = 0;
+	for (uint32_t col = 0; col < width; col++) {
+		bool continues = !bit_plane_get(bottom_walls, col);
+		uint32_t set = sets[col];
+
+		bool first = continues & (numbers[set] == MAZE_ROW_STREAM_NO_SET);
+		numbers[set] = first ? number_count : numbers[set];
+		number_count += first;
+
+		sets[col] = continues ? numbers[set] : MAZE_ROW_STREAM_NO_SET;
+	}
+	stream->set_count = number_count;
+}
+
 struct MazeCell *maze_get_cell(struct Maze *maze, uint32_t col, uint32_t row)
 {
 	uint64_t index = (uint64_t) row * maze->width + col;
@@ -205,3 +488,239 @@ uint8_t get_cell_unvisited_neighbor_positions(struct Maze *maze, uint32_t col, u
 	return unvisited_neighbor_count;
 }
 
+/*
+ * The depth-first carve of maze_generate confined to a rectangle, remembering only the wall crossed to enter each
+ * cell on the path. Walls on the rectangle's edge are left alone.
+ */
+void carve_region(struct PackedMaze *maze, uint32_t region_col, uint32_t region_row, uint32_t width, uint32_t height,
+		struct Rng *rng)
+{
+	uint64_t cell_count = (uint64_t) width * height;
+	uint64_t row_bits = maze->row_words * 64;
+
+	uint64_t *visited = CALLOC_ARR(visited, get_bit_plane_words(cell_count));
+	uint64_t *direction_stack = ALLOC_ARR(direction_stack, get_bit_plane_words(cell_count * 2));
+	uint64_t depth = 0;
+
+	// Position in the region (visited) and in the maze (walls)
+	uint32_t col = width / 2;
+	uint32_t row = height / 2;
+	uint64_t index = (uint64_t) row * width + col;
+	uint64_t wall_index = (uint64_t) (region_row + row) * row_bits + region_col + col;
+	bit_plane_set(visited, index);
+
+	while (true) {
+		enum MazeCellWall unvisited_walls[4];
+		uint32_t unvisited_count = 0;
+
+		if (col > 0 && !bit_plane_get(visited, index - 1)) {
+			unvisited_walls[unvisited_count++] = MAZE_WALL_LEFT;
+		}
+		if (row > 0 && !bit_plane_get(visited, index - width)) {
+			unvisited_walls[unvisited_count++] = MAZE_WALL_TOP;
+		}
+		if (col < width - 1 && !bit_plane_get(visited, index + 1)) {
+			unvisited_walls[unvisited_count++] = MAZE_WALL_RIGHT;
+		}
+		if (row < height - 1 && !bit_plane_get(visited, index + width)) {
+			unvisited_walls[unvisited_count++] = MAZE_WALL_BOTTOM;
+		}
+
+		if (unvisited_count > 0) {
+			enum MazeCellWall wall = unvisited_walls[rng_below(rng, unvisited_count)];
+
+			switch (wall) {
+			case MAZE_WALL_TOP:
+				row--;
+				index -= width;
+				wall_index -= row_bits;
+				bit_plane_clear(maze->bottom_walls, wall_index);
+				break;
+			case MAZE_WALL_RIGHT:
+				bit_plane_clear(maze->right_walls, wall_index);
+				col++;
+				index++;
+				wall_index++;
+				break;
+			case MAZE_WALL_BOTTOM:
+				bit_plane_clear(maze->bottom_walls, wall_index);
+				row++;
+				index += width;
+				wall_index += row_bits;
+				break;
+			case MAZE_WALL_LEFT:
+				col--;
+				index--;
+				wall_index--;
+				bit_plane_clear(maze->right_walls, wall_index);
+				break;
+			}
+			bit_plane_set(visited, index);
+
+			uint32_t shift = (depth % 32) * 2;
+			direction_stack[depth / 32] &= ~(3ULL << shift);
+			direction_stack[depth / 32] |= (uint64_t) wall << shift;
+			depth++;
+		} else if (depth > 0) {
+			depth--;
+			enum MazeCellWall wall = (direction_stack[depth / 32] >> ((depth % 32) * 2)) & 3;
+
+			// Back out through the wall we came in by
+			switch (wall) {
+			case MAZE_WALL_TOP:
+				row++;
+				index += width;
+				wall_index += row_bits;
+				break;
+			case MAZE_WALL_RIGHT:
+				col--;
+				index--;
+				wall_index--;
+				break;
+			case MAZE_WALL_BOTTOM:
+				row--;
+				index -= width;
+				wall_index -= row_bits;
+				break;
+			case MAZE_WALL_LEFT:
+				col++;
+				index++;
+				wall_index++;
+				break;
+			}
+		} else {
+			break;
+		}
+	}
+
+	free(visited);
+	free(direction_stack);
+}
+
+void *tile_worker_func(void *data)
+{
+	struct TileJob *job = data;
+	uint32_t tile_count = job->tile_columns * job->tile_rows;
+
+	while (true) {
+		uint32_t tile = atomic_fetch_add(&job->next_tile, 1);
+		if (tile >= tile_count) {
+			break;
+		}
+
+		uint32_t col = (tile % job->tile_columns) * MAZE_TILE_SIZE;
+		uint32_t row = (tile / job->tile_columns) * MAZE_TILE_SIZE;
+		uint32_t width = (job->maze->width - col < MAZE_TILE_SIZE) ? job->maze->width - col : MAZE_TILE_SIZE;
+		uint32_t height = (job->maze->height - row < MAZE_TILE_SIZE) ? job->maze->height - row : MAZE_TILE_SIZE;
+
+		struct Rng rng;
+		rng_init(&rng, job->seed, tile + 1);
+		carve_region(job->maze, col, row, width, height, &rng);
+	}
+
+	return NULL;
+}
+
+/*
+ * Kruskal over the tile grid. Every tile is already a spanning tree of its cells, so opening one wall on each
+ * border that joins two different components leaves a spanning tree of the whole maze.
+ */
+void join_tiles(struct PackedMaze *maze, uint32_t tile_columns, uint32_t tile_rows, uint64_t seed)
+{
+	uint32_t tile_count = tile_columns * tile_rows;
+	uint64_t row_bits = maze->row_words * 64;
+
+	struct Rng rng;
+	rng_init(&rng, seed, 0);
+
+	// Border of tile / 2 with its right neighbour if even, with the one below if odd
+	uint32_t *borders = ALLOC_ARR(borders, (uint64_t) tile_count * 2);
+	uint32_t border_count = 0;
+	for (uint32_t tile = 0; tile < tile_count; tile++) {
+		if (tile % tile_columns < tile_columns - 1) {
+			borders[border_count++] = tile * 2;
+		}
+		if (tile / tile_columns < tile_rows - 1) {
+			borders[border_count++] = tile * 2 + 1;
+		}
+	}
+	for (uint32_t index = border_count; index > 1; index--) {
+		uint32_t other = rng_below(&rng, index);
+		uint32_t swap = borders[index - 1];
+		borders[index - 1] = borders[other];
+		borders[other] = swap;
+	}
+
+	uint32_t *parents = ALLOC_ARR(parents, tile_count);
+	for (uint32_t tile = 0; tile < tile_count; tile++) {
+		parents[tile] = tile;
+	}
+
+	for (uint32_t index = 0; index < border_count; index++) {
+		uint32_t tile = borders[index] / 2;
+		bool below = borders[index] % 2;
+		uint32_t neighbor = below ? tile + tile_columns : tile + 1;
+
+		uint32_t root = find_set_root(parents, tile);
+		uint32_t neighbor_root = find_set_root(parents, neighbor);
+		if (root == neighbor_root) {
+			continue;
+		}
+		parents[neighbor_root] = root;
+
+		uint32_t col = (tile % tile_columns) * MAZE_TILE_SIZE;
+		uint32_t row = (tile / tile_columns) * MAZE_TILE_SIZE;
+		if (below) {
+			uint32_t width = (maze->width - col < MAZE_TILE_SIZE) ? maze->width - col : MAZE_TILE_SIZE;
+			uint64_t wall_index = (uint64_t) (row + MAZE_TILE_SIZE - 1) * row_bits + col + rng_below(&rng, width);
+			bit_plane_clear(maze->bottom_walls, wall_index);
+		} else {
+			uint32_t height = (maze->height - row < MAZE_TILE_SIZE) ? maze->height - row : MAZE_TILE_SIZE;
+			uint64_t wall_index = (uint64_t) (row + rng_below(&rng, height)) * row_bits + col + MAZE_TILE_SIZE - 1;
+			bit_plane_clear(maze->right_walls, wall_index);
+		}
+	}
+
+	free(borders);
+	free(parents);
+}
+
+/* 64 fair coin flips */
+uint64_t draw_coins(struct Rng *rng)
+{
+	uint64_t high = rng_next(rng);
+	uint64_t low = rng_next(rng);
+
+	return (high << 32) | low;
+}
+
+/* With path halving */
+uint32_t find_set_root(uint32_t *parents, uint32_t index)
+{
+	while (parents[index] != index) {
+		parents[index] = parents[parents[index]];
+		index = parents[index];
+	}
+
+	return index;
+}
+
+uint64_t get_bit_plane_words(uint64_t bit_count)
+{
+	return (bit_count + 63) / 64;
+}
+
+bool bit_plane_get(const uint64_t *plane, uint64_t index)
+{
+	return (plane[index / 64] >> (index % 64)) & 1;
+}
+
+void bit_plane_set(uint64_t *plane, uint64_t index)
+{
+	plane[index / 64] |= 1ULL << (index % 64);
+}
+
+void bit_plane_clear(uint64_t *plane, uint64_t index)
+{
+	plane[index / 64] &= ~(1ULL << (index % 64));
+}
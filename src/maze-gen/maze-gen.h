@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "../rng/rng.h"
+
 enum MazeCellWall {
 	MAZE_WALL_TOP = 0,
 	MAZE_WALL_RIGHT,
@@ -16,10 +18,14 @@ struct Maze {
 	uint32_t height;
 	struct MazeCell {
 		bool visited : 1;
-		uint8_t walls : 4;
+		uint8_t walls : 4; // bit n set: wall n of enum MazeCellWall
+		uint8_t tag : 3; // left 0 by the maze; free for callers to mark cells with
 	} cells[];
 };
 
+// Cells are single bytes, so callers can read them straight out of cells as masks
+_Static_assert(sizeof (struct MazeCell) == 1, "struct MazeCell must be one byte");
+
 struct Maze *maze_create(uint32_t width, uint32_t height);
 void maze_destroy(struct Maze *maze);
 
@@ -36,5 +42,54 @@ void maze_remove_wall(struct Maze *maze, uint32_t col, uint32_t row, enum MazeCe
 
 bool maze_is_position_in_bounds(struct Maze *maze, int64_t col, int64_t row);
 
+/*
+ * The same kind of maze as Maze, perfect and with the same openings, at a fraction of the memory. It draws from an
+ * Rng rather than rand(), so a seed doesn't give the same maze as maze_generate. Walls are bit planes in which each
+ * cell owns its right and bottom walls, and the outer border is implicit (closed except for the openings).
+ * Generation keeps a visited bit plane and a 2-bit-per-step backtrack stack, about 5 bits per cell in all.
+ */
+struct PackedMaze {
+	uint32_t width;
+	uint32_t height;
+	uint64_t row_words; // plane words per row; every row starts on a word
+	uint64_t *right_walls; // bit col of row row set: wall between (col, row) and (col + 1, row)
+	uint64_t *bottom_walls; // bit col of row row set: wall between (col, row) and (col, row + 1)
+};
+
+struct PackedMaze *maze_packed_create(uint32_t width, uint32_t height);
+void maze_packed_destroy(struct PackedMaze *maze);
+
+void maze_packed_generate(struct PackedMaze *maze, struct Rng *rng);
+void maze_packed_generate_tiled(struct PackedMaze *maze, uint64_t seed, uint32_t thread_count);
+
+void maze_packed_generate_streamed(struct PackedMaze *maze, uint64_t seed);
+
+bool maze_packed_has_wall(struct PackedMaze *maze, uint32_t col, uint32_t row, enum MazeCellWall wall);
+
+/*
+ * Eller's algorithm: produces a perfect maze one row at a time in PackedMaze row layout, keeping O(width) state, so
+ * the height is unbounded. Every row but the last leaves at least one way down from each set of connected cells;
+ * the row passed last = true joins them all and closes the maze.
+ */
+struct MazeRowStream {
+	uint32_t width;
+	uint64_t row_words; // words in each row passed to maze_row_stream_next
+	struct Rng rng;
+
+	uint32_t set_count; // sets carried down from the previous row, numbered from 0
+	uint32_t *sets; // per cell; MAZE_ROW_STREAM_NO_SET where the wall above is closed
+	uint32_t *parents; // union-find over the set numbers of the current row
+	uint32_t *member_counts;
+	uint32_t *down_cells; // per set that no cell left by: the member that goes down
+	bool *goes_down;
+};
+
+#define MAZE_ROW_STREAM_NO_SET UINT32_MAX
+
+struct MazeRowStream *maze_row_stream_create(uint32_t width, uint64_t seed);
+void maze_row_stream_destroy(struct MazeRowStream *stream);
+
+void maze_row_stream_next(struct MazeRowStream *stream, uint64_t *right_walls, uint64_t *bottom_walls, bool last);
+
 #endif // maze_gen_h
 
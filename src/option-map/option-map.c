@@ -104,6 +104,16 @@ char *option_map_get_option_value(struct OptionMap *option_map, const char *opti
 	return option->value;
 }
 
+/* A copy for the caller to free, which outlives the map; NULL if the option wasn't given */
+char *option_map_copy_option_value(struct OptionMap *option_map, const char *option_name)
+{
+	if (!option_map_is_option_given(option_map, option_name)) {
+		return NULL;
+	}
+
+	return str_dup(option_map_get_option_value(option_map, option_name));
+}
+
 void str_arr_destroy(char **str_arr)
 {
 	size_t size = str_arr_len(str_arr) + 1;
@@ -39,6 +39,7 @@ struct OptionMapError option_map_set_options(struct OptionMap *option_map, int o
 
 bool option_map_is_option_given(struct OptionMap *option_map, const char *option_name);
 char *option_map_get_option_value(struct OptionMap *option_map, const char *option_name);
+char *option_map_copy_option_value(struct OptionMap *option_map, const char *option_name);
 
 struct OptionMapError option_map_get_last_error();
 void option_map_print_error_message(FILE *stream, const char *prefix, struct OptionMapError error);
@@ -0,0 +1,134 @@
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif // MEM_DEBUG
+
+#include "perf-counters.h"
+
+static int open_counter(uint64_t config, int group_fd);
+
+static const uint64_t COUNTER_CONFIGS[PERF_COUNTER_COUNT] = {
+	[PERF_COUNTER_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+	[PERF_COUNTER_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+	[PERF_COUNTER_CACHE_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+	[PERF_COUNTER_BRANCH_MISSES] = PERF_COUNT_HW_BRANCH_MISSES
+};
+
+static const char *COUNTER_NAMES[PERF_COUNTER_COUNT] = {
+	[PERF_COUNTER_CYCLES] = "cycles",
+	[PERF_COUNTER_INSTRUCTIONS] = "instructions",
+	[PERF_COUNTER_CACHE_MISSES] = "cache_misses",
+	[PERF_COUNTER_BRANCH_MISSES] = "branch_misses"
+};
+
+/*
+ * Returns NULL when hardware counters aren't available at all (no PMU, a VM without passthrough, or
+ * perf_event_paranoid > 2). Counters other than cycles that fail to open are left out of the group.
+ */
+struct PerfCounters *perf_counters_create()
+{
+	int group_fd = open_counter(COUNTER_CONFIGS[PERF_COUNTER_CYCLES], -1);
+	if (group_fd < 0) {
+		return NULL;
+	}
+
+	struct PerfCounters *counters = malloc(sizeof *counters);
+	counters->group_fd = group_fd;
+	counters->fds[PERF_COUNTER_CYCLES] = group_fd;
+	counters->read_index[PERF_COUNTER_CYCLES] = 0;
+	counters->open_count = 1;
+
+	for (int counter = PERF_COUNTER_CYCLES + 1; counter < PERF_COUNTER_COUNT; counter++) {
+		counters->fds[counter] = open_counter(COUNTER_CONFIGS[counter], group_fd);
+
+		if (counters->fds[counter] >= 0) {
+			counters->read_index[counter] = counters->open_count;
+			counters->open_count++;
+		}
+	}
+
+	return counters;
+}
+
+void perf_counters_destroy(struct PerfCounters *counters)
+{
+	for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+		if (counters->fds[counter] >= 0) {
+			close(counters->fds[counter]);
+		}
+	}
+
+	free(counters);
+}
+
+void perf_counters_reset(struct PerfCounters *counters)
+{
+	ioctl(counters->group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+}
+
+/* Enabling and disabling don't reset, so a group can accumulate over many short intervals */
+void perf_counters_enable(struct PerfCounters *counters)
+{
+	ioctl(counters->group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void perf_counters_disable(struct PerfCounters *counters)
+{
+	ioctl(counters->group_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/* Counts are scaled up if the kernel had to multiplex the group with other events */
+bool perf_counters_read(struct PerfCounters *counters, struct PerfCounterValues *values)
+{
+	struct {
+		uint64_t count;
+		uint64_t time_enabled;
+		uint64_t time_running;
+		uint64_t values[PERF_COUNTER_COUNT];
+	} group;
+
+	memset(values, 0, sizeof *values);
+
+	ssize_t expected = (3 + counters->open_count) * sizeof(uint64_t);
+	if (read(counters->group_fd, &group, sizeof group) < expected) {
+		return false;
+	}
+
+	double scale = (group.time_running > 0) ? (double) group.time_enabled / group.time_running : 1;
+
+	for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+		if (counters->fds[counter] >= 0) {
+			values->counts[counter] = (uint64_t) (group.values[counters->read_index[counter]] * scale);
+			values->valid[counter] = true;
+		}
+	}
+
+	return true;
+}
+
+const char *perf_counter_name(enum PerfCounter counter)
+{
+	return COUNTER_NAMES[counter];
+}
+
+static int open_counter(uint64_t config, int group_fd)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof attr);
+
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof attr;
+	attr.config = config;
+	attr.disabled = (group_fd < 0); // members follow the leader
+	attr.exclude_kernel = 1; // keeps the enable/disable ioctls themselves out of the counts
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+}
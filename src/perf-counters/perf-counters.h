@@ -0,0 +1,38 @@
+#ifndef perf_counters_h
+#define perf_counters_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum PerfCounter {
+	PERF_COUNTER_CYCLES,
+	PERF_COUNTER_INSTRUCTIONS,
+	PERF_COUNTER_CACHE_MISSES,
+	PERF_COUNTER_BRANCH_MISSES,
+	PERF_COUNTER_COUNT
+};
+
+struct PerfCounterValues {
+	uint64_t counts[PERF_COUNTER_COUNT];
+	bool valid[PERF_COUNTER_COUNT]; // false if the counter couldn't be opened on this machine
+};
+
+/* One perf_event_open group counting user-space events of the calling thread while enabled */
+struct PerfCounters {
+	int group_fd; // cycles, the group leader
+	int fds[PERF_COUNTER_COUNT]; // -1 for counters that couldn't be opened
+	uint32_t read_index[PERF_COUNTER_COUNT]; // position of each open counter in a group read
+	uint32_t open_count;
+};
+
+struct PerfCounters *perf_counters_create();
+void perf_counters_destroy(struct PerfCounters *counters);
+
+void perf_counters_reset(struct PerfCounters *counters);
+void perf_counters_enable(struct PerfCounters *counters);
+void perf_counters_disable(struct PerfCounters *counters);
+bool perf_counters_read(struct PerfCounters *counters, struct PerfCounterValues *values);
+
+const char *perf_counter_name(enum PerfCounter counter);
+
+#endif // perf_counters_h
@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif
+
+#include "pose-snapshot.h"
+
+struct PoseSnapshot *pose_snapshot_create(struct PoseState state)
+{
+	struct PoseSnapshot *snapshot = malloc(sizeof *snapshot);
+
+	uint64_t words[POSE_SNAPSHOT_WORDS];
+	memcpy(words, &state, sizeof state);
+
+	atomic_init(&snapshot->sequence, 0);
+	for (size_t index = 0; index < POSE_SNAPSHOT_WORDS; index++) {
+		atomic_init(&snapshot->words[index], words[index]);
+	}
+
+	return snapshot;
+}
+
+void pose_snapshot_destroy(struct PoseSnapshot *snapshot)
+{
+	free(snapshot);
+}
+
+/* Writer only */
+void pose_snapshot_publish(struct PoseSnapshot *snapshot, struct PoseState state)
+{
+	uint64_t words[POSE_SNAPSHOT_WORDS];
+	memcpy(words, &state, sizeof state);
+
+	uint_fast32_t sequence = atomic_load_explicit(&snapshot->sequence, memory_order_relaxed);
+	atomic_store_explicit(&snapshot->sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	for (size_t index = 0; index < POSE_SNAPSHOT_WORDS; index++) {
+		atomic_store_explicit(&snapshot->words[index], words[index], memory_order_relaxed);
+	}
+
+	atomic_store_explicit(&snapshot->sequence, sequence + 2, memory_order_release);
+}
+
+/* Retries while a write is in progress or completed mid-read, so every field belongs to the same tick */
+struct PoseState pose_snapshot_read(struct PoseSnapshot *snapshot)
+{
+	uint64_t words[POSE_SNAPSHOT_WORDS];
+	uint_fast32_t sequence_before, sequence_after;
+
+	do {
+		sequence_before = atomic_load_explicit(&snapshot->sequence, memory_order_acquire);
+
+		for (size_t index = 0; index < POSE_SNAPSHOT_WORDS; index++) {
+			words[index] = atomic_load_explicit(&snapshot->words[index], memory_order_relaxed);
+		}
+
+		atomic_thread_fence(memory_order_acquire);
+		sequence_after = atomic_load_explicit(&snapshot->sequence, memory_order_relaxed);
+	} while ((sequence_before & 1) || sequence_before != sequence_after);
+
+	struct PoseState state;
+	memcpy(&state, words, sizeof state);
+
+	return state;
+}
+
+/* alpha = 0 gives from, alpha = 1 gives to; rotation takes the shorter way around */
+struct Pose pose_interpolate(struct Pose from, struct Pose to, double alpha)
+{
+	return (struct Pose) {
+		.x = from.x + (to.x - from.x) * alpha,
+		.y = from.y + (to.y - from.y) * alpha,
+		.rotation = binary_angle_add(from.rotation,
+				(struct BinaryAngle) { (uint32_t) (int32_t) (binary_angle_difference(from.rotation, to.rotation) * alpha) })
+	};
+}
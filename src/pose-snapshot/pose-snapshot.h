@@ -0,0 +1,39 @@
+#ifndef pose_snapshot_h
+#define pose_snapshot_h
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "../fixed/fixed.h"
+
+struct Pose {
+	double x;
+	double y;
+	struct BinaryAngle rotation;
+};
+
+/* The last two simulation ticks, so readers can interpolate between them */
+struct PoseState {
+	struct Pose previous;
+	struct Pose current;
+	uint64_t tick_time_ns; // when current was produced
+	uint64_t tick_count;
+};
+
+#define POSE_SNAPSHOT_WORDS (sizeof (struct PoseState) / sizeof (uint64_t))
+
+/* Seqlock: one writer publishes whole states; any number of readers get consistent copies without blocking it */
+struct PoseSnapshot {
+	atomic_uint_fast32_t sequence; // odd while a write is in progress
+	_Atomic uint64_t words[POSE_SNAPSHOT_WORDS];
+};
+
+struct PoseSnapshot *pose_snapshot_create(struct PoseState state);
+void pose_snapshot_destroy(struct PoseSnapshot *snapshot);
+
+void pose_snapshot_publish(struct PoseSnapshot *snapshot, struct PoseState state);
+struct PoseState pose_snapshot_read(struct PoseSnapshot *snapshot);
+
+struct Pose pose_interpolate(struct Pose from, struct Pose to, double alpha);
+
+#endif // pose_snapshot_h
@@ -0,0 +1,168 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mem-utils/mem-macros.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif // MEM_DEBUG
+
+#include "ray-stats.h"
+
+#define HEATMAP_CELL_PIXELS 8
+
+static struct RayStatsSummary totals;
+
+// Per-cell visit counts, sized to the last map seen; row 0 is map y 0
+static uint64_t *cell_visits = NULL;
+static uint32_t visits_width = 0;
+static uint32_t visits_height = 0;
+
+static bool has_suffix(const char *string, const char *suffix);
+
+/* Counts a cell lookup, or a bounds failure if (x, y) is outside the map */
+void ray_stats_record_cell(struct REMap *map, int64_t x, int64_t y)
+{
+	if (!re_map_coords_in_bounds(map, x, y)) {
+		totals.bounds_failures++;
+		return;
+	}
+
+	// A chunked map is far too large for a heatmap, so only the totals count
+	if (map->chunk_table != NULL) {
+		totals.cells_visited++;
+		return;
+	}
+
+	// A different map starts a new heatmap
+	if (map->width != visits_width || map->height != visits_height) {
+		free(cell_visits);
+		cell_visits = CALLOC_ARR(cell_visits, (uint64_t) map->width * map->height);
+		visits_width = map->width;
+		visits_height = map->height;
+	}
+
+	totals.cells_visited++;
+	cell_visits[(uint64_t) y * visits_width + x]++;
+}
+
+void ray_stats_record_ray(uint64_t steps, bool out_of_bounds_hit)
+{
+	totals.rays++;
+	totals.dda_steps += steps;
+	totals.out_of_bounds_hits += out_of_bounds_hit;
+
+	if (steps > totals.max_steps) {
+		totals.max_steps = steps;
+	}
+}
+
+/* Clears the counters and heatmap, keeping its allocation */
+void ray_stats_reset()
+{
+	memset(&totals, 0, sizeof totals);
+
+	if (cell_visits != NULL) {
+		memset(cell_visits, 0, (uint64_t) visits_width * visits_height * sizeof cell_visits[0]);
+	}
+}
+
+void ray_stats_free()
+{
+	free(cell_visits);
+	cell_visits = NULL;
+	visits_width = 0;
+	visits_height = 0;
+}
+
+struct RayStatsSummary ray_stats_get_summary()
+{
+	struct RayStatsSummary summary = totals;
+	summary.mean_steps = (totals.rays > 0) ? (double) totals.dda_steps / totals.rays : 0;
+
+	return summary;
+}
+
+uint64_t ray_stats_get_cell_visits(uint32_t x, uint32_t y)
+{
+	if (cell_visits == NULL || x >= visits_width || y >= visits_height) {
+		return 0;
+	}
+
+	return cell_visits[(uint64_t) y * visits_width + x];
+}
+
+/* Picks the format from the extension: .csv, otherwise PGM */
+bool ray_stats_write_heatmap(const char *path)
+{
+	if (has_suffix(path, ".csv")) {
+		return ray_stats_write_heatmap_csv(path);
+	}
+
+	return ray_stats_write_heatmap_pgm(path, HEATMAP_CELL_PIXELS);
+}
+
+/*
+ * Greyscale image with map +y up and each cell drawn as cell_pixels square. Brightness is log-scaled so that
+ * rarely visited cells stay distinguishable from unvisited ones next to hot spots.
+ */
+bool ray_stats_write_heatmap_pgm(const char *path, uint32_t cell_pixels)
+{
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		return false;
+	}
+
+	uint64_t max_visits = 0;
+	for (uint64_t index = 0; index < (uint64_t) visits_width * visits_height; index++) {
+		if (cell_visits[index] > max_visits) {
+			max_visits = cell_visits[index];
+		}
+	}
+	double scale = (max_visits > 0) ? 255 / log1p((double) max_visits) : 0;
+
+	uint32_t image_width = visits_width * cell_pixels;
+	uint32_t image_height = visits_height * cell_pixels;
+	fprintf(file, "P5\n%u %u\n255\n", image_width, image_height);
+
+	uint8_t row_pixels[image_width > 0 ? image_width : 1];
+	for (uint32_t image_row = 0; image_row < image_height; image_row++) {
+		uint32_t y = visits_height - 1 - image_row / cell_pixels;
+
+		for (uint32_t x = 0; x < visits_width; x++) {
+			uint8_t shade = (uint8_t) round(log1p((double) cell_visits[(uint64_t) y * visits_width + x]) * scale);
+			memset(&row_pixels[x * cell_pixels], shade, cell_pixels);
+		}
+
+		fwrite(row_pixels, 1, image_width, file);
+	}
+
+	return fclose(file) == 0;
+}
+
+bool ray_stats_write_heatmap_csv(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+
+	fprintf(file, "x,y,visits\n");
+	for (uint32_t y = 0; y < visits_height; y++) {
+		for (uint32_t x = 0; x < visits_width; x++) {
+			fprintf(file, "%u,%u,%llu\n", x, y, (unsigned long long) cell_visits[(uint64_t) y * visits_width + x]);
+		}
+	}
+
+	return fclose(file) == 0;
+}
+
+static bool has_suffix(const char *string, const char *suffix)
+{
+	size_t string_length = strlen(string);
+	size_t suffix_length = strlen(suffix);
+
+	return string_length >= suffix_length && strcmp(string + string_length - suffix_length, suffix) == 0;
+}
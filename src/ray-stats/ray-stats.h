@@ -0,0 +1,48 @@
+#ifndef ray_stats_h
+#define ray_stats_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../raycast-engine/raycast-engine.h"
+
+struct RayStatsSummary {
+	uint64_t rays;
+	uint64_t dda_steps;
+	uint64_t cells_visited; // in-bounds cell lookups
+	uint64_t bounds_failures; // lookups outside the map
+	uint64_t out_of_bounds_hits; // rays that ended on the out-of-bounds material
+	uint64_t max_steps; // most DDA steps taken by a single ray
+	double mean_steps;
+};
+
+/*
+ * Traversal counting compiles to nothing unless RAY_STATS is defined (make ray-stats). RAY_BEGIN and RAY_END
+ * must be in the same scope. Not thread-safe; only the render thread should cast instrumented rays.
+ */
+#ifdef RAY_STATS
+#define RAY_STATS_RAY_BEGIN() uint64_t ray_stats_steps = 0
+#define RAY_STATS_STEP() ray_stats_steps++
+#define RAY_STATS_CELL(map, x, y) ray_stats_record_cell(map, x, y)
+#define RAY_STATS_RAY_END(out_of_bounds_hit) ray_stats_record_ray(ray_stats_steps, out_of_bounds_hit)
+#else
+#define RAY_STATS_RAY_BEGIN()
+#define RAY_STATS_STEP()
+#define RAY_STATS_CELL(map, x, y)
+#define RAY_STATS_RAY_END(out_of_bounds_hit)
+#endif // RAY_STATS
+
+void ray_stats_record_cell(struct REMap *map, int64_t x, int64_t y);
+void ray_stats_record_ray(uint64_t steps, bool out_of_bounds_hit);
+
+void ray_stats_reset();
+void ray_stats_free();
+
+struct RayStatsSummary ray_stats_get_summary();
+uint64_t ray_stats_get_cell_visits(uint32_t x, uint32_t y);
+
+bool ray_stats_write_heatmap(const char *path);
+bool ray_stats_write_heatmap_pgm(const char *path, uint32_t cell_pixels);
+bool ray_stats_write_heatmap_csv(const char *path);
+
+#endif // ray_stats_h
@@ -1,179 +1,480 @@
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "../fixed/fixed.h"
 #include "../mem-utils/mem-macros.h"
+#include "../ray-stats/ray-stats.h"
 
 #ifdef MEM_DEBUG
 #include "../mem-utils/mem-debug.h"
 #endif // MEM_DEBUG
 
 #include "raycast-engine.h"
+#include "re-chunk-loader.h"
+#include "re-chunk-table.h"
+#include "re-map-file.h"
 
-#define PI 3.14159265358979323846
+#define SIGHT_BATCH_SIZE 256 // queries a thread takes at a time
 
 typedef struct Fixed64 fixed64_t;
 
-static uint8_t get_angle_quadrant(double reduced_angle);
-static double reduce_angle(double angle);
+/* The next row and column lines a ray will cross, and where it crosses them */
+struct RayWalk {
+	fixed64_t intercept_x; // x at row line tile_y
+	fixed64_t intercept_y; // y at column line tile_x
+	fixed64_t step_x; // intercept_x change from one row line to the next
+	fixed64_t step_y;
+	int32_t tile_x;
+	int32_t tile_y;
+	uint8_t quadrant;
+	bool crosses_rows; // false when the ray runs along a row
+	bool crosses_columns;
+};
+
+struct RayHit {
+	double x;
+	double y;
+	int material;
+};
+
+/* Cell lookups on a flat map */
+struct FlatReader {
+	struct REMap *map;
+	struct REMapCell *cells;
+	uint32_t width;
+};
+
+/* Cell lookups on a masked map: a byte per cell, expanded through the source's table */
+struct MaskReader {
+	struct REMap *map;
+	const uint8_t *masks;
+	ptrdiff_t row_stride;
+	const struct REMapCell *cell_table;
+};
+
+/*
+ * Cell lookups on a chunked map. The chunk being read is pinned, so its cells are read with the table unlocked; the
+ * table is only locked to move to another chunk. While loaders run, a missing chunk reads as out of bounds instead
+ * of being generated on the spot. Must be finished with finish_chunk_reader.
+ */
+struct ChunkReader {
+	struct REMap *map;
+	struct REChunkTable *table;
+	uint32_t chunk_x;
+	uint32_t chunk_y;
+	struct REMapCell *cells;
+	atomic_uint *pin_count; // of the chunk being read; NULL if it wasn't resident
+	struct REMapCell *generated_cells; // where a missing chunk is generated; allocated on first use
+};
+
+/*
+ * A segment's row and column line crossings, like a RayWalk's, but counted: the walk ends at the target's cell
+ * rather than at a wall
+ */
+struct SightWalk {
+	fixed64_t intercept_x;
+	fixed64_t intercept_y;
+	fixed64_t step_x;
+	fixed64_t step_y;
+	int32_t tile_x;
+	int32_t tile_y;
+	uint32_t rows_left;
+	uint32_t columns_left;
+	uint8_t quadrant; // of the direction from the first point to the second; an axis counts as positive
+};
+
+struct SightJob {
+	struct REMap *map;
+	const struct RESightQuery *queries;
+	bool *results;
+	size_t count;
+	int transparent_material;
+	atomic_size_t next_query;
+};
+
+static void walk_flat(struct FlatReader *reader, struct RayWalk walk, int transparent_material,
+		int out_of_bounds_material, struct RayHit *p_hit);
+static void walk_mask(struct MaskReader *reader, struct RayWalk walk, int transparent_material,
+		int out_of_bounds_material, struct RayHit *p_hit);
+static void walk_chunk(struct ChunkReader *reader, struct RayWalk walk, int transparent_material,
+		int out_of_bounds_material, struct RayHit *p_hit);
+static bool sight_flat(struct FlatReader *reader, struct SightWalk walk, int transparent_material);
+static bool sight_mask(struct MaskReader *reader, struct SightWalk walk, int transparent_material);
+static bool sight_chunk(struct ChunkReader *reader, struct SightWalk walk, int transparent_material);
+static void move_chunk_reader(struct ChunkReader *reader, uint32_t chunk_x, uint32_t chunk_y);
+static void finish_chunk_reader(struct ChunkReader *reader);
+static bool init_sight_walk(struct REMap *map, double from_x, double from_y, double to_x, double to_y,
+		struct SightWalk *p_walk);
+static void *sight_worker_func(void *data);
+static uint8_t get_angle_quadrant(struct BinaryAngle angle);
 static double distance_of_points(double x1, double y1, double x2, double y2);
 
 struct REMap *re_map_create(uint32_t width, uint32_t height)
 {
 	uint64_t area = (uint64_t) width * height;
-	struct REMap *map = ALLOC_FLEX_STRUCT(map, cells, area);
+	struct REMap *map = malloc(sizeof *map);
 
 	map->width = width;
 	map->height = height;
+	map->chunk_table = NULL;
+	map->mask_source = NULL;
+	map->mapping = NULL;
+	map->mapping_size = 0;
+	map->cells = ALLOC_ARR(map->cells, area);
+
+	return map;
+}
+
+/* The source is copied; the masks themselves are only read, and must outlive the map */
+struct REMap *re_map_create_masked(uint32_t width, uint32_t height, const struct REMaskSource *source)
+{
+	struct REMap *map = malloc(sizeof *map);
+
+	map->width = width;
+	map->height = height;
+	map->chunk_table = NULL;
+	map->mask_source = malloc(sizeof *map->mask_source);
+	*map->mask_source = *source;
+	map->mapping = NULL;
+	map->mapping_size = 0;
+	map->cells = NULL;
+
+	return map;
+}
+
+/* The budget covers chunk cells; it is rounded down to whole chunks, but never below a few */
+struct REMap *re_map_create_chunked(uint32_t width, uint32_t height, struct REChunkSource source,
+		size_t memory_budget)
+{
+	struct REMap *map = malloc(sizeof *map);
+
+	map->width = width;
+	map->height = height;
+	map->mask_source = NULL;
+	map->mapping = NULL;
+	map->mapping_size = 0;
+	map->cells = NULL;
+
+	size_t slot_count = memory_budget / (RE_CHUNK_AREA * sizeof map->cells[0]);
+	if (slot_count < RE_CHUNK_TABLE_MIN_SLOTS) {
+		slot_count = RE_CHUNK_TABLE_MIN_SLOTS;
+	}
+	map->chunk_table = re_chunk_table_create(source, (uint32_t) slot_count);
 
 	return map;
 }
 
 void re_map_destroy(struct REMap *map)
 {
+	if (map->chunk_table != NULL) {
+		re_map_stop_prefetch(map);
+		re_chunk_table_destroy(map->chunk_table);
+	}
+
+	if (map->mask_source != NULL) {
+		if (map->mask_source->release != NULL) {
+			map->mask_source->release(map->mask_source->context);
+		}
+		free(map->mask_source);
+	}
+
+	if (map->mapping != NULL) {
+		re_map_file_unmap(map);
+	} else {
+		free(map->cells);
+	}
 	free(map);
 }
 
+struct REChunkStats re_map_get_chunk_stats(struct REMap *map)
+{
+	if (map->chunk_table == NULL) {
+		return (struct REChunkStats) { 0 };
+	}
+
+	pthread_mutex_lock(&map->chunk_table->lock);
+	struct REChunkStats stats = map->chunk_table->stats;
+	pthread_mutex_unlock(&map->chunk_table->lock);
+
+	return stats;
+}
+
+/*
+ * Hands chunk generation to background loaders, which prefetch along re_map_hint_view's hints. From then on rays
+ * never wait for a chunk: one that isn't resident ends the ray as if it left the map. Does nothing on a flat map or
+ * one already prefetching.
+ */
+void re_map_start_prefetch(struct REMap *map, uint32_t thread_count)
+{
+	struct REChunkTable *table = map->chunk_table;
+	if (table == NULL || table->loader != NULL || thread_count == 0) {
+		return;
+	}
+
+	uint32_t chunk_columns = (uint32_t) (((uint64_t) map->width + RE_CHUNK_SIZE - 1) >> RE_CHUNK_SHIFT);
+	uint32_t chunk_rows = (uint32_t) (((uint64_t) map->height + RE_CHUNK_SIZE - 1) >> RE_CHUNK_SHIFT);
+	struct REChunkLoader *loader = re_chunk_loader_start(table, chunk_columns, chunk_rows, thread_count);
+
+	pthread_mutex_lock(&table->lock);
+	table->loader = loader;
+	pthread_mutex_unlock(&table->lock);
+}
+
+/* Waits for the loaders to finish the chunks they are generating. Rays then generate missing chunks again */
+void re_map_stop_prefetch(struct REMap *map)
+{
+	struct REChunkTable *table = map->chunk_table;
+	if (table == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&table->lock);
+	struct REChunkLoader *loader = table->loader;
+	table->loader = NULL;
+	pthread_mutex_unlock(&table->lock);
+
+	if (loader != NULL) {
+		re_chunk_loader_stop(loader);
+	}
+}
+
+/* Cheap enough to call every frame; ignored unless prefetching */
+void re_map_hint_view(struct REMap *map, struct REViewHint hint)
+{
+	struct REChunkTable *table = map->chunk_table;
+	if (table == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&table->lock);
+	if (table->loader != NULL) {
+		re_chunk_loader_post_hint(table->loader, hint);
+	}
+	pthread_mutex_unlock(&table->lock);
+}
+
 struct REMapCell re_map_get_cell(struct REMap *map, uint32_t x, uint32_t y)
 {
-	return map->cells[y * map->width + x];
+	if (map->cells != NULL) {
+		return map->cells[(size_t) y * map->width + x];
+	}
+
+	if (map->mask_source != NULL) {
+		struct REMaskSource *source = map->mask_source;
+		return source->cell_table[source->masks[(ptrdiff_t) y * source->row_stride + x]];
+	}
+
+	struct REChunkTable *table = map->chunk_table;
+	struct REMapCell *cells = re_chunk_table_lock_and_get(table, x >> RE_CHUNK_SHIFT, y >> RE_CHUNK_SHIFT);
+	struct REMapCell cell = cells[re_chunk_cell_index(x, y)];
+	pthread_mutex_unlock(&table->lock);
+
+	return cell;
 }
 
+/*
+ * On a chunked map the edit lasts until the chunk is evicted and generated again, and rays in other threads read
+ * chunks unlocked, so it must not overlap them. On a loaded map it stays private to this process and never reaches
+ * the file. A masked map's cells can't be edited.
+ */
 void re_map_set_cell(struct REMap *map, uint32_t x, uint32_t y, struct REMapCell cell)
 {
-	map->cells[y * map->width + x] = cell;
+	if (map->cells != NULL) {
+		map->cells[(size_t) y * map->width + x] = cell;
+		return;
+	}
+
+	if (map->mask_source != NULL) {
+		return;
+	}
+
+	struct REChunkTable *table = map->chunk_table;
+	re_chunk_table_lock_and_get(table, x >> RE_CHUNK_SHIFT, y >> RE_CHUNK_SHIFT)[re_chunk_cell_index(x, y)] = cell;
+	pthread_mutex_unlock(&table->lock);
 }
 
+/* Flat maps only; other maps' cells come from their sources */
 void re_map_fill(struct REMap *map, struct REMapCell cell)
 {
+	if (map->cells == NULL) {
+		return;
+	}
+
 	uint64_t area = (uint64_t) map->width * map->height;
 	for (uint64_t index = 0; index < area; index++) {
 		map->cells[index] = cell;
 	}
 }
 
-double re_cast_ray(struct REMap *map, double origin_x, double origin_y, double forward_angle, double rel_angle,
-		int transparent_material, int out_of_bounds_material, int *collided_material)
+double re_cast_ray(struct REMap *map, double origin_x, double origin_y, struct BinaryAngle forward_angle,
+		struct BinaryAngle rel_angle, int transparent_material, int out_of_bounds_material, int *collided_material)
 {
 	int32_t origin_x_whole = (int32_t) origin_x; // no floor--should always be positive
 	int32_t origin_y_whole = (int32_t) origin_y; // ^^^
-	double origin_x_frac = origin_x - origin_x_whole;
-	double origin_y_frac = origin_y - origin_y_whole;
-	double absolute_angle = reduce_angle(forward_angle + rel_angle);
+	fixed64_t origin_x_fixed = fixed64_from_double(origin_x);
+	fixed64_t origin_y_fixed = fixed64_from_double(origin_y);
+	fixed64_t origin_x_frac = { origin_x_fixed.as_int & UINT32_MAX };
+	fixed64_t origin_y_frac = { origin_y_fixed.as_int & UINT32_MAX };
+	struct BinaryAngle absolute_angle = binary_angle_add(forward_angle, rel_angle);
 
 	uint8_t quadrant = get_angle_quadrant(absolute_angle);
 
-	fixed64_t intercept_x = fixed64_from_double(origin_x + (1 - origin_y_frac) / tan(absolute_angle));
-	fixed64_t intercept_y = fixed64_from_double(origin_y + (1 - origin_x_frac) * tan(absolute_angle));
-
-	int32_t tile_x = origin_x_whole + 1;
-	int32_t tile_y = origin_y_whole + 1;
-
-	fixed64_t step_x = fixed64_from_double(1 / tan(absolute_angle));
-	fixed64_t step_y = fixed64_from_double(tan(absolute_angle));
-
-	int32_t tile_step_x = 1;
-	int32_t tile_step_y = 1;
+	// A ray along an axis never crosses the lines parallel to it
+	fixed64_t sine, cosine;
+	binary_angle_sin_cos(absolute_angle, &sine, &cosine);
+	bool crosses_rows = (sine.as_int != 0);
+	bool crosses_columns = (cosine.as_int != 0);
+
+	// The ratios are taken in double: one hardware divide each is far cheaper than a 128-bit fixed-point divide
+	struct RayWalk walk;
+	walk.step_x = crosses_rows
+		? fixed64_from_double((double) cosine.as_int / sine.as_int)
+		: (fixed64_t) { 0 };
+	walk.step_y = crosses_columns
+		? fixed64_from_double((double) sine.as_int / cosine.as_int)
+		: (fixed64_t) { 0 };
+
+	walk.intercept_x = fixed64_add(origin_x_fixed,
+			fixed64_multiply(fixed64_subtract(fixed64_from_int(1), origin_y_frac), walk.step_x));
+	walk.intercept_y = fixed64_add(origin_y_fixed,
+			fixed64_multiply(fixed64_subtract(fixed64_from_int(1), origin_x_frac), walk.step_y));
+
+	walk.tile_x = origin_x_whole + 1;
+	walk.tile_y = origin_y_whole + 1;
+	walk.quadrant = quadrant;
+	walk.crosses_rows = crosses_rows;
+	walk.crosses_columns = crosses_columns;
 
 	if (quadrant == 2 || quadrant == 3)
 	{
-		tile_step_x = -1;
-		step_y.as_int *= -1;
+		walk.step_y.as_int *= -1;
 
-		tile_x += tile_step_x;
-		intercept_y = fixed64_add(intercept_y, step_y);
+		walk.tile_x--;
+		walk.intercept_y = fixed64_add(walk.intercept_y, walk.step_y);
 	}
 	if (quadrant == 3 || quadrant == 4)
 	{
-		tile_step_y = -1;
-		step_x.as_int *= -1;
+		walk.step_x.as_int *= -1;
 
-		tile_y += tile_step_y;
-		intercept_x = fixed64_add(intercept_x, step_x);
+		walk.tile_y--;
+		walk.intercept_x = fixed64_add(walk.intercept_x, walk.step_x);
 	}
 
-	bool found_horiz_wall = false;
-	bool found_vert_wall = false;
+	struct RayHit hit;
+	if (map->cells != NULL) {
+		struct FlatReader reader = { map, map->cells, map->width };
+		walk_flat(&reader, walk, transparent_material, out_of_bounds_material, &hit);
+	} else if (map->mask_source != NULL) {
+		struct MaskReader reader = { map, map->mask_source->masks, map->mask_source->row_stride,
+			map->mask_source->cell_table };
+		walk_mask(&reader, walk, transparent_material, out_of_bounds_material, &hit);
+	} else {
+		struct ChunkReader reader = { map, map->chunk_table, RE_CHUNK_TABLE_NONE, RE_CHUNK_TABLE_NONE, NULL, NULL,
+			NULL };
+		walk_chunk(&reader, walk, transparent_material, out_of_bounds_material, &hit);
+		finish_chunk_reader(&reader);
+	}
+	*collided_material = hit.material;
 
-	double collision_coords[2] = {0, 0};
-	while (!found_horiz_wall && !found_vert_wall) {
-		if ((tile_step_x * intercept_x.as_int <= tile_step_x * ((int64_t) tile_x << 32)) && (intercept_x.as_int != (1L << 63))) {
-			int32_t intercept_x_floor = intercept_x.as_int >> 32;
+	double travel_distance = distance_of_points(origin_x, origin_y, hit.x, hit.y);
+	double forward_distance = travel_distance * fixed64_to_double(binary_angle_cos(rel_angle));
 
-			int top_cell_material    = re_map_coords_in_bounds(map, intercept_x_floor, tile_y)
-				? re_map_get_cell(map, intercept_x_floor, tile_y).material_bottom
-				: out_of_bounds_material;
+	return forward_distance;
+}
 
-			int bottom_cell_material = re_map_coords_in_bounds(map, intercept_x_floor, tile_y - 1)
-				? re_map_get_cell(map, intercept_x_floor, tile_y - 1).material_top
-				: out_of_bounds_material;
+/*
+ * Whether the segment between two points crosses no wall: no distance, angle or material is worked out, and the
+ * walk stops at the second point. Points outside the map can't see or be seen. While a chunked map is prefetching,
+ * a chunk that isn't resident blocks the line, as it would a ray.
+ *
+ * A line through a corner, or within rounding of one, is taken past one of the two cells beside it, and which one
+ * can depend on the direction of the walk. So the walk always starts from the point with the lesser x, then the
+ * lesser y: either point can see the other or neither can.
+ */
+bool re_has_line_of_sight(struct REMap *map, double from_x, double from_y, double to_x, double to_y,
+		int transparent_material)
+{
+	if (to_x < from_x || (to_x == from_x && to_y < from_y)) {
+		double swap_x = from_x, swap_y = from_y;
+		from_x = to_x;
+		from_y = to_y;
+		to_x = swap_x;
+		to_y = swap_y;
+	}
 
-			int material_close, material_far;
-			if (quadrant == 1 || quadrant == 2) {
-				material_close = bottom_cell_material;
-				material_far = top_cell_material;
-			} else {
-				material_close = top_cell_material;
-				material_far = bottom_cell_material;
-			}
+	struct SightWalk walk;
+	if (!init_sight_walk(map, from_x, from_y, to_x, to_y, &walk)) {
+		return false;
+	}
+	if (walk.rows_left == 0 && walk.columns_left == 0) {
+		return true;
+	}
 
-			if (material_close != transparent_material) {
-				*collided_material = material_close;
-				found_horiz_wall = true;
-			} else if (material_far != transparent_material) {
-				*collided_material = material_far;
-				found_horiz_wall = true;
-			}
+	if (map->cells != NULL) {
+		struct FlatReader reader = { map, map->cells, map->width };
+		return sight_flat(&reader, walk, transparent_material);
+	}
+	if (map->mask_source != NULL) {
+		struct MaskReader reader = { map, map->mask_source->masks, map->mask_source->row_stride,
+			map->mask_source->cell_table };
+		return sight_mask(&reader, walk, transparent_material);
+	}
 
-			if (found_horiz_wall) {
-				collision_coords[0] = fixed64_to_double(intercept_x);
-				collision_coords[1] = tile_y;
-			} else { // Step
-				tile_y += tile_step_y;
-				intercept_x = fixed64_add(intercept_x, step_x);
-			}
-		} else {
-			int32_t intercept_y_floor = intercept_y.as_int >> 32;
-			int right_cell_material = re_map_coords_in_bounds(map, tile_x, intercept_y_floor)
-				? re_map_get_cell(map, tile_x, intercept_y_floor).material_left
-				: out_of_bounds_material;
-			int left_cell_material  = re_map_coords_in_bounds(map, tile_x - 1, intercept_y_floor)
-				? re_map_get_cell(map, tile_x - 1, intercept_y_floor).material_right
-				: out_of_bounds_material;
-
-			int material_close, material_far;
-			if (quadrant == 1 || quadrant == 4) {
-				material_close = left_cell_material;
-				material_far = right_cell_material;
-			} else {
-				material_close = right_cell_material;
-				material_far = left_cell_material;
-			}
+	struct ChunkReader reader = { map, map->chunk_table, RE_CHUNK_TABLE_NONE, RE_CHUNK_TABLE_NONE, NULL, NULL, NULL };
+	bool visible = sight_chunk(&reader, walk, transparent_material);
+	finish_chunk_reader(&reader);
 
-			if (material_close != transparent_material) {
-				*collided_material = material_close;
-				found_vert_wall = true;
-			} else if (material_far != transparent_material) {
-				*collided_material = material_far;
-				found_vert_wall = true;
-			}
+	return visible;
+}
 
-			if (found_vert_wall) {
-				collision_coords[0] = tile_x;
-				collision_coords[1] = fixed64_to_double(intercept_y);
-			} else { // Step
-				tile_x += tile_step_x;
-				intercept_y = fixed64_add(intercept_y, step_y);
-			}
-		}
+/*
+ * re_has_line_of_sight for each query, into results. Threads take SIGHT_BATCH_SIZE queries at a time, the calling
+ * thread among them; a thread_count of 0 uses every online core. The threads are started and joined on every call,
+ * which costs tens of microseconds, so a batch of a few thousand queries or fewer is better done on one thread, which
+ * runs inline. Threads that can't be started leave their share to the rest.
+ */
+void re_has_lines_of_sight(struct REMap *map, const struct RESightQuery *queries, bool *results, size_t count,
+		int transparent_material, uint32_t thread_count)
+{
+	struct SightJob job = {
+		.map = map,
+		.queries = queries,
+		.results = results,
+		.count = count,
+		.transparent_material = transparent_material
+	};
+	atomic_init(&job.next_query, 0);
+
+	if (thread_count == 0) {
+		long core_count = sysconf(_SC_NPROCESSORS_ONLN);
+		thread_count = (core_count > 0) ? (uint32_t) core_count : 1;
+	}
+	size_t batch_count = (count + SIGHT_BATCH_SIZE - 1) / SIGHT_BATCH_SIZE;
+	if (thread_count > batch_count) {
+		thread_count = (batch_count > 0) ? (uint32_t) batch_count : 1;
 	}
 
-	double travel_distance = distance_of_points(origin_x, origin_y, collision_coords[0], collision_coords[1]);
-	double forward_distance = travel_distance * cos(rel_angle);
+	if (thread_count == 1) {
+		sight_worker_func(&job);
+		return;
+	}
 
-	return forward_distance;
+	pthread_t *threads = ALLOC_ARR(threads, thread_count);
+	uint32_t started_count = 1;
+	while (started_count < thread_count
+			&& pthread_create(&threads[started_count], NULL, sight_worker_func, &job) == 0) {
+		started_count++;
+	}
+	sight_worker_func(&job);
+	for (uint32_t thread = 1; thread < started_count; thread++) {
+		pthread_join(threads[thread], NULL);
+	}
+	free(threads);
 }
 
 bool re_map_coords_in_bounds(struct REMap *map, int64_t x, int64_t y)
@@ -181,29 +482,432 @@ bool re_map_coords_in_bounds(struct REMap *map, int64_t x, int64_t y)
 	return (x >= 0 && y >= 0 && x < map->width && y < map->height);
 }
 
-/* NOTE: only works for angles >=  0 and < 2PI */
-uint8_t get_angle_quadrant(double reduced_angle)
+/* Returns false outside the map */
+static inline bool flat_reader_get_cell(struct FlatReader *reader, int64_t x, int64_t y, struct REMapCell *p_cell)
 {
-	return (uint8_t) (reduced_angle / (PI / 2) + 1);
+	if (!re_map_coords_in_bounds(reader->map, x, y)) {
+		return false;
+	}
+
+	*p_cell = reader->cells[y * reader->width + x];
+	return true;
 }
 
-double reduce_angle(double angle)
+/* Returns false outside the map */
+static inline bool mask_reader_get_cell(struct MaskReader *reader, int64_t x, int64_t y, struct REMapCell *p_cell)
 {
-	if (angle < 0)
-	{
-		int wraps = (int) (angle / (2 * PI));
-		
-		angle -= (wraps - 1) * (2 * PI);
+	if (!re_map_coords_in_bounds(reader->map, x, y)) {
+		return false;
 	}
-	
-	if (angle >= (2 * PI))
-	{
-		int wraps = (int) (angle / (2 * PI));
-		
-		angle -= wraps * (2 * PI);
+
+	*p_cell = reader->cell_table[reader->masks[y * reader->row_stride + x]];
+	return true;
+}
+
+/*
+ * Returns false outside the map, and in chunks the loaders haven't brought in yet. Chunk coordinates never reach
+ * RE_CHUNK_TABLE_NONE, so a new reader always misses.
+ */
+static inline bool chunk_reader_get_cell(struct ChunkReader *reader, int64_t x, int64_t y, struct REMapCell *p_cell)
+{
+	if (!re_map_coords_in_bounds(reader->map, x, y)) {
+		return false;
+	}
+
+	uint32_t chunk_x = (uint32_t) x >> RE_CHUNK_SHIFT;
+	uint32_t chunk_y = (uint32_t) y >> RE_CHUNK_SHIFT;
+	if (chunk_x != reader->chunk_x || chunk_y != reader->chunk_y) {
+		move_chunk_reader(reader, chunk_x, chunk_y);
 	}
-	
-	return angle;
+	if (reader->cells == NULL) {
+		return false;
+	}
+
+	*p_cell = reader->cells[re_chunk_cell_index(x, y)];
+	return true;
+}
+
+/*
+ * Traversal kernels. Each direction gets its own copy of the walk with the tile steps as constants, so the
+ * comparisons and the choice of near and far cell fold away and only the hit test branches on the map. The whole
+ * set is stamped out once per kind of map, each reading cells through its own reader.
+ */
+
+/* Row line y between cells (x, y - 1) and (x, y), entered from below when step_y > 0 */
+#define DEFINE_HIT_ROW(READER, READER_TYPE) \
+static inline bool hit_row_##READER(READER_TYPE *reader, int32_t x, int32_t y, int32_t step_y, \
+		int transparent_material, int out_of_bounds_material, int *p_material) \
+{ \
+	RAY_STATS_CELL(reader->map, x, y); \
+	RAY_STATS_CELL(reader->map, x, y - 1); \
+\
+	struct REMapCell cell; \
+	int top_cell_material = READER##_reader_get_cell(reader, x, y, &cell) \
+		? cell.material_bottom \
+		: out_of_bounds_material; \
+	int bottom_cell_material = READER##_reader_get_cell(reader, x, y - 1, &cell) \
+		? cell.material_top \
+		: out_of_bounds_material; \
+\
+	int material_close = (step_y > 0) ? bottom_cell_material : top_cell_material; \
+	int material_far = (step_y > 0) ? top_cell_material : bottom_cell_material; \
+\
+	if (material_close != transparent_material) { \
+		*p_material = material_close; \
+		return true; \
+	} \
+	if (material_far != transparent_material) { \
+		*p_material = material_far; \
+		return true; \
+	} \
+	return false; \
+}
+
+/* Column line x between cells (x - 1, y) and (x, y), entered from the left when step_x > 0 */
+#define DEFINE_HIT_COLUMN(READER, READER_TYPE) \
+static inline bool hit_column_##READER(READER_TYPE *reader, int32_t x, int32_t y, int32_t step_x, \
+		int transparent_material, int out_of_bounds_material, int *p_material) \
+{ \
+	RAY_STATS_CELL(reader->map, x, y); \
+	RAY_STATS_CELL(reader->map, x - 1, y); \
+\
+	struct REMapCell cell; \
+	int right_cell_material = READER##_reader_get_cell(reader, x, y, &cell) \
+		? cell.material_left \
+		: out_of_bounds_material; \
+	int left_cell_material = READER##_reader_get_cell(reader, x - 1, y, &cell) \
+		? cell.material_right \
+		: out_of_bounds_material; \
+\
+	int material_close = (step_x > 0) ? left_cell_material : right_cell_material; \
+	int material_far = (step_x > 0) ? right_cell_material : left_cell_material; \
+\
+	if (material_close != transparent_material) { \
+		*p_material = material_close; \
+		return true; \
+	} \
+	if (material_far != transparent_material) { \
+		*p_material = material_far; \
+		return true; \
+	} \
+	return false; \
+}
+
+/* Takes whichever line comes first along the ray; on a tie, the row */
+#define DEFINE_QUADRANT_WALK(READER, READER_TYPE, name, STEP_X, STEP_Y) \
+static void name(READER_TYPE *reader, struct RayWalk walk, int transparent_material, int out_of_bounds_material, \
+		struct RayHit *p_hit) \
+{ \
+	RAY_STATS_RAY_BEGIN(); \
+	while (true) { \
+		RAY_STATS_STEP(); \
+\
+		if ((STEP_X) * walk.intercept_x.as_int <= (STEP_X) * ((int64_t) walk.tile_x << 32)) { \
+			if (hit_row_##READER(reader, walk.intercept_x.as_int >> 32, walk.tile_y, (STEP_Y), \
+					transparent_material, out_of_bounds_material, &p_hit->material)) { \
+				p_hit->x = fixed64_to_double(walk.intercept_x); \
+				p_hit->y = walk.tile_y; \
+				break; \
+			} \
+			walk.tile_y += (STEP_Y); \
+			walk.intercept_x = fixed64_add(walk.intercept_x, walk.step_x); \
+		} else { \
+			if (hit_column_##READER(reader, walk.tile_x, walk.intercept_y.as_int >> 32, (STEP_X), \
+					transparent_material, out_of_bounds_material, &p_hit->material)) { \
+				p_hit->x = walk.tile_x; \
+				p_hit->y = fixed64_to_double(walk.intercept_y); \
+				break; \
+			} \
+			walk.tile_x += (STEP_X); \
+			walk.intercept_y = fixed64_add(walk.intercept_y, walk.step_y); \
+		} \
+	} \
+	RAY_STATS_RAY_END(p_hit->material == out_of_bounds_material); \
+}
+
+/* Straight up or down: x never changes, so only row lines are crossed */
+#define DEFINE_ROW_WALK(READER, READER_TYPE, name, STEP_Y) \
+static void name(READER_TYPE *reader, struct RayWalk walk, int transparent_material, int out_of_bounds_material, \
+		struct RayHit *p_hit) \
+{ \
+	int32_t x = walk.intercept_x.as_int >> 32; \
+\
+	RAY_STATS_RAY_BEGIN(); \
+	while (true) { \
+		RAY_STATS_STEP(); \
+\
+		if (hit_row_##READER(reader, x, walk.tile_y, (STEP_Y), transparent_material, out_of_bounds_material, \
+				&p_hit->material)) { \
+			p_hit->x = fixed64_to_double(walk.intercept_x); \
+			p_hit->y = walk.tile_y; \
+			break; \
+		} \
+		walk.tile_y += (STEP_Y); \
+	} \
+	RAY_STATS_RAY_END(p_hit->material == out_of_bounds_material); \
+}
+
+/* Straight left or right: y never changes, so only column lines are crossed */
+#define DEFINE_COLUMN_WALK(READER, READER_TYPE, name, STEP_X) \
+static void name(READER_TYPE *reader, struct RayWalk walk, int transparent_material, int out_of_bounds_material, \
+		struct RayHit *p_hit) \
+{ \
+	int32_t y = walk.intercept_y.as_int >> 32; \
+\
+	RAY_STATS_RAY_BEGIN(); \
+	while (true) { \
+		RAY_STATS_STEP(); \
+\
+		if (hit_column_##READER(reader, walk.tile_x, y, (STEP_X), transparent_material, out_of_bounds_material, \
+				&p_hit->material)) { \
+			p_hit->x = walk.tile_x; \
+			p_hit->y = fixed64_to_double(walk.intercept_y); \
+			break; \
+		} \
+		walk.tile_x += (STEP_X); \
+	} \
+	RAY_STATS_RAY_END(p_hit->material == out_of_bounds_material); \
+}
+
+/* All eight kernels for one reader, and walk_<reader> to pick between them */
+#define DEFINE_WALKS(READER, READER_TYPE) \
+DEFINE_HIT_ROW(READER, READER_TYPE) \
+DEFINE_HIT_COLUMN(READER, READER_TYPE) \
+DEFINE_QUADRANT_WALK(READER, READER_TYPE, walk_quadrant_1_##READER, 1, 1) \
+DEFINE_QUADRANT_WALK(READER, READER_TYPE, walk_quadrant_2_##READER, -1, 1) \
+DEFINE_QUADRANT_WALK(READER, READER_TYPE, walk_quadrant_3_##READER, -1, -1) \
+DEFINE_QUADRANT_WALK(READER, READER_TYPE, walk_quadrant_4_##READER, 1, -1) \
+DEFINE_ROW_WALK(READER, READER_TYPE, walk_rows_north_##READER, 1) \
+DEFINE_ROW_WALK(READER, READER_TYPE, walk_rows_south_##READER, -1) \
+DEFINE_COLUMN_WALK(READER, READER_TYPE, walk_columns_east_##READER, 1) \
+DEFINE_COLUMN_WALK(READER, READER_TYPE, walk_columns_west_##READER, -1) \
+\
+void walk_##READER(READER_TYPE *reader, struct RayWalk walk, int transparent_material, int out_of_bounds_material, \
+		struct RayHit *p_hit) \
+{ \
+	if (!walk.crosses_rows) { \
+		if (walk.quadrant == 1) { \
+			walk_columns_east_##READER(reader, walk, transparent_material, out_of_bounds_material, p_hit); \
+		} else { \
+			walk_columns_west_##READER(reader, walk, transparent_material, out_of_bounds_material, p_hit); \
+		} \
+	} else if (!walk.crosses_columns) { \
+		if (walk.quadrant == 2) { \
+			walk_rows_north_##READER(reader, walk, transparent_material, out_of_bounds_material, p_hit); \
+		} else { \
+			walk_rows_south_##READER(reader, walk, transparent_material, out_of_bounds_material, p_hit); \
+		} \
+	} else { \
+		switch (walk.quadrant) { \
+		case 1: \
+			walk_quadrant_1_##READER(reader, walk, transparent_material, out_of_bounds_material, p_hit); \
+			break; \
+		case 2: \
+			walk_quadrant_2_##READER(reader, walk, transparent_material, out_of_bounds_material, p_hit); \
+			break; \
+		case 3: \
+			walk_quadrant_3_##READER(reader, walk, transparent_material, out_of_bounds_material, p_hit); \
+			break; \
+		default: \
+			walk_quadrant_4_##READER(reader, walk, transparent_material, out_of_bounds_material, p_hit); \
+			break; \
+		} \
+	} \
+}
+
+DEFINE_WALKS(flat, struct FlatReader)
+DEFINE_WALKS(mask, struct MaskReader)
+DEFINE_WALKS(chunk, struct ChunkReader)
+
+/*
+ * Sight kernels. A side blocks sight if either cell shows anything but transparent_material there, with no need to
+ * tell which. The counts, not the intercepts, decide when the walk is done, so it ends in the target's cell however
+ * the fixed-point steps round.
+ */
+
+/* Row line y between cells (x, y - 1) and (x, y) */
+#define DEFINE_ROW_OPEN(READER, READER_TYPE) \
+static inline bool is_row_open_##READER(READER_TYPE *reader, int32_t x, int32_t y, int transparent_material) \
+{ \
+	struct REMapCell cell; \
+	return READER##_reader_get_cell(reader, x, y, &cell) && cell.material_bottom == transparent_material \
+		&& READER##_reader_get_cell(reader, x, y - 1, &cell) && cell.material_top == transparent_material; \
+}
+
+/* Column line x between cells (x - 1, y) and (x, y) */
+#define DEFINE_COLUMN_OPEN(READER, READER_TYPE) \
+static inline bool is_column_open_##READER(READER_TYPE *reader, int32_t x, int32_t y, int transparent_material) \
+{ \
+	struct REMapCell cell; \
+	return READER##_reader_get_cell(reader, x, y, &cell) && cell.material_left == transparent_material \
+		&& READER##_reader_get_cell(reader, x - 1, y, &cell) && cell.material_right == transparent_material; \
+}
+
+/* As DEFINE_QUADRANT_WALK, taking the row on a tie, until both counts run out */
+#define DEFINE_QUADRANT_SIGHT(READER, READER_TYPE, name, STEP_X, STEP_Y) \
+static bool name(READER_TYPE *reader, struct SightWalk walk, int transparent_material) \
+{ \
+	while (walk.rows_left > 0 || walk.columns_left > 0) { \
+		if (walk.columns_left == 0 || (walk.rows_left > 0 \
+				&& (STEP_X) * walk.intercept_x.as_int <= (STEP_X) * ((int64_t) walk.tile_x << 32))) { \
+			if (!is_row_open_##READER(reader, walk.intercept_x.as_int >> 32, walk.tile_y, transparent_material)) { \
+				return false; \
+			} \
+			walk.tile_y += (STEP_Y); \
+			walk.intercept_x = fixed64_add(walk.intercept_x, walk.step_x); \
+			walk.rows_left--; \
+		} else { \
+			if (!is_column_open_##READER(reader, walk.tile_x, walk.intercept_y.as_int >> 32, \
+					transparent_material)) { \
+				return false; \
+			} \
+			walk.tile_x += (STEP_X); \
+			walk.intercept_y = fixed64_add(walk.intercept_y, walk.step_y); \
+			walk.columns_left--; \
+		} \
+	} \
+	return true; \
+}
+
+/* The four sight kernels for one reader, and sight_<reader> to pick between them */
+#define DEFINE_SIGHTS(READER, READER_TYPE) \
+DEFINE_ROW_OPEN(READER, READER_TYPE) \
+DEFINE_COLUMN_OPEN(READER, READER_TYPE) \
+DEFINE_QUADRANT_SIGHT(READER, READER_TYPE, sight_quadrant_1_##READER, 1, 1) \
+DEFINE_QUADRANT_SIGHT(READER, READER_TYPE, sight_quadrant_2_##READER, -1, 1) \
+DEFINE_QUADRANT_SIGHT(READER, READER_TYPE, sight_quadrant_3_##READER, -1, -1) \
+DEFINE_QUADRANT_SIGHT(READER, READER_TYPE, sight_quadrant_4_##READER, 1, -1) \
+\
+bool sight_##READER(READER_TYPE *reader, struct SightWalk walk, int transparent_material) \
+{ \
+	switch (walk.quadrant) { \
+	case 1: \
+		return sight_quadrant_1_##READER(reader, walk, transparent_material); \
+	case 2: \
+		return sight_quadrant_2_##READER(reader, walk, transparent_material); \
+	case 3: \
+		return sight_quadrant_3_##READER(reader, walk, transparent_material); \
+	default: \
+		return sight_quadrant_4_##READER(reader, walk, transparent_material); \
+	} \
+}
+
+DEFINE_SIGHTS(flat, struct FlatReader)
+DEFINE_SIGHTS(mask, struct MaskReader)
+DEFINE_SIGHTS(chunk, struct ChunkReader)
+
+/*
+ * Unpins the chunk the reader was in and pins the new one. The loaders are looked up each time, since they can be
+ * stopped between moves. Without them a missing chunk is generated with the table unlocked, as
+ * re_chunk_table_lock_and_get does, so other rays and lookups carry on meanwhile.
+ */
+void move_chunk_reader(struct ChunkReader *reader, uint32_t chunk_x, uint32_t chunk_y)
+{
+	struct REChunkTable *table = reader->table;
+
+	if (reader->pin_count != NULL) {
+		re_chunk_table_unpin(reader->pin_count);
+		reader->pin_count = NULL;
+	}
+
+	pthread_mutex_lock(&table->lock);
+	if (table->loader != NULL) {
+		reader->cells = re_chunk_loader_pin(table->loader, chunk_x, chunk_y, &reader->pin_count);
+	} else {
+		reader->cells = re_chunk_table_pin(table, chunk_x, chunk_y, &reader->pin_count);
+		if (reader->cells == NULL) {
+			pthread_mutex_unlock(&table->lock);
+			if (reader->generated_cells == NULL) {
+				reader->generated_cells = ALLOC_ARR(reader->generated_cells, RE_CHUNK_AREA);
+			}
+			table->source.generate(table->source.context, table->source.seed, chunk_x, chunk_y,
+					reader->generated_cells);
+			pthread_mutex_lock(&table->lock);
+
+			re_chunk_table_install(table, chunk_x, chunk_y, &reader->generated_cells); // false if beaten to it
+			reader->cells = re_chunk_table_pin(table, chunk_x, chunk_y, &reader->pin_count);
+		}
+	}
+	pthread_mutex_unlock(&table->lock);
+
+	reader->chunk_x = chunk_x;
+	reader->chunk_y = chunk_y;
+}
+
+void finish_chunk_reader(struct ChunkReader *reader)
+{
+	if (reader->pin_count != NULL) {
+		re_chunk_table_unpin(reader->pin_count);
+	}
+
+	free(reader->generated_cells);
+}
+
+/*
+ * False if either point is outside the map. Intercepts are worked out in double from the first point, so each
+ * stays between the two points however steep the segment; a step is only used where at least two lines of its kind
+ * are crossed, which keeps it no bigger than the map.
+ */
+bool init_sight_walk(struct REMap *map, double from_x, double from_y, double to_x, double to_y,
+		struct SightWalk *p_walk)
+{
+	double from_cell_x = floor(from_x), from_cell_y = floor(from_y);
+	double to_cell_x = floor(to_x), to_cell_y = floor(to_y);
+	if (!(from_cell_x >= 0 && from_cell_y >= 0 && from_cell_x < map->width && from_cell_y < map->height)
+			|| !(to_cell_x >= 0 && to_cell_y >= 0 && to_cell_x < map->width && to_cell_y < map->height)) {
+		return false;
+	}
+
+	double delta_x = to_x - from_x;
+	double delta_y = to_y - from_y;
+	bool forward_x = (delta_x >= 0);
+	bool forward_y = (delta_y >= 0);
+
+	p_walk->columns_left = (uint32_t) fabs(to_cell_x - from_cell_x);
+	p_walk->rows_left = (uint32_t) fabs(to_cell_y - from_cell_y);
+	p_walk->tile_x = (int32_t) from_cell_x + forward_x;
+	p_walk->tile_y = (int32_t) from_cell_y + forward_y;
+	p_walk->quadrant = forward_x ? (forward_y ? 1 : 4) : (forward_y ? 2 : 3);
+
+	// x at each row line crossed, y at each column line
+	double row_distance = forward_y ? p_walk->tile_y - from_y : from_y - p_walk->tile_y;
+	double column_distance = forward_x ? p_walk->tile_x - from_x : from_x - p_walk->tile_x;
+	double x_per_row = (p_walk->rows_left > 0) ? delta_x / fabs(delta_y) : 0;
+	double y_per_column = (p_walk->columns_left > 0) ? delta_y / fabs(delta_x) : 0;
+
+	p_walk->intercept_x = fixed64_from_double(from_x + x_per_row * row_distance);
+	p_walk->intercept_y = fixed64_from_double(from_y + y_per_column * column_distance);
+	p_walk->step_x = fixed64_from_double((p_walk->rows_left > 1) ? x_per_row : 0);
+	p_walk->step_y = fixed64_from_double((p_walk->columns_left > 1) ? y_per_column : 0);
+
+	return true;
+}
+
+void *sight_worker_func(void *data)
+{
+	struct SightJob *job = (struct SightJob *) data;
+
+	while (true) {
+		size_t start = atomic_fetch_add(&job->next_query, SIGHT_BATCH_SIZE);
+		if (start >= job->count) {
+			break;
+		}
+		size_t end = (start + SIGHT_BATCH_SIZE < job->count) ? start + SIGHT_BATCH_SIZE : job->count;
+
+		for (size_t index = start; index < end; index++) {
+			const struct RESightQuery *query = &job->queries[index];
+			job->results[index] = re_has_line_of_sight(job->map, query->from_x, query->from_y, query->to_x,
+					query->to_y, job->transparent_material);
+		}
+	}
+
+	return NULL;
+}
+
+/* 1 to 4, counter-clockwise from +x */
+uint8_t get_angle_quadrant(struct BinaryAngle angle)
+{
+	return (uint8_t) ((angle.as_uint >> 30) + 1);
 }
 
 double distance_of_points(double x1, double y1, double x2, double y2)
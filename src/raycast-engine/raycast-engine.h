@@ -3,30 +3,127 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "../fixed/fixed.h"
 
 #define RE_MAP_CELL_SOLID(material) (struct REMapCell) { material, material, material, material }
 
+#define RE_CHUNK_SHIFT 5
+#define RE_CHUNK_SIZE (1u << RE_CHUNK_SHIFT) // cells along each side of a chunk
+#define RE_CHUNK_AREA (RE_CHUNK_SIZE * RE_CHUNK_SIZE)
+
+#define RE_MASK_TABLE_SIZE 256
+
+/*
+ * A map is flat, with every cell in cells row by row; masked, with a byte per cell read through a mask source; or
+ * chunked, with cells paged in RE_CHUNK_SIZE squares from a chunk source on first use, up to a memory budget. Only
+ * a flat map has cells. They are either its own or mapped from a map file.
+ */
 struct REMap {
 	uint32_t width;
 	uint32_t height;
+	struct REChunkTable *chunk_table; // NULL unless chunked
+	struct REMaskSource *mask_source; // NULL unless masked
+
+	void *mapping; // the whole map file, if cells point into one
+	size_t mapping_size;
 
 	struct REMapCell {
 		int material_top;
 		int material_right;
 		int material_bottom;
 		int material_left;
-	} cells[];
+	} *cells;
+};
+
+/*
+ * Fills one chunk's cells, RE_CHUNK_SIZE rows of RE_CHUNK_SIZE starting from the chunk's lowest x and y. Must give
+ * the same cells every time it is called with the same seed and chunk, since evicted chunks are generated again.
+ */
+struct REChunkSource {
+	void (*generate)(void *context, uint64_t seed, uint32_t chunk_x, uint32_t chunk_y, struct REMapCell *cells);
+	void *context;
+	uint64_t seed;
+};
+
+/*
+ * A byte per cell in memory the caller owns, such as a generated maze's wall masks, expanded through a table as it
+ * is read. Row y of the map starts at masks + y * row_stride, so a negative stride reads rows stored top down.
+ */
+struct REMaskSource {
+	const uint8_t *masks;
+	ptrdiff_t row_stride;
+	struct REMapCell cell_table[RE_MASK_TABLE_SIZE]; // what each mask byte reads as
+	void (*release)(void *context); // called by re_map_destroy for the memory behind masks; may be NULL
+	void *context;
+};
+
+struct REChunkStats {
+	uint64_t lookups; // chunk table lookups; cells in the chunk a ray is already in skip the table
+	uint64_t generated;
+	uint64_t prefetched; // of those generated, by the background loaders
+	uint64_t evicted;
+	uint64_t fallbacks; // lookups by rays that found the chunk missing while loaders were running
+	uint32_t resident;
+	uint32_t capacity;
+};
+
+/*
+ * Where the camera is and how it is moving, from which the prefetch loaders predict the chunks the next
+ * lookahead_frames frames will look at
+ */
+struct REViewHint {
+	double x;
+	double y;
+	double velocity_x; // cells per second
+	double velocity_y;
+	struct BinaryAngle forward_angle;
+	double angular_velocity; // radians per second, counter-clockwise
+	double half_fov; // radians; the widest rel_angle a frame casts either side of forward
+	double view_distance; // cells; how far rays are expected to reach
+	double frame_seconds;
+	uint32_t lookahead_frames;
+};
+
+/* A pair of points for re_has_lines_of_sight */
+struct RESightQuery {
+	double from_x;
+	double from_y;
+	double to_x;
+	double to_y;
 };
 
 struct REMap *re_map_create(uint32_t width, uint32_t height);
+struct REMap *re_map_create_chunked(uint32_t width, uint32_t height, struct REChunkSource source,
+		size_t memory_budget);
+struct REMap *re_map_create_masked(uint32_t width, uint32_t height, const struct REMaskSource *source);
 void re_map_destroy(struct REMap *map);
 
+bool re_map_save(struct REMap *map, const char *path);
+struct REMap *re_map_load(const char *path);
+
+struct REMapWriter *re_map_writer_open(const char *path, uint32_t width, uint32_t height);
+bool re_map_writer_write_row(struct REMapWriter *writer, const struct REMapCell *cells);
+bool re_map_writer_close(struct REMapWriter *writer);
+
+struct REChunkStats re_map_get_chunk_stats(struct REMap *map);
+
+void re_map_start_prefetch(struct REMap *map, uint32_t thread_count);
+void re_map_stop_prefetch(struct REMap *map);
+void re_map_hint_view(struct REMap *map, struct REViewHint hint);
+
 struct REMapCell re_map_get_cell(struct REMap *map, uint32_t x, uint32_t y);
 void re_map_set_cell(struct REMap *map, uint32_t x, uint32_t y, struct REMapCell cell);
 void re_map_fill(struct REMap *map, struct REMapCell cell);
 
-double re_cast_ray(struct REMap *map, double origin_x, double origin_y, double forward_angle, double rel_angle,
-		int transparent_material, int out_of_bounds_material, int *collided_material);
+double re_cast_ray(struct REMap *map, double origin_x, double origin_y, struct BinaryAngle forward_angle,
+		struct BinaryAngle rel_angle, int transparent_material, int out_of_bounds_material, int *collided_material);
+
+bool re_has_line_of_sight(struct REMap *map, double from_x, double from_y, double to_x, double to_y,
+		int transparent_material);
+void re_has_lines_of_sight(struct REMap *map, const struct RESightQuery *queries, bool *results, size_t count,
+		int transparent_material, uint32_t thread_count);
 
 bool re_map_coords_in_bounds(struct REMap *map, int64_t x, int64_t y);
 
@@ -0,0 +1,272 @@
+#include <stdlib.h>
+
+#include "../fixed/fixed.h"
+#include "../mem-utils/mem-macros.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif // MEM_DEBUG
+
+#include "re-chunk-loader.h"
+
+#define PLAN_SEEN_SLOTS 1024 // open addressing over at most RE_CHUNK_LOADER_MAX_PLAN keys
+#define PLAN_SEEN_EMPTY UINT64_MAX
+#define PLAN_SAMPLE_SPACING (RE_CHUNK_SIZE / 2.0)
+
+static void *loader_worker_func(void *vp_worker);
+static bool take_job(struct REChunkLoader *loader, struct REChunkRequest *p_job);
+static bool is_job_wanted(struct REChunkLoader *loader, struct REChunkRequest job);
+static uint32_t plan_chunks(struct REChunkLoader *loader, struct REViewHint hint, struct REChunkRequest *plan);
+static void add_to_plan(struct REChunkLoader *loader, uint64_t *seen, struct REChunkRequest *plan, uint32_t *p_count,
+		double x, double y);
+
+struct REChunkLoader *re_chunk_loader_start(struct REChunkTable *table, uint32_t chunk_columns, uint32_t chunk_rows,
+		uint32_t thread_count)
+{
+	struct REChunkLoader *loader = malloc(sizeof *loader);
+
+	loader->table = table;
+	loader->chunk_columns = chunk_columns;
+	loader->chunk_rows = chunk_rows;
+	loader->plan_capacity = table->slot_count / 2;
+	if (loader->plan_capacity > RE_CHUNK_LOADER_MAX_PLAN) {
+		loader->plan_capacity = RE_CHUNK_LOADER_MAX_PLAN;
+	}
+
+	pthread_cond_init(&loader->work_ready, NULL);
+	loader->stopping = false;
+
+	loader->hint_version = 0;
+	loader->plan_version = 0;
+	loader->planning = false;
+	loader->plan_count = 0;
+	loader->plan_next = 0;
+	loader->plan = ALLOC_ARR(loader->plan, RE_CHUNK_LOADER_MAX_PLAN);
+
+	loader->worker_count = (thread_count < RE_CHUNK_LOADER_MAX_THREADS) ? thread_count : RE_CHUNK_LOADER_MAX_THREADS;
+	for (uint32_t index = 0; index < loader->worker_count; index++) {
+		struct REChunkLoaderWorker *worker = &loader->workers[index];
+
+		worker->loader = loader;
+		worker->busy = false;
+		worker->plan_scratch = ALLOC_ARR(worker->plan_scratch, RE_CHUNK_LOADER_MAX_PLAN);
+	}
+
+	// Workers read each other's jobs, so all are set up before any starts
+	for (uint32_t index = 0; index < loader->worker_count; index++) {
+		pthread_create(&loader->workers[index].thread, NULL, loader_worker_func, &loader->workers[index]);
+	}
+
+	return loader;
+}
+
+/* Waits for any chunk being generated to be installed */
+void re_chunk_loader_stop(struct REChunkLoader *loader)
+{
+	struct REChunkTable *table = loader->table;
+
+	pthread_mutex_lock(&table->lock);
+	loader->stopping = true;
+	pthread_cond_broadcast(&loader->work_ready);
+	pthread_mutex_unlock(&table->lock);
+
+	for (uint32_t index = 0; index < loader->worker_count; index++) {
+		pthread_join(loader->workers[index].thread, NULL);
+		free(loader->workers[index].plan_scratch);
+	}
+
+	pthread_cond_destroy(&loader->work_ready);
+	free(loader->plan);
+	free(loader);
+}
+
+/* Table locked. Replaces any earlier hint; a plan made from an older one is dropped once a worker replans */
+void re_chunk_loader_post_hint(struct REChunkLoader *loader, struct REViewHint hint)
+{
+	loader->hint = hint;
+	loader->hint_version++;
+	pthread_cond_signal(&loader->work_ready);
+}
+
+/*
+ * Table locked. Pins the chunk as re_chunk_table_pin does, but never generates: a missing chunk is requested and
+ * NULL returned for the caller to fall back on
+ */
+struct REMapCell *re_chunk_loader_pin(struct REChunkLoader *loader, uint32_t chunk_x, uint32_t chunk_y,
+		atomic_uint **p_pin_count)
+{
+	struct REChunkTable *table = loader->table;
+
+	struct REMapCell *cells = re_chunk_table_pin(table, chunk_x, chunk_y, p_pin_count);
+	if (cells == NULL) {
+		table->stats.fallbacks++;
+		re_chunk_table_request(table, chunk_x, chunk_y);
+		pthread_cond_signal(&loader->work_ready);
+	}
+
+	return cells;
+}
+
+void *loader_worker_func(void *vp_worker)
+{
+	struct REChunkLoaderWorker *worker = (struct REChunkLoaderWorker *) vp_worker;
+	struct REChunkLoader *loader = worker->loader;
+	struct REChunkTable *table = loader->table;
+	struct REChunkSource source = table->source;
+
+	struct REMapCell *cells = ALLOC_ARR(cells, RE_CHUNK_AREA);
+
+	pthread_mutex_lock(&table->lock);
+	while (!loader->stopping) {
+		// Plans are made with the table unlocked; only one worker makes each
+		if (loader->plan_version != loader->hint_version && !loader->planning) {
+			struct REViewHint hint = loader->hint;
+			uint64_t hint_version = loader->hint_version;
+			loader->planning = true;
+
+			pthread_mutex_unlock(&table->lock);
+			uint32_t plan_count = plan_chunks(loader, hint, worker->plan_scratch);
+			pthread_mutex_lock(&table->lock);
+
+			struct REChunkRequest *old_plan = loader->plan;
+			loader->plan = worker->plan_scratch;
+			worker->plan_scratch = old_plan;
+			loader->plan_count = plan_count;
+			loader->plan_next = 0;
+			loader->plan_version = hint_version;
+			loader->planning = false;
+			continue;
+		}
+
+		struct REChunkRequest job;
+		if (!take_job(loader, &job)) {
+			pthread_cond_wait(&loader->work_ready, &table->lock);
+			continue;
+		}
+
+		worker->busy = true;
+		worker->job = job;
+		pthread_mutex_unlock(&table->lock);
+
+		source.generate(source.context, source.seed, job.chunk_x, job.chunk_y, cells);
+
+		pthread_mutex_lock(&table->lock);
+		worker->busy = false;
+		if (re_chunk_table_install(table, job.chunk_x, job.chunk_y, &cells)) {
+			table->stats.prefetched++;
+		}
+	}
+	pthread_mutex_unlock(&table->lock);
+
+	free(cells);
+
+	return NULL;
+}
+
+/* Chunks rays are missing right now come first, then the plan */
+bool take_job(struct REChunkLoader *loader, struct REChunkRequest *p_job)
+{
+	struct REChunkRequest job;
+	while (re_chunk_table_take_request(loader->table, &job.chunk_x, &job.chunk_y)) {
+		if (is_job_wanted(loader, job)) {
+			*p_job = job;
+			return true;
+		}
+	}
+
+	while (loader->plan_next < loader->plan_count) {
+		job = loader->plan[loader->plan_next++];
+		if (is_job_wanted(loader, job)) {
+			*p_job = job;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Resident chunks the plan passes over are marked used, so the plan's chunks are the last to be evicted */
+bool is_job_wanted(struct REChunkLoader *loader, struct REChunkRequest job)
+{
+	if (re_chunk_table_touch(loader->table, job.chunk_x, job.chunk_y)) {
+		return false;
+	}
+
+	for (uint32_t index = 0; index < loader->worker_count; index++) {
+		struct REChunkLoaderWorker *worker = &loader->workers[index];
+		if (worker->busy && worker->job.chunk_x == job.chunk_x && worker->job.chunk_y == job.chunk_y) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * For each frame of the lookahead in turn: the chunks around the predicted position, then a fan across the
+ * predicted view from near to far, sampled every half chunk along and across it.
+ */
+uint32_t plan_chunks(struct REChunkLoader *loader, struct REViewHint hint, struct REChunkRequest *plan)
+{
+	uint64_t seen[PLAN_SEEN_SLOTS];
+	for (uint32_t slot = 0; slot < PLAN_SEEN_SLOTS; slot++) {
+		seen[slot] = PLAN_SEEN_EMPTY;
+	}
+
+	uint32_t fan_rays = 2 + (uint32_t) (2 * hint.half_fov * hint.view_distance / PLAN_SAMPLE_SPACING);
+
+	uint32_t count = 0;
+	for (uint32_t frame = 0; frame <= hint.lookahead_frames && count < loader->plan_capacity; frame++) {
+		double seconds = frame * hint.frame_seconds;
+		double x = hint.x + hint.velocity_x * seconds;
+		double y = hint.y + hint.velocity_y * seconds;
+		struct BinaryAngle forward_angle = binary_angle_add(hint.forward_angle,
+				binary_angle_from_radians(hint.angular_velocity * seconds));
+
+		for (int32_t offset_y = -1; offset_y <= 1; offset_y++) {
+			for (int32_t offset_x = -1; offset_x <= 1; offset_x++) {
+				add_to_plan(loader, seen, plan, &count, x + offset_x * RE_CHUNK_SIZE, y + offset_y * RE_CHUNK_SIZE);
+			}
+		}
+
+		for (double distance = PLAN_SAMPLE_SPACING; distance < hint.view_distance + PLAN_SAMPLE_SPACING;
+				distance += PLAN_SAMPLE_SPACING) {
+			for (uint32_t ray = 0; ray < fan_rays; ray++) {
+				double rel_angle = hint.half_fov * (2.0 * ray / (fan_rays - 1) - 1);
+
+				struct Fixed64 sine, cosine;
+				binary_angle_sin_cos(binary_angle_add(forward_angle, binary_angle_from_radians(rel_angle)), &sine,
+						&cosine);
+				add_to_plan(loader, seen, plan, &count, x + fixed64_to_double(cosine) * distance,
+						y + fixed64_to_double(sine) * distance);
+			}
+		}
+	}
+
+	return count;
+}
+
+/* Skips points outside the map, chunks already planned and anything past the plan's capacity */
+void add_to_plan(struct REChunkLoader *loader, uint64_t *seen, struct REChunkRequest *plan, uint32_t *p_count,
+		double x, double y)
+{
+	if (*p_count >= loader->plan_capacity || x < 0 || y < 0 || x >= (double) loader->chunk_columns * RE_CHUNK_SIZE
+			|| y >= (double) loader->chunk_rows * RE_CHUNK_SIZE) {
+		return;
+	}
+
+	uint32_t chunk_x = (uint32_t) (x / RE_CHUNK_SIZE);
+	uint32_t chunk_y = (uint32_t) (y / RE_CHUNK_SIZE);
+
+	uint64_t key = ((uint64_t) chunk_y << 32) | chunk_x;
+	uint32_t slot = (uint32_t) ((key * 0x9E3779B97F4A7C15ull) >> 54) & (PLAN_SEEN_SLOTS - 1);
+	while (seen[slot] != PLAN_SEEN_EMPTY) {
+		if (seen[slot] == key) {
+			return;
+		}
+		slot = (slot + 1) & (PLAN_SEEN_SLOTS - 1);
+	}
+	seen[slot] = key;
+
+	plan[(*p_count)++] = (struct REChunkRequest) { chunk_x, chunk_y };
+}
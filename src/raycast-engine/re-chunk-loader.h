@@ -0,0 +1,57 @@
+#ifndef re_chunk_loader_h
+#define re_chunk_loader_h
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "raycast-engine.h"
+#include "re-chunk-table.h"
+
+#define RE_CHUNK_LOADER_MAX_THREADS 8
+#define RE_CHUNK_LOADER_MAX_PLAN 256
+
+/*
+ * Background threads that keep the chunks the camera is about to see resident. The render thread only posts view
+ * hints. A loader turns the newest hint into a plan, the chunks the coming frames will need in the order they will
+ * need them, and loaders work through it generating missing chunks with the table unlocked. Chunks that rays found
+ * missing are taken ahead of the plan. Everything here is guarded by the table's lock.
+ */
+struct REChunkLoader {
+	struct REChunkTable *table;
+	uint32_t chunk_columns; // of the map, so plans stay inside it
+	uint32_t chunk_rows;
+	uint32_t plan_capacity; // well under the table's slots, so a plan never evicts its own chunks
+
+	pthread_cond_t work_ready;
+	bool stopping;
+
+	uint32_t worker_count;
+	struct REChunkLoaderWorker {
+		struct REChunkLoader *loader;
+		pthread_t thread;
+		bool busy;
+		struct REChunkRequest job;
+		struct REChunkRequest *plan_scratch; // where this worker builds a plan before swapping it in
+	} workers[RE_CHUNK_LOADER_MAX_THREADS];
+
+	struct REViewHint hint;
+	uint64_t hint_version;
+	uint64_t plan_version; // of the hint the plan came from
+	bool planning;
+
+	uint32_t plan_count;
+	uint32_t plan_next;
+	struct REChunkRequest *plan;
+};
+
+struct REChunkLoader *re_chunk_loader_start(struct REChunkTable *table, uint32_t chunk_columns, uint32_t chunk_rows,
+		uint32_t thread_count);
+void re_chunk_loader_stop(struct REChunkLoader *loader);
+
+void re_chunk_loader_post_hint(struct REChunkLoader *loader, struct REViewHint hint);
+struct REMapCell *re_chunk_loader_pin(struct REChunkLoader *loader, uint32_t chunk_x, uint32_t chunk_y,
+		atomic_uint **p_pin_count);
+
+#endif // re_chunk_loader_h
@@ -0,0 +1,339 @@
+#include <stdlib.h>
+
+#include "../mem-utils/mem-macros.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif // MEM_DEBUG
+
+#include "re-chunk-table.h"
+
+static uint32_t find_slot(struct REChunkTable *table, uint32_t bucket, uint32_t chunk_x, uint32_t chunk_y);
+static uint32_t claim_oldest_slot(struct REChunkTable *table, uint32_t bucket, uint32_t chunk_x, uint32_t chunk_y);
+static uint32_t add_slot(struct REChunkTable *table);
+static void unlink_from_bucket(struct REChunkTable *table, uint32_t slot_index);
+static void touch_slot(struct REChunkTable *table, uint32_t slot_index);
+static void unlink_from_recency(struct REChunkTable *table, uint32_t slot_index);
+static void link_as_newest(struct REChunkTable *table, uint32_t slot_index);
+static uint32_t get_bucket(struct REChunkTable *table, uint32_t chunk_x, uint32_t chunk_y);
+
+struct REChunkTable *re_chunk_table_create(struct REChunkSource source, uint32_t slot_count)
+{
+	struct REChunkTable *table = malloc(sizeof *table);
+
+	pthread_mutex_init(&table->lock, NULL);
+	table->source = source;
+	table->slot_count = slot_count;
+	table->slots = ALLOC_ARR(table->slots, slot_count);
+
+	// At least twice as many buckets as slots keeps the chains short
+	uint32_t bucket_count = 1;
+	while (bucket_count < 2 * slot_count) {
+		bucket_count *= 2;
+	}
+	table->bucket_mask = bucket_count - 1;
+	table->buckets = ALLOC_ARR(table->buckets, bucket_count);
+	for (uint32_t bucket = 0; bucket < bucket_count; bucket++) {
+		table->buckets[bucket] = RE_CHUNK_TABLE_NONE;
+	}
+
+	for (uint32_t slot_index = 0; slot_index < slot_count; slot_index++) {
+		struct REChunkSlot *slot = &table->slots[slot_index];
+
+		*slot = (struct REChunkSlot) {
+			.resident = false,
+			.bucket_next = RE_CHUNK_TABLE_NONE,
+			.newer = (slot_index > 0) ? slot_index - 1 : RE_CHUNK_TABLE_NONE,
+			.older = (slot_index + 1 < slot_count) ? slot_index + 1 : RE_CHUNK_TABLE_NONE
+		};
+		slot->pin_count = malloc(sizeof *slot->pin_count);
+		atomic_init(slot->pin_count, 0);
+		slot->cells = ALLOC_ARR(slot->cells, RE_CHUNK_AREA);
+	}
+	table->newest = 0;
+	table->oldest = slot_count - 1;
+
+	table->request_count = 0;
+	table->request_start = 0;
+	table->loader = NULL;
+	table->stats = (struct REChunkStats) { .capacity = slot_count };
+
+	return table;
+}
+
+void re_chunk_table_destroy(struct REChunkTable *table)
+{
+	for (uint32_t slot_index = 0; slot_index < table->slot_count; slot_index++) {
+		free(table->slots[slot_index].pin_count);
+		free(table->slots[slot_index].cells);
+	}
+
+	pthread_mutex_destroy(&table->lock);
+	free(table->buckets);
+	free(table->slots);
+	free(table);
+}
+
+/* NULL if the chunk isn't resident. The cells stay valid until the table is unlocked */
+struct REMapCell *re_chunk_table_find(struct REChunkTable *table, uint32_t chunk_x, uint32_t chunk_y)
+{
+	table->stats.lookups++;
+
+	uint32_t slot_index = find_slot(table, get_bucket(table, chunk_x, chunk_y), chunk_x, chunk_y);
+	if (slot_index == RE_CHUNK_TABLE_NONE) {
+		return NULL;
+	}
+	touch_slot(table, slot_index);
+
+	return table->slots[slot_index].cells;
+}
+
+/*
+ * Locks the table and returns the chunk's cells, generating a missing chunk first. It is generated with the table
+ * unlocked so that rays and loaders carry on meanwhile.
+ */
+struct REMapCell *re_chunk_table_lock_and_get(struct REChunkTable *table, uint32_t chunk_x, uint32_t chunk_y)
+{
+	pthread_mutex_lock(&table->lock);
+
+	struct REMapCell *cells = re_chunk_table_find(table, chunk_x, chunk_y);
+	if (cells == NULL) {
+		pthread_mutex_unlock(&table->lock);
+		struct REMapCell *generated_cells = ALLOC_ARR(generated_cells, RE_CHUNK_AREA);
+		table->source.generate(table->source.context, table->source.seed, chunk_x, chunk_y, generated_cells);
+		pthread_mutex_lock(&table->lock);
+
+		re_chunk_table_install(table, chunk_x, chunk_y, &generated_cells);
+		free(generated_cells); // the evicted buffer, or ours if a loader got there first
+		cells = re_chunk_table_find(table, chunk_x, chunk_y);
+	}
+
+	return cells;
+}
+
+/*
+ * Like re_chunk_table_find, but the cells stay valid with the table unlocked, until re_chunk_table_unpin is given
+ * the pin count handed back
+ */
+struct REMapCell *re_chunk_table_pin(struct REChunkTable *table, uint32_t chunk_x, uint32_t chunk_y,
+		atomic_uint **p_pin_count)
+{
+	table->stats.lookups++;
+
+	uint32_t slot_index = find_slot(table, get_bucket(table, chunk_x, chunk_y), chunk_x, chunk_y);
+	if (slot_index == RE_CHUNK_TABLE_NONE) {
+		return NULL;
+	}
+	struct REChunkSlot *slot = &table->slots[slot_index];
+
+	atomic_fetch_add(slot->pin_count, 1);
+	touch_slot(table, slot_index);
+	*p_pin_count = slot->pin_count;
+
+	return slot->cells;
+}
+
+/* Needs no lock */
+void re_chunk_table_unpin(atomic_uint *pin_count)
+{
+	atomic_fetch_sub(pin_count, 1);
+}
+
+/* Marks a resident chunk as just used without counting a lookup; false if it isn't resident */
+bool re_chunk_table_touch(struct REChunkTable *table, uint32_t chunk_x, uint32_t chunk_y)
+{
+	uint32_t slot_index = find_slot(table, get_bucket(table, chunk_x, chunk_y), chunk_x, chunk_y);
+	if (slot_index == RE_CHUNK_TABLE_NONE) {
+		return false;
+	}
+	touch_slot(table, slot_index);
+
+	return true;
+}
+
+/*
+ * Makes *p_cells, generated without the lock, the chunk's cells, and hands back the evicted slot's buffer in its
+ * place. Returns false and leaves *p_cells alone if the chunk became resident in the meantime.
+ */
+bool re_chunk_table_install(struct REChunkTable *table, uint32_t chunk_x, uint32_t chunk_y,
+		struct REMapCell **p_cells)
+{
+	uint32_t bucket = get_bucket(table, chunk_x, chunk_y);
+	if (find_slot(table, bucket, chunk_x, chunk_y) != RE_CHUNK_TABLE_NONE) {
+		return false;
+	}
+
+	uint32_t slot_index = claim_oldest_slot(table, bucket, chunk_x, chunk_y);
+	struct REChunkSlot *slot = &table->slots[slot_index];
+
+	struct REMapCell *evicted_cells = slot->cells;
+	slot->cells = *p_cells;
+	*p_cells = evicted_cells;
+
+	table->stats.generated++;
+	touch_slot(table, slot_index);
+
+	return true;
+}
+
+/* Queues a missing chunk for the loaders; repeats are ignored and the oldest request gives way when full */
+void re_chunk_table_request(struct REChunkTable *table, uint32_t chunk_x, uint32_t chunk_y)
+{
+	for (uint32_t index = 0; index < table->request_count; index++) {
+		struct REChunkRequest *request = &table->requests[(table->request_start + index) % RE_CHUNK_TABLE_MAX_REQUESTS];
+		if (request->chunk_x == chunk_x && request->chunk_y == chunk_y) {
+			return;
+		}
+	}
+
+	if (table->request_count == RE_CHUNK_TABLE_MAX_REQUESTS) {
+		table->request_start = (table->request_start + 1) % RE_CHUNK_TABLE_MAX_REQUESTS;
+		table->request_count--;
+	}
+
+	uint32_t end = (table->request_start + table->request_count) % RE_CHUNK_TABLE_MAX_REQUESTS;
+	table->requests[end] = (struct REChunkRequest) { chunk_x, chunk_y };
+	table->request_count++;
+}
+
+bool re_chunk_table_take_request(struct REChunkTable *table, uint32_t *p_chunk_x, uint32_t *p_chunk_y)
+{
+	if (table->request_count == 0) {
+		return false;
+	}
+
+	struct REChunkRequest request = table->requests[table->request_start];
+	table->request_start = (table->request_start + 1) % RE_CHUNK_TABLE_MAX_REQUESTS;
+	table->request_count--;
+
+	*p_chunk_x = request.chunk_x;
+	*p_chunk_y = request.chunk_y;
+
+	return true;
+}
+
+uint32_t find_slot(struct REChunkTable *table, uint32_t bucket, uint32_t chunk_x, uint32_t chunk_y)
+{
+	uint32_t slot_index = table->buckets[bucket];
+	while (slot_index != RE_CHUNK_TABLE_NONE) {
+		struct REChunkSlot *slot = &table->slots[slot_index];
+		if (slot->chunk_x == chunk_x && slot->chunk_y == chunk_y) {
+			break;
+		}
+		slot_index = slot->bucket_next;
+	}
+
+	return slot_index;
+}
+
+/* Evicts the least recently used chunk that isn't pinned, if any, and files its slot under the new chunk */
+uint32_t claim_oldest_slot(struct REChunkTable *table, uint32_t bucket, uint32_t chunk_x, uint32_t chunk_y)
+{
+	uint32_t slot_index = table->oldest;
+	while (slot_index != RE_CHUNK_TABLE_NONE && atomic_load(table->slots[slot_index].pin_count) > 0) {
+		slot_index = table->slots[slot_index].newer;
+	}
+	if (slot_index == RE_CHUNK_TABLE_NONE) {
+		slot_index = add_slot(table);
+	}
+	struct REChunkSlot *slot = &table->slots[slot_index];
+
+	if (slot->resident) {
+		unlink_from_bucket(table, slot_index);
+		table->stats.evicted++;
+		table->stats.resident--;
+	}
+
+	slot->chunk_x = chunk_x;
+	slot->chunk_y = chunk_y;
+	slot->resident = true;
+	slot->bucket_next = table->buckets[bucket];
+	table->buckets[bucket] = slot_index;
+	table->stats.resident++;
+
+	return slot_index;
+}
+
+/*
+ * For when every slot is pinned, which takes more readers at once than the table has slots. The slots move, but
+ * their cells and pin counts don't, so readers holding them are unaffected.
+ */
+uint32_t add_slot(struct REChunkTable *table)
+{
+	uint32_t slot_index = table->slot_count++;
+	table->slots = REALLOC_ARR(table->slots, table->slot_count);
+
+	struct REChunkSlot *slot = &table->slots[slot_index];
+	*slot = (struct REChunkSlot) {
+		.resident = false,
+		.bucket_next = RE_CHUNK_TABLE_NONE,
+		.newer = RE_CHUNK_TABLE_NONE,
+		.older = RE_CHUNK_TABLE_NONE
+	};
+	slot->pin_count = malloc(sizeof *slot->pin_count);
+	atomic_init(slot->pin_count, 0);
+	slot->cells = ALLOC_ARR(slot->cells, RE_CHUNK_AREA);
+	link_as_newest(table, slot_index);
+
+	table->stats.capacity = table->slot_count;
+
+	return slot_index;
+}
+
+void unlink_from_bucket(struct REChunkTable *table, uint32_t slot_index)
+{
+	struct REChunkSlot *slot = &table->slots[slot_index];
+	uint32_t *p_link = &table->buckets[get_bucket(table, slot->chunk_x, slot->chunk_y)];
+
+	while (*p_link != slot_index) {
+		p_link = &table->slots[*p_link].bucket_next;
+	}
+	*p_link = slot->bucket_next;
+}
+
+void touch_slot(struct REChunkTable *table, uint32_t slot_index)
+{
+	if (slot_index != table->newest) {
+		unlink_from_recency(table, slot_index);
+		link_as_newest(table, slot_index);
+	}
+}
+
+void unlink_from_recency(struct REChunkTable *table, uint32_t slot_index)
+{
+	struct REChunkSlot *slot = &table->slots[slot_index];
+
+	if (slot->newer != RE_CHUNK_TABLE_NONE) {
+		table->slots[slot->newer].older = slot->older;
+	} else {
+		table->newest = slot->older;
+	}
+
+	if (slot->older != RE_CHUNK_TABLE_NONE) {
+		table->slots[slot->older].newer = slot->newer;
+	} else {
+		table->oldest = slot->newer;
+	}
+}
+
+void link_as_newest(struct REChunkTable *table, uint32_t slot_index)
+{
+	struct REChunkSlot *slot = &table->slots[slot_index];
+
+	slot->newer = RE_CHUNK_TABLE_NONE;
+	slot->older = table->newest;
+	if (table->newest != RE_CHUNK_TABLE_NONE) {
+		table->slots[table->newest].newer = slot_index;
+	}
+	table->newest = slot_index;
+
+	if (table->oldest == RE_CHUNK_TABLE_NONE) {
+		table->oldest = slot_index;
+	}
+}
+
+uint32_t get_bucket(struct REChunkTable *table, uint32_t chunk_x, uint32_t chunk_y)
+{
+	uint32_t hash = chunk_x * 0x9E3779B1u ^ chunk_y * 0x85EBCA77u;
+	return (hash ^ (hash >> 16)) & table->bucket_mask;
+}
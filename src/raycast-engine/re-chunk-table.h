@@ -0,0 +1,80 @@
+#ifndef re_chunk_table_h
+#define re_chunk_table_h
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "raycast-engine.h"
+
+#define RE_CHUNK_TABLE_NONE UINT32_MAX
+#define RE_CHUNK_TABLE_MIN_SLOTS 4 // a ray along a chunk corner reads up to four chunks in turn
+#define RE_CHUNK_TABLE_MAX_REQUESTS 64
+
+/*
+ * The resident chunks of a chunked map, in a fixed number of slots. A chunk that is missing goes into the least
+ * recently used slot. Slots are found through a chained hash on chunk coordinates and kept in recency order on a
+ * doubly linked list, so lookups and evictions are O(1). Callers hold lock around every lookup and for as long as
+ * they read the returned cells, unless they pin the slot: a pinned slot is never evicted, so its cells can be read
+ * with the table unlocked. If every slot is pinned when one is needed, the table grows by a slot.
+ *
+ * Each slot's cells are a separate buffer, so a chunk generated elsewhere without the lock is installed by
+ * swapping buffers rather than copying.
+ */
+struct REChunkTable {
+	pthread_mutex_t lock;
+	struct REChunkSource source;
+
+	uint32_t slot_count;
+	struct REChunkSlot {
+		uint32_t chunk_x;
+		uint32_t chunk_y;
+		bool resident;
+		atomic_uint *pin_count; // readers of the cells with the table unlocked; apart, so it stays put as slots grow
+		uint32_t bucket_next; // next slot in the same hash bucket
+		uint32_t newer; // toward the most recently used slot
+		uint32_t older;
+		struct REMapCell *cells; // RE_CHUNK_AREA
+	} *slots;
+
+	uint32_t bucket_mask;
+	uint32_t *buckets; // first slot in each bucket
+
+	uint32_t newest;
+	uint32_t oldest; // evicted next; free slots are kept at this end
+
+	// Chunks rays found missing, oldest first, for the loaders to take ahead of their own plan
+	uint32_t request_count;
+	uint32_t request_start;
+	struct REChunkRequest {
+		uint32_t chunk_x;
+		uint32_t chunk_y;
+	} requests[RE_CHUNK_TABLE_MAX_REQUESTS];
+
+	struct REChunkLoader *loader; // NULL unless prefetching
+	struct REChunkStats stats;
+};
+
+struct REChunkTable *re_chunk_table_create(struct REChunkSource source, uint32_t slot_count);
+void re_chunk_table_destroy(struct REChunkTable *table);
+
+struct REMapCell *re_chunk_table_find(struct REChunkTable *table, uint32_t chunk_x, uint32_t chunk_y);
+struct REMapCell *re_chunk_table_lock_and_get(struct REChunkTable *table, uint32_t chunk_x, uint32_t chunk_y);
+struct REMapCell *re_chunk_table_pin(struct REChunkTable *table, uint32_t chunk_x, uint32_t chunk_y,
+		atomic_uint **p_pin_count);
+void re_chunk_table_unpin(atomic_uint *pin_count);
+bool re_chunk_table_touch(struct REChunkTable *table, uint32_t chunk_x, uint32_t chunk_y);
+bool re_chunk_table_install(struct REChunkTable *table, uint32_t chunk_x, uint32_t chunk_y,
+		struct REMapCell **p_cells);
+
+void re_chunk_table_request(struct REChunkTable *table, uint32_t chunk_x, uint32_t chunk_y);
+bool re_chunk_table_take_request(struct REChunkTable *table, uint32_t *p_chunk_x, uint32_t *p_chunk_y);
+
+/* Where map cell (x, y) is within its chunk's cells */
+static inline uint32_t re_chunk_cell_index(uint32_t x, uint32_t y)
+{
+	return ((y & (RE_CHUNK_SIZE - 1)) << RE_CHUNK_SHIFT) | (x & (RE_CHUNK_SIZE - 1));
+}
+
+#endif // re_chunk_table_h
@@ -0,0 +1,198 @@
+#include <fcntl.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../mem-utils/mem-macros.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif // MEM_DEBUG
+
+#include "re-map-file.h"
+
+static bool is_header_valid(struct REMapFileHeader *header, size_t file_size);
+
+/*
+ * Flat and masked maps; a masked map is saved as the cells it reads as. The file is written beside path and renamed
+ * over it, so processes that have the old file mapped keep reading it intact.
+ */
+bool re_map_save(struct REMap *map, const char *path)
+{
+	if (map->chunk_table != NULL) {
+		return false;
+	}
+
+	struct REMapWriter *writer = re_map_writer_open(path, map->width, map->height);
+	if (writer == NULL) {
+		return false;
+	}
+
+	struct REMapCell *row_cells = (map->cells == NULL) ? ALLOC_ARR(row_cells, map->width) : NULL;
+	bool written = true;
+	for (uint32_t y = 0; y < map->height && written; y++) {
+		struct REMapCell *cells = row_cells;
+		if (row_cells != NULL) {
+			for (uint32_t x = 0; x < map->width; x++) {
+				row_cells[x] = re_map_get_cell(map, x, y);
+			}
+		} else {
+			cells = &map->cells[(size_t) y * map->width];
+		}
+
+		written = re_map_writer_write_row(writer, cells);
+	}
+	free(row_cells);
+
+	return re_map_writer_close(writer);
+}
+
+/*
+ * Returns NULL if the file can't be mapped or isn't a version RE_MAP_FILE_VERSION map laid out like this build's
+ * cells. The mapping is private: edits through re_map_set_cell copy the page they touch and never reach the file.
+ */
+struct REMap *re_map_load(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t) sizeof (struct REMapFileHeader)) {
+		close(fd);
+		return NULL;
+	}
+
+	size_t file_size = (size_t) file_stat.st_size;
+	void *mapping = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping keeps the file open
+	if (mapping == MAP_FAILED) {
+		return NULL;
+	}
+
+	struct REMapFileHeader *header = (struct REMapFileHeader *) mapping;
+	if (!is_header_valid(header, file_size)) {
+		munmap(mapping, file_size);
+		return NULL;
+	}
+
+	struct REMap *map = malloc(sizeof *map);
+
+	map->width = header->width;
+	map->height = header->height;
+	map->chunk_table = NULL;
+	map->mask_source = NULL;
+	map->mapping = mapping;
+	map->mapping_size = file_size;
+	map->cells = (struct REMapCell *) ((char *) mapping + header->cells_offset);
+
+	return map;
+}
+
+/*
+ * For maps too big to hold: the caller passes the rows from y = 0 up and never needs more than one in memory.
+ * Returns NULL if the file can't be created or the map would be empty.
+ */
+struct REMapWriter *re_map_writer_open(const char *path, uint32_t width, uint32_t height)
+{
+	if (width == 0 || height == 0) {
+		return NULL;
+	}
+
+	size_t path_length = strlen(path);
+	char *temp_path = ALLOC_STR_LENGTH(path_length + 4);
+	memcpy(temp_path, path, path_length);
+	memcpy(temp_path + path_length, ".tmp", 5);
+
+	FILE *file = fopen(temp_path, "wb");
+	if (file == NULL) {
+		free(temp_path);
+		return NULL;
+	}
+
+	struct REMapWriter *writer = malloc(sizeof *writer);
+
+	writer->file = file;
+	writer->path = ALLOC_STR_LENGTH(path_length);
+	memcpy(writer->path, path, path_length + 1);
+	writer->temp_path = temp_path;
+	writer->width = width;
+	writer->height = height;
+	writer->rows_written = 0;
+
+	struct REMapFileHeader header = {
+		.magic = RE_MAP_FILE_MAGIC,
+		.version = RE_MAP_FILE_VERSION,
+		.byte_order = RE_MAP_FILE_BYTE_ORDER,
+		.cell_size = sizeof (struct REMapCell),
+		.width = width,
+		.height = height,
+		.reserved = 0,
+		.cells_offset = RE_MAP_FILE_CELLS_OFFSET
+	};
+
+	static const char PADDING[RE_MAP_FILE_CELLS_OFFSET - sizeof (struct REMapFileHeader)] = { 0 };
+	writer->failed = (fwrite(&header, sizeof header, 1, file) != 1
+			|| fwrite(PADDING, sizeof PADDING, 1, file) != 1);
+
+	return writer;
+}
+
+/* width cells; false once any write has failed or every row is already written */
+bool re_map_writer_write_row(struct REMapWriter *writer, const struct REMapCell *cells)
+{
+	if (writer->failed || writer->rows_written == writer->height) {
+		return false;
+	}
+
+	writer->failed = (fwrite(cells, sizeof cells[0], writer->width, writer->file) != writer->width);
+	writer->rows_written++;
+
+	return !writer->failed;
+}
+
+/* Renames the file into place if every row was written, or removes it. Either way the writer is freed */
+bool re_map_writer_close(struct REMapWriter *writer)
+{
+	bool complete = (fclose(writer->file) == 0 && !writer->failed && writer->rows_written == writer->height);
+	bool saved = (complete && rename(writer->temp_path, writer->path) == 0);
+	if (!saved) {
+		remove(writer->temp_path);
+	}
+
+	free(writer->path);
+	free(writer->temp_path);
+	free(writer);
+
+	return saved;
+}
+
+void re_map_file_unmap(struct REMap *map)
+{
+	munmap(map->mapping, map->mapping_size);
+	map->mapping = NULL;
+	map->cells = NULL;
+}
+
+bool is_header_valid(struct REMapFileHeader *header, size_t file_size)
+{
+	if (memcmp(header->magic, RE_MAP_FILE_MAGIC, sizeof RE_MAP_FILE_MAGIC) != 0
+			|| header->version != RE_MAP_FILE_VERSION || header->byte_order != RE_MAP_FILE_BYTE_ORDER
+			|| header->cell_size != sizeof (struct REMapCell) || header->width == 0 || header->height == 0) {
+		return false;
+	}
+
+	if (header->cells_offset < sizeof *header || header->cells_offset > file_size
+			|| header->cells_offset % alignof (struct REMapCell) != 0) {
+		return false;
+	}
+
+	// Compared in cells so a huge width * height can't overflow
+	uint64_t cell_capacity = (file_size - header->cells_offset) / header->cell_size;
+	return (uint64_t) header->width * header->height <= cell_capacity;
+}
@@ -0,0 +1,45 @@
+#ifndef re_map_file_h
+#define re_map_file_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "raycast-engine.h"
+
+#define RE_MAP_FILE_MAGIC "RCMAP"
+#define RE_MAP_FILE_VERSION 1
+#define RE_MAP_FILE_BYTE_ORDER 0x01020304u
+#define RE_MAP_FILE_CELLS_OFFSET 4096 // cells start on a page of their own
+
+/*
+ * A map file is this header, zeros up to cells_offset, then width * height cells row by row, laid out exactly as
+ * struct REMapCell is in memory. Loading maps the file and points the map's cells into it, so nothing is read until
+ * rays reach it and every process loading the same file shares its pages. A file only loads where the byte order
+ * and cell layout match the writer's; others are refused rather than converted.
+ */
+struct REMapFileHeader {
+	char magic[8]; // RE_MAP_FILE_MAGIC, zero padded
+	uint32_t version;
+	uint32_t byte_order; // RE_MAP_FILE_BYTE_ORDER as the writer stored it
+	uint32_t cell_size;
+	uint32_t width;
+	uint32_t height;
+	uint32_t reserved;
+	uint64_t cells_offset;
+};
+
+/* A map file being written a row at a time. It is written beside path and only renamed over it once complete */
+struct REMapWriter {
+	FILE *file;
+	char *path;
+	char *temp_path;
+	uint32_t width;
+	uint32_t height;
+	uint32_t rows_written;
+	bool failed;
+};
+
+void re_map_file_unmap(struct REMap *map);
+
+#endif // re_map_file_h
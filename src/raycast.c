@@ -1,60 +1,106 @@
-#include <ctype.h>
 #include <math.h>
 #include <pthread.h>
+#include <signal.h>
 #include <unistd.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-
+#include <string.h>
+#include <time.h>
+
+#include "event-signal/event-signal.h"
+#include "frame-pacer/frame-pacer.h"
+#include "frame-stats/frame-stats.h"
+#include "input-queue/input-queue.h"
+#include "input-record/input-record.h"
 #include "mem-utils/mem-macros.h"
 #include "option-map/option-map.h"
+#include "pose-snapshot/pose-snapshot.h"
+#include "trace/trace.h"
 #include "raycast-engine/raycast-engine.h"
+#include "ray-stats/ray-stats.h"
+#include "scene/scene.h"
 #include "simptg/simptg.h"
-#include "maze-gen/maze-gen.h"
+#include "simulation/simulation.h"
 
 #ifdef MEM_DEBUG
 #include "mem-utils/mem-debug.h"
 #endif
 
-#define PI 3.14159265358979323846
 #define CTRL_C '\003'
 
-enum WallMaterial {
-	WALL_OUT_OF_BOUNDS = SCG_COLOR_BRIGHT_BLACK,
-	WALL_NONE = SCG_COLOR_BLACK,
-	WALL_BLUE = SCG_COLOR_BLUE,
-	WALL_BRIGHT_BLUE = SCG_COLOR_BRIGHT_BLUE,
-	WALL_RED = SCG_COLOR_RED,
-	WALL_GREEN = SCG_COLOR_GREEN
-};
+#define SIMULATION_TICK_RATE 120
+#define INPUT_QUEUE_CAPACITY 256
+#define MAP_SIZE 16
+#define WORLD_MEMORY_BUDGET (4 << 20) // chunk cells kept resident by --infinite
+#define PREFETCH_THREADS 2
+#define PREFETCH_VIEW_DISTANCE 48.0 // cells; past this walls are a pixel or two tall
+#define PREFETCH_LOOKAHEAD_FRAMES 30
 
 struct Options {
 	uint16_t width;
 	uint16_t height;
+	double target_fps;
+	bool on_demand;
+	bool show_stats;
+	char *stats_csv_path;
+	char *trace_path;
+	char *heatmap_path;
+	char *record_path;
+	char *replay_path;
+	bool replay_max_speed;
+	bool infinite;
+	char *map_path;
+	char *save_map_path;
+	bool seed_given;
+	uint64_t seed;
 };
 
-struct Player {
-	double x;
-	double y;
-	double rotation;
+struct Renderer {
+	struct REMap *map;
+	struct SCGPixelBuffer *pixel_buffer;
+	struct SCGPixelBuffer *printed_buffer; // what the terminal is showing, once printed_buffer_valid
+	bool printed_buffer_valid;
+	bool show_stats;
+#ifdef FRAME_STATS
+	char *stats_overlay;
+	uint32_t stats_overlay_age;
+#endif // FRAME_STATS
 };
 
 struct CrossThreadData {
-	volatile struct Player *p_player;
-	struct REMap *map;
-	volatile bool quit;
+	struct Simulation *simulation; // owned by the simulation thread once it starts
+	struct InputQueue *input_queue;
+	struct PoseSnapshot *pose_snapshot;
+	struct EventSignal *simulation_signal; // input arrived
+	struct EventSignal *render_signal; // something visible changed
+	struct InputRecord *input_record; // written only by the simulation thread; NULL unless recording
+	uint64_t start_ns;
+	atomic_bool quit;
 };
 
+static struct EventSignal *p_resize_signal = NULL;
+static volatile sig_atomic_t terminal_resized = 0;
+static volatile sig_atomic_t replay_interrupted = 0;
+
+static struct REMap *create_map(enum InputRecordMapKind map_kind, uint32_t width, uint32_t height, uint64_t seed);
+static void run_session(struct Renderer *renderer, enum InputRecordMapKind map_kind, uint64_t seed,
+		struct Options *options);
+static void run_replay(struct Renderer *renderer, struct InputRecord *record, struct Options *options);
+static void render_frame(struct Renderer *renderer, struct Pose pose);
+static void hint_view(struct Renderer *renderer, struct PoseState pose_state, struct Pose pose, double target_fps);
+static void print_frame_rate(struct FramePacer *frame_pacer);
 static struct Options parse_options(int argc, char **argv);
-static void init_map(struct REMap *map);
-static void draw_frame(struct REMap *map, struct SCGBuffer *pixel_buffer, double origin_x, double origin_y, double forward_angle);
-static void angle_to_vector(double angle, double length, double *vec_x, double *vec_y);
-static double vector_to_angle(double x, double y);
-static double reduce_angle(double angle);
-static int32_t min_int32(int32_t a, int32_t b); 
-static int32_t move_player(volatile struct Player *p_player, double dx, double dy, struct REMap *map);
+static struct Pose player_get_pose(struct Player *p_player);
+static struct PoseState simulation_get_pose_state(struct Simulation *simulation);
+static struct Pose pose_state_interpolate(struct PoseState state, uint64_t now_ns, double tick_rate);
+static bool pose_equals(struct Pose a, struct Pose b);
+static void handle_sigwinch(int signal_number);
+static void handle_sigint(int signal_number);
 
 void *input_loop_func(void *vp_data);
+void *simulation_loop_func(void *vp_data);
 
 int main(int argc, char **argv)
 {
@@ -66,28 +112,116 @@ int main(int argc, char **argv)
 	
 	struct Options options = parse_options(argc - 1, &argv[1]);
 
-	struct REMap *map = re_map_create(16, 16);
-	init_map(map);
-	printf("\n");
+	if (options.trace_path != NULL) {
+		trace_start(options.trace_path);
+		trace_set_thread_name("render");
+	}
 
-	struct SCGBuffer *pixel_buffer = stg_pixel_buffer_create(options.width, options.height);
-	stg_pixel_buffer_make_space(pixel_buffer);
-	stg_input_adjust();
+	uint64_t seed = options.seed_given ? options.seed : (uint64_t) time(NULL);
+	enum InputRecordMapKind map_kind = options.infinite ? INPUT_RECORD_MAP_WORLD : INPUT_RECORD_MAP_MAZE;
+	uint32_t map_width = options.infinite ? SCENE_WORLD_SIZE : MAP_SIZE;
+	uint32_t map_height = options.infinite ? SCENE_WORLD_SIZE : MAP_SIZE;
 
-	volatile struct Player player = { 0.5, map->height - 0.5, 0.0625 };
+	struct InputRecord *replay_record = NULL;
+	if (options.replay_path != NULL) {
+		replay_record = input_record_load(options.replay_path);
+		if (replay_record == NULL) {
+			fprintf(stderr, "raycast: could not read recording '%s'\n", options.replay_path);
 
-	struct CrossThreadData data = { .p_player = &player, .map = map, .quit = false };
-	pthread_t input_thread;
-	pthread_create(&input_thread, NULL, input_loop_func, &data);
+			exit(EXIT_FAILURE);
+		}
+
+		if (replay_record->map_kind == INPUT_RECORD_MAP_FILE) {
+			fprintf(stderr, "raycast: recording '%s' was made on a map file and can't be replayed\n",
+					options.replay_path);
+
+			exit(EXIT_FAILURE);
+		}
 
-	while (!data.quit) {
-		draw_frame(map, pixel_buffer, player.x, player.y, player.rotation);
-		usleep(1000000 / 60);
+		map_kind = replay_record->map_kind;
+		seed = replay_record->seed;
+		map_width = replay_record->map_width;
+		map_height = replay_record->map_height;
 	}
 
-	stg_pixel_buffer_remove_space(pixel_buffer);
-	stg_pixel_buffer_destroy(pixel_buffer);
-	stg_input_restore();
+	struct REMap *map;
+	if (options.map_path != NULL) {
+		map_kind = INPUT_RECORD_MAP_FILE;
+		map = re_map_load(options.map_path);
+		if (map == NULL) {
+			fprintf(stderr, "raycast: could not load map '%s'\n", options.map_path);
+
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		map = create_map(map_kind, map_width, map_height, seed);
+	}
+
+	if (options.save_map_path != NULL) {
+		bool saved = re_map_save(map, options.save_map_path);
+		if (!saved) {
+			fprintf(stderr, "raycast: could not write map '%s'\n", options.save_map_path);
+		}
+
+		re_map_destroy(map);
+		exit(saved ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	printf("\n");
+
+	struct Renderer renderer = {
+		.map = map,
+		.pixel_buffer = stg_pixel_buffer_create(options.width, options.height),
+		.printed_buffer = stg_pixel_buffer_create(options.width, options.height),
+		.printed_buffer_valid = false,
+		.show_stats = options.show_stats
+	};
+#ifdef FRAME_STATS
+	renderer.stats_overlay = ALLOC_STR_LENGTH((size_t) options.width * 2);
+	renderer.stats_overlay_age = 0;
+#endif // FRAME_STATS
+	stg_pixel_buffer_make_space(renderer.pixel_buffer);
+
+	if (replay_record != NULL) {
+		run_replay(&renderer, replay_record, &options);
+		input_record_destroy(replay_record);
+	} else {
+		run_session(&renderer, map_kind, seed, &options);
+	}
+
+	stg_pixel_buffer_remove_space(renderer.pixel_buffer);
+	stg_pixel_buffer_destroy(renderer.pixel_buffer);
+	stg_pixel_buffer_destroy(renderer.printed_buffer);
+#ifdef FRAME_STATS
+	free(renderer.stats_overlay);
+
+	if (options.stats_csv_path != NULL && !frame_stats_write_csv(options.stats_csv_path)) {
+		fprintf(stderr, "raycast: could not write '%s'\n", options.stats_csv_path);
+	}
+#endif // FRAME_STATS
+	free(options.stats_csv_path);
+
+#ifdef RAY_STATS
+	struct RayStatsSummary ray_summary = ray_stats_get_summary();
+	fprintf(stderr, "raycast: %llu rays, %.2f DDA steps/ray (max %llu), %.2f cells/ray, %llu bounds failures, "
+			"%llu out-of-bounds hits\n", (unsigned long long) ray_summary.rays, ray_summary.mean_steps,
+			(unsigned long long) ray_summary.max_steps,
+			(ray_summary.rays > 0) ? (double) ray_summary.cells_visited / ray_summary.rays : 0,
+			(unsigned long long) ray_summary.bounds_failures, (unsigned long long) ray_summary.out_of_bounds_hits);
+
+	if (options.heatmap_path != NULL && !ray_stats_write_heatmap(options.heatmap_path)) {
+		fprintf(stderr, "raycast: could not write '%s'\n", options.heatmap_path);
+	}
+	ray_stats_free();
+#endif // RAY_STATS
+	free(options.heatmap_path);
+
+	if (options.trace_path != NULL && !trace_stop()) {
+		fprintf(stderr, "raycast: could not write '%s'\n", options.trace_path);
+	}
+	free(options.trace_path);
+	free(options.record_path);
+	free(options.replay_path);
+	free(options.map_path);
 
 	re_map_destroy(map);
 
@@ -101,336 +235,481 @@ int main(int argc, char **argv)
 	return EXIT_SUCCESS;
 }
 
-static struct Options parse_options(int argc, char **argv)
+/* Generates a maze or world map; map files are loaded by re_map_load instead */
+static struct REMap *create_map(enum InputRecordMapKind map_kind, uint32_t width, uint32_t height, uint64_t seed)
 {
-	char *size_aliases[] = { "--size", "-s", NULL };
+	if (map_kind == INPUT_RECORD_MAP_WORLD) {
+		return scene_create_world(seed, WORLD_MEMORY_BUDGET);
+	}
 
-	struct OptionMapOption option_arr[] = {
-		{ .aliases = size_aliases, .takes_value = true }
-	};
-	size_t option_count = 1;
+	return scene_create_maze_map(width, height, seed);
+}
 
-	struct OptionMap *option_map = option_map_create(option_arr, option_count);
-	struct OptionMapError error = option_map_set_options(option_map, argc, argv);
+/* Interactive play: input, simulation and rendering each on their own thread */
+static void run_session(struct Renderer *renderer, enum InputRecordMapKind map_kind, uint64_t seed,
+		struct Options *options)
+{
+	struct REMap *map = renderer->map;
 
-	if (error.error_code != OM_NO_ERROR) {
-		option_map_print_error_message(stderr, "raycast: ", error);
+	struct EventSignal *simulation_signal = event_signal_create();
+	struct EventSignal *render_signal = event_signal_create();
+	if (simulation_signal == NULL || render_signal == NULL) {
+		fprintf(stderr, "raycast: could not create event signals\n");
 
 		exit(EXIT_FAILURE);
 	}
 
-	struct Options options = { .width = 64, .height = 48 };
-
-	if (option_map_is_option_given(option_map, "--size")) {
-		char *size = option_map_get_option_value(option_map, "--size");
-		sscanf(size, "%hux%hu", &options.width, &options.height);
-	}
+	stg_input_adjust();
 
-	option_map_destroy(option_map);
+	struct Player player = { .x = 0.5, .y = map->height - 0.5, .rotation = binary_angle_from_radians(0.0625) };
+	struct Simulation *simulation = simulation_create(map, WALL_NONE, player, SIMULATION_TICK_RATE);
+
+	struct CrossThreadData data = {
+		.simulation = simulation,
+		.input_queue = input_queue_create(INPUT_QUEUE_CAPACITY),
+		.pose_snapshot = pose_snapshot_create(simulation_get_pose_state(simulation)),
+		.simulation_signal = simulation_signal,
+		.render_signal = render_signal,
+		.input_record = NULL,
+		.start_ns = frame_pacer_now_ns()
+	};
+	atomic_init(&data.quit, false);
 
-	return options;
-}
+	if (options->record_path != NULL) {
+		data.input_record = input_record_create(map_kind, seed, map->width, map->height, SIMULATION_TICK_RATE);
+	}
 
-static void init_map(struct REMap *map)
-{
-	re_map_fill(map, RE_MAP_CELL_SOLID(WALL_NONE));
+	p_resize_signal = data.render_signal;
+	struct sigaction resize_action = { .sa_handler = handle_sigwinch };
+	sigemptyset(&resize_action.sa_mask);
+	sigaction(SIGWINCH, &resize_action, NULL);
 
-	srand(time(NULL));
-	struct Maze *maze = maze_create(map->width, map->height);
-	maze_generate(maze);
+	pthread_t input_thread;
+	pthread_t simulation_thread;
+	pthread_create(&input_thread, NULL, input_loop_func, &data);
+	pthread_create(&simulation_thread, NULL, simulation_loop_func, &data);
+
+	struct FramePacer *frame_pacer = frame_pacer_create(options->target_fps);
+
+	// Only here: replays generate chunks as rays reach them so that every run draws the same frames
+	re_map_start_prefetch(map, PREFETCH_THREADS);
+
+	while (!atomic_load(&data.quit)) {
+		struct PoseState pose_state = pose_snapshot_read(data.pose_snapshot);
+		struct Pose pose = pose_state_interpolate(pose_state, frame_pacer_now_ns(), SIMULATION_TICK_RATE);
+		hint_view(renderer, pose_state, pose, options->target_fps);
+
+		uint64_t fallbacks = re_map_get_chunk_stats(map).fallbacks;
+		render_frame(renderer, pose);
+		bool chunks_missing = (re_map_get_chunk_stats(map).fallbacks != fallbacks);
+
+		// Once the pose has settled, further frames would be identical; sleep until the simulation,
+		// a map edit or SIGWINCH signals a change. A frame drawn without chunks the loaders hadn't brought in
+		// yet isn't final, so frames go on at the paced rate until one is drawn whole.
+		if (options->on_demand && !chunks_missing && pose_equals(pose_state.previous, pose_state.current)) {
+			TRACE_BEGIN("idle");
+			event_signal_wait(data.render_signal, EVENT_SIGNAL_WAIT_FOREVER);
+			TRACE_END("idle");
+			frame_pacer_resync(frame_pacer);
+		} else {
+			TRACE_BEGIN("pace");
+			frame_pacer_wait(frame_pacer);
+			TRACE_END("pace");
+		}
+	}
 
-	for (uint32_t row = 0; row < maze->height; row++) {
-		for (uint32_t col = 0; col < maze->width; col++) {
-			struct REMapCell cell = RE_MAP_CELL_SOLID(WALL_NONE);
+	signal(SIGWINCH, SIG_DFL);
+	p_resize_signal = NULL;
 
-			if (maze_has_wall(maze, col, row, MAZE_WALL_TOP)) {
-				cell.material_top = WALL_BRIGHT_BLUE;
-			}
-			if (maze_has_wall(maze, col, row, MAZE_WALL_RIGHT)) {
-				cell.material_right = WALL_BLUE;
-			}
-			if (maze_has_wall(maze, col, row, MAZE_WALL_BOTTOM)) {
-				cell.material_bottom = WALL_BRIGHT_BLUE;
-			}
-			if (maze_has_wall(maze, col, row, MAZE_WALL_LEFT)) {
-				cell.material_left = WALL_BLUE;
-			}
+	pthread_join(input_thread, NULL);
+	pthread_join(simulation_thread, NULL);
 
-			if (col == 0 && row == 0) {
-				cell.material_left = WALL_RED;
-			}
-			if (col == maze->width - 1 && row == maze->height - 1) {
-				cell.material_right = WALL_GREEN;
-			}
+	re_map_stop_prefetch(map);
 
-			re_map_set_cell(map, col, (map->height - 1) - row, cell);
+	if (data.input_record != NULL) {
+		input_record_finish(data.input_record, simulation->tick_count, frame_pacer_now_ns() - data.start_ns);
+		if (!input_record_save(data.input_record, options->record_path)) {
+			fprintf(stderr, "raycast: could not write '%s'\n", options->record_path);
 		}
+		input_record_destroy(data.input_record);
 	}
 
-	maze_destroy(maze);
+	input_queue_destroy(data.input_queue);
+	pose_snapshot_destroy(data.pose_snapshot);
+	event_signal_destroy(data.simulation_signal);
+	event_signal_destroy(data.render_signal);
+	simulation_destroy(simulation);
+
+	stg_input_restore();
+
+	print_frame_rate(frame_pacer);
+	frame_pacer_destroy(frame_pacer);
 }
 
-static void draw_frame(struct REMap *map, struct SCGBuffer *pixel_buffer, double origin_x, double origin_y, double forward_angle)
+/*
+ * Plays a recording back on the render thread. At original speed the recorded clock is followed and frames are
+ * paced as usual; at max speed every tick is rendered as one frame with no pacing, which makes a
+ * reproducible workload.
+ */
+static void run_replay(struct Renderer *renderer, struct InputRecord *record, struct Options *options)
 {
-	int32_t screen_width = pixel_buffer->width / 2;
-	int32_t screen_height = pixel_buffer->height;
+	struct REMap *map = renderer->map;
 
-	for (int32_t row = 0; row < screen_height; row++) {
-		for (int32_t col = 0; col < screen_width; col++) {
-			stg_pixel_buffer_set(pixel_buffer, col, row, WALL_NONE);
-		}
-	}
+	// stdin is left cooked so ctrl-c interrupts the replay
+	struct sigaction interrupt_action = { .sa_handler = handle_sigint };
+	sigemptyset(&interrupt_action.sa_mask);
+	sigaction(SIGINT, &interrupt_action, NULL);
 
-	int32_t scaler_dimension = min_int32(screen_width, screen_height);
+	struct sigaction resize_action = { .sa_handler = handle_sigwinch };
+	sigemptyset(&resize_action.sa_mask);
+	sigaction(SIGWINCH, &resize_action, NULL);
 
-	double lengths[screen_width];
-	enum WallMaterial materials[screen_width];
+	struct Player player = { .x = 0.5, .y = map->height - 0.5, .rotation = binary_angle_from_radians(0.0625) };
+	struct Simulation *simulation = simulation_create(map, WALL_NONE, player, record->tick_rate);
+	struct InputReplay *replay = input_replay_create(record, simulation);
 
-	// Calculate values
-	for (int32_t line = 0; line < screen_width; line++)
-	{
-		double line_center_offset = (int32_t) line - (int32_t) screen_width / 2;
-		double rel_angle = -vector_to_angle(1, line_center_offset / (scaler_dimension));
+	bool max_speed = options->replay_max_speed;
+	struct FramePacer *frame_pacer = frame_pacer_create(max_speed ? FRAME_PACER_UNCAPPED : options->target_fps);
+	uint64_t start_ns = frame_pacer_now_ns();
 
-		enum WallMaterial collided_material;
-		double forward_distance = re_cast_ray(map, origin_x, origin_y, forward_angle, rel_angle, WALL_NONE, WALL_OUT_OF_BOUNDS, &collided_material);
+	while (!replay_interrupted && !input_replay_is_finished(replay)) {
+		uint64_t replay_ns = max_speed ? UINT64_MAX : frame_pacer_now_ns() - start_ns;
+		input_replay_advance(replay, replay_ns, max_speed ? 1 : UINT32_MAX);
 
-		double length = scaler_dimension / forward_distance;
+		struct PoseState pose_state = simulation_get_pose_state(simulation);
+		pose_state.tick_time_ns = input_replay_get_tick_time_ns(replay);
+		render_frame(renderer, pose_state_interpolate(pose_state, replay_ns, record->tick_rate));
 
-		lengths[line] = length;
-		materials[line] = collided_material;
+		TRACE_BEGIN("pace");
+		frame_pacer_wait(frame_pacer);
+		TRACE_END("pace");
 	}
 
-	// Draw
-	for (int32_t line = 0; line < screen_width; line++)
-	{
-		int32_t length = (int32_t) round(lengths[line]);
-		int32_t start = round((screen_height - length) / 2);
-		int32_t end = round((screen_height + length) / 2);
+	signal(SIGWINCH, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
 
-		if (start < 0) {
-			start = 0;
-		}
-		if (end > screen_height) {
-			end = screen_height;
-		}
+	fprintf(stderr, "raycast: replayed %llu of %llu ticks\n", (unsigned long long) simulation->tick_count,
+			(unsigned long long) record->end_tick);
+	print_frame_rate(frame_pacer);
 
-		enum WallMaterial material = materials[line];
-		for (int32_t row = start; row < end; row++) {
-			stg_pixel_buffer_set(pixel_buffer, line, row, material);
-		}
-	}
+	frame_pacer_destroy(frame_pacer);
+	input_replay_destroy(replay);
+	simulation_destroy(simulation);
+}
 
-	// Print
-	stg_pixel_buffer_print(pixel_buffer);
+/* Tells the chunk loaders, if any, where the view is heading, judging by the last tick's motion */
+static void hint_view(struct Renderer *renderer, struct PoseState pose_state, struct Pose pose, double target_fps)
+{
+	struct SCGPixelBuffer *pixel_buffer = renderer->pixel_buffer;
+	double angle_change = binary_angle_difference(pose_state.previous.rotation, pose_state.current.rotation)
+		/ BINARY_ANGLE_UNITS_PER_RADIAN;
+
+	struct REViewHint hint = {
+		.x = pose.x,
+		.y = pose.y,
+		.velocity_x = (pose_state.current.x - pose_state.previous.x) * SIMULATION_TICK_RATE,
+		.velocity_y = (pose_state.current.y - pose_state.previous.y) * SIMULATION_TICK_RATE,
+		.forward_angle = pose.rotation,
+		.angular_velocity = angle_change * SIMULATION_TICK_RATE,
+		.half_fov = binary_angle_to_radians(scene_column_angle(0, stg_pixel_buffer_get_width(pixel_buffer),
+				stg_pixel_buffer_get_height(pixel_buffer))),
+		.view_distance = PREFETCH_VIEW_DISTANCE,
+		.frame_seconds = 1.0 / ((target_fps > 0) ? target_fps : 60),
+		.lookahead_frames = PREFETCH_LOOKAHEAD_FRAMES
+	};
+	re_map_hint_view(renderer->map, hint);
 }
 
-static void angle_to_vector(double angle, double length, double *vx, double *vy)
+static void render_frame(struct Renderer *renderer, struct Pose pose)
 {
-	angle = reduce_angle(angle);
-	
-	if (length == 0)
-	{
-		*vx = 0;
-		*vy = 0;
+	struct SCGPixelBuffer *pixel_buffer = renderer->pixel_buffer;
+
+	FRAME_STAGE_BEGIN(FRAME_STAGE_FRAME);
 
-		return;
+	scene_draw_frame(renderer->map, pixel_buffer, pose.x, pose.y, pose.rotation);
+
+	if (terminal_resized) {
+		terminal_resized = 0;
+		renderer->printed_buffer_valid = false; // the terminal may have reflowed or cleared what was printed
 	}
-	
-	double slope = tan(angle);
-	
-	*vx = 1;
-	*vy = slope;
-	
-	double scale = sqrt(*vx * *vx + *vy * *vy);
-	
-	*vx *= length / scale;
-	*vy *= length / scale;
-	
-	if (angle > PI / 2 && angle <= 3 * PI / 2)
-	{
-		*vx *= -1;
-		*vy *= -1;
+
+#ifdef FRAME_STATS
+	if (renderer->show_stats && renderer->stats_overlay_age-- == 0) {
+		frame_stats_format_overlay(renderer->stats_overlay, (size_t) stg_pixel_buffer_get_width(pixel_buffer) * 2 + 1);
+		stg_pixel_buffer_set_overlay(pixel_buffer, renderer->stats_overlay);
+		renderer->stats_overlay_age = 15; // refreshing every frame would make the numbers unreadable
 	}
+#endif // FRAME_STATS
+
+	FRAME_STAGE_BEGIN(FRAME_STAGE_ENCODE);
+	stg_pixel_buffer_encode_changes(pixel_buffer, renderer->printed_buffer_valid ? renderer->printed_buffer : NULL);
+	FRAME_STAGE_END(FRAME_STAGE_ENCODE);
+
+	FRAME_STAGE_BEGIN(FRAME_STAGE_WRITE);
+	stg_pixel_buffer_write(pixel_buffer);
+	FRAME_STAGE_END(FRAME_STAGE_WRITE);
+
+	FRAME_STAGE_BEGIN(FRAME_STAGE_FLUSH);
+	fflush(stdout);
+	FRAME_STAGE_END(FRAME_STAGE_FLUSH);
+
+	stg_pixel_buffer_copy(renderer->printed_buffer, pixel_buffer);
+	renderer->printed_buffer_valid = true;
+
+	FRAME_STAGE_END(FRAME_STAGE_FRAME);
 }
 
-static double vector_to_angle(double vx, double yx)
+static void print_frame_rate(struct FramePacer *frame_pacer)
 {
-	return atan2(yx, vx);
+	fprintf(stderr, "raycast: %.2f fps (%llu frames, %llu skipped)\n", frame_pacer_get_achieved_rate(frame_pacer),
+			(unsigned long long) frame_pacer_get_frame_count(frame_pacer),
+			(unsigned long long) frame_pacer_get_skipped_count(frame_pacer));
 }
 
-static double reduce_angle(double angle)
+static struct Options parse_options(int argc, char **argv)
 {
-	if (angle < 0)
-	{
-		int wraps = (int) (angle / (2 * PI));
-		
-		angle -= (wraps - 1) * (2 * PI);
+	char *size_aliases[] = { "--size", "-s", NULL };
+	char *fps_aliases[] = { "--fps", "-f", NULL };
+	char *on_demand_aliases[] = { "--on-demand", "-o", NULL };
+	char *stats_aliases[] = { "--stats", NULL };
+	char *stats_csv_aliases[] = { "--stats-csv", NULL };
+	char *trace_aliases[] = { "--trace", NULL };
+	char *heatmap_aliases[] = { "--heatmap", NULL };
+	char *record_aliases[] = { "--record", NULL };
+	char *replay_aliases[] = { "--replay", NULL };
+	char *replay_speed_aliases[] = { "--replay-speed", NULL };
+	char *seed_aliases[] = { "--seed", NULL };
+	char *infinite_aliases[] = { "--infinite", "-i", NULL };
+	char *map_aliases[] = { "--map", "-m", NULL };
+	char *save_map_aliases[] = { "--save-map", NULL };
+
+	struct OptionMapOption option_arr[] = {
+		{ .aliases = size_aliases, .takes_value = true },
+		{ .aliases = fps_aliases, .takes_value = true },
+		{ .aliases = on_demand_aliases, .takes_value = false },
+		{ .aliases = stats_aliases, .takes_value = false },
+		{ .aliases = stats_csv_aliases, .takes_value = true },
+		{ .aliases = trace_aliases, .takes_value = true },
+		{ .aliases = heatmap_aliases, .takes_value = true },
+		{ .aliases = record_aliases, .takes_value = true },
+		{ .aliases = replay_aliases, .takes_value = true },
+		{ .aliases = replay_speed_aliases, .takes_value = true },
+		{ .aliases = seed_aliases, .takes_value = true },
+		{ .aliases = infinite_aliases, .takes_value = false },
+		{ .aliases = map_aliases, .takes_value = true },
+		{ .aliases = save_map_aliases, .takes_value = true }
+	};
+	size_t option_count = 14;
+
+	struct OptionMap *option_map = option_map_create(option_arr, option_count);
+	struct OptionMapError error = option_map_set_options(option_map, argc, argv);
+
+	if (error.error_code != OM_NO_ERROR) {
+		option_map_print_error_message(stderr, "raycast: ", error);
+
+		exit(EXIT_FAILURE);
 	}
-	
-	if (angle >= (2 * PI))
-	{
-		int wraps = (int) (angle / (2 * PI));
-		
-		angle -= wraps * (2 * PI);
+
+	struct Options options = {
+		.width = 64, .height = 48, .target_fps = 60, .on_demand = false, .show_stats = false, .stats_csv_path = NULL,
+		.trace_path = NULL, .heatmap_path = NULL, .record_path = NULL, .replay_path = NULL, .replay_max_speed = false, .infinite = false,
+		.map_path = NULL, .save_map_path = NULL, .seed_given = false, .seed = 0
+	};
+
+	if (option_map_is_option_given(option_map, "--size")) {
+		char *size = option_map_get_option_value(option_map, "--size");
+		sscanf(size, "%hux%hu", &options.width, &options.height);
 	}
-	
-	return angle;
-}
 
-static int32_t min_int32(int32_t a, int32_t b)
-{
-	return (a < b) ? a : b;
-}
+	if (option_map_is_option_given(option_map, "--fps")) {
+		char *fps = option_map_get_option_value(option_map, "--fps");
+		sscanf(fps, "%lf", &options.target_fps); // 0 = uncapped
+	}
 
-static int32_t move_player(volatile struct Player *p_player, double dx, double dy, struct REMap *map)
-{
-	bool can_move_x = true;
-	bool can_move_y = true;
+	options.on_demand = option_map_is_option_given(option_map, "--on-demand");
+	options.show_stats = option_map_is_option_given(option_map, "--stats");
+	options.infinite = option_map_is_option_given(option_map, "--infinite");
 
-	double x_new = p_player->x + dx;
-	double y_new = p_player->y + dy;
+	options.stats_csv_path = option_map_copy_option_value(option_map, "--stats-csv");
+	options.trace_path = option_map_copy_option_value(option_map, "--trace");
+	options.heatmap_path = option_map_copy_option_value(option_map, "--heatmap");
+	options.record_path = option_map_copy_option_value(option_map, "--record");
+	options.replay_path = option_map_copy_option_value(option_map, "--replay");
+	options.map_path = option_map_copy_option_value(option_map, "--map");
+	options.save_map_path = option_map_copy_option_value(option_map, "--save-map");
 
-	int64_t cell_x = (int64_t) p_player->x; // no floor--should never be negative
-	int64_t cell_y = (int64_t) p_player->y; // ^^^
-	int64_t cell_x_new = (int64_t) floor(x_new);
-	int64_t cell_y_new = (int64_t) floor(y_new);
+	// A recording keeps only how to generate its map, so it can neither be made on nor replayed on a map file
+	if (options.map_path != NULL && options.record_path != NULL) {
+		fprintf(stderr, "raycast: --record can't be used with --map\n");
 
-	// check x collision
-	if (cell_x != cell_x_new) {
-		if (!re_map_coords_in_bounds(map, cell_x_new, cell_y)) {
-			can_move_x = false;
-		} else {
-			struct REMapCell cell_current = re_map_get_cell(map, cell_x, cell_y);
-			struct REMapCell cell_new = re_map_get_cell(map, cell_x_new, cell_y);
-
-			enum WallMaterial passed_wall_materials[2];
-			if (cell_x_new < cell_x) {
-				passed_wall_materials[0] = cell_current.material_left;
-				passed_wall_materials[1] = cell_new.material_right;
-			} else {
-				passed_wall_materials[0] = cell_current.material_right;
-				passed_wall_materials[1] = cell_new.material_left;
-			}
+		exit(EXIT_FAILURE);
+	}
+	if (options.map_path != NULL && options.replay_path != NULL) {
+		fprintf(stderr, "raycast: --replay can't be used with --map\n");
 
-			if (passed_wall_materials[0] != WALL_NONE || passed_wall_materials[1] != WALL_NONE) {
-				can_move_x = false;
-			}
-		}
+		exit(EXIT_FAILURE);
 	}
 
-	// check y collision
-	if (cell_y != cell_y_new) {
-		if (!re_map_coords_in_bounds(map, cell_x, cell_y_new)) {
-			can_move_y = false;
-		} else {
-			struct REMapCell cell_current = re_map_get_cell(map, cell_x, cell_y);
-			struct REMapCell cell_new = re_map_get_cell(map, cell_x, cell_y_new);
-
-			enum WallMaterial passed_wall_materials[2];
-			if (cell_y_new < cell_y) {
-				passed_wall_materials[0] = cell_current.material_bottom;
-				passed_wall_materials[1] = cell_new.material_top;
-			} else {
-				passed_wall_materials[0] = cell_current.material_top;
-				passed_wall_materials[1] = cell_new.material_bottom;
-			}
+	if (option_map_is_option_given(option_map, "--replay-speed")) {
+		char *speed = option_map_get_option_value(option_map, "--replay-speed");
 
-			if (passed_wall_materials[0] != WALL_NONE || passed_wall_materials[1] != WALL_NONE) {
-				can_move_y = false;
-			}
+		if (strcmp(speed, "max") == 0) {
+			options.replay_max_speed = true;
+		} else if (strcmp(speed, "original") != 0) {
+			fprintf(stderr, "raycast: --replay-speed must be 'original' or 'max'\n");
+
+			exit(EXIT_FAILURE);
 		}
 	}
 
-	// special case when crossing x and y at the same time
-	// (prevents walking through convex corners)
-	if (cell_x != cell_x_new && cell_y != cell_y_new && can_move_x && can_move_y) {
-		struct REMapCell cell_pass_x = re_map_get_cell(map, cell_x_new, cell_y);
-		struct REMapCell cell_pass_y = re_map_get_cell(map, cell_x, cell_y_new);
-		struct REMapCell cell_new = re_map_get_cell(map, cell_x_new, cell_y_new);
-
-		enum WallMaterial passed_wall_materials[4];
-		if (cell_x_new < cell_x) {
-			passed_wall_materials[0] = cell_pass_x.material_left;
-			passed_wall_materials[1] = cell_new.material_right;
-		} else {
-			passed_wall_materials[0] = cell_pass_x.material_right;
-			passed_wall_materials[1] = cell_new.material_left;
-		}
+	if (option_map_is_option_given(option_map, "--seed")) {
+		unsigned long long seed = 0;
+		options.seed_given = sscanf(option_map_get_option_value(option_map, "--seed"), "%llu", &seed) == 1;
+		options.seed = seed;
+	}
 
-		if (cell_y_new < cell_y) {
-			passed_wall_materials[2] = cell_pass_y.material_bottom;
-			passed_wall_materials[3] = cell_new.material_top;
-		} else {
-			passed_wall_materials[2] = cell_pass_y.material_top;
-			passed_wall_materials[3] = cell_new.material_bottom;
-		}
+#ifndef FRAME_STATS
+	if (options.show_stats || options.stats_csv_path != NULL) {
+		fprintf(stderr, "raycast: built without frame stats; rebuild with 'make stats'\n");
+	}
+#endif // FRAME_STATS
 
-		if (passed_wall_materials[0] != WALL_NONE || passed_wall_materials[1] != WALL_NONE
-				|| passed_wall_materials[2] != WALL_NONE || passed_wall_materials[3] != WALL_NONE) {
-			
-			if (dx > dy) {
-				can_move_y = false;
-			} else {
-				can_move_x = false;
-			}
-		}
+#ifndef RAY_STATS
+	if (options.heatmap_path != NULL) {
+		fprintf(stderr, "raycast: built without ray stats; rebuild with 'make ray-stats'\n");
 	}
+#endif // RAY_STATS
+
+	option_map_destroy(option_map);
+
+	return options;
+}
+
+static struct Pose player_get_pose(struct Player *p_player)
+{
+	return (struct Pose) { .x = p_player->x, .y = p_player->y, .rotation = p_player->rotation };
+}
+
+static struct PoseState simulation_get_pose_state(struct Simulation *simulation)
+{
+	return (struct PoseState) {
+		.previous = player_get_pose(&simulation->previous_player),
+		.current = player_get_pose(&simulation->player),
+		.tick_time_ns = frame_pacer_now_ns(),
+		.tick_count = simulation->tick_count
+	};
+}
+
+/* Renders one tick behind the simulation, blending from the previous tick toward the current one */
+static struct Pose pose_state_interpolate(struct PoseState state, uint64_t now_ns, double tick_rate)
+{
+	double tick_ns = 1e9 / tick_rate;
 
-	if (can_move_x) {
-		p_player->x += dx;
+	double alpha = (now_ns > state.tick_time_ns) ? (now_ns - state.tick_time_ns) / tick_ns : 0;
+	if (alpha > 1) {
+		alpha = 1;
 	}
-	if (can_move_y) {
-		p_player->y += dy;
+
+	return pose_interpolate(state.previous, state.current, alpha);
+}
+
+static bool pose_equals(struct Pose a, struct Pose b)
+{
+	return a.x == b.x && a.y == b.y && a.rotation.as_uint == b.rotation.as_uint;
+}
+
+static void handle_sigwinch(int signal_number)
+{
+	(void) signal_number;
+
+	terminal_resized = 1;
+	if (p_resize_signal != NULL) {
+		event_signal_notify(p_resize_signal);
 	}
+}
+
+static void handle_sigint(int signal_number)
+{
+	(void) signal_number;
 
-	return can_move_x * 2 + can_move_y;
+	replay_interrupted = 1;
 }
 
+/* Producer: forwards raw key presses to the simulation thread without touching player state */
 void *input_loop_func(void *vp_data)
 {
 	struct CrossThreadData *p_data = (struct CrossThreadData *) vp_data;
-	volatile struct Player *p_player = p_data->p_player;
+	trace_set_thread_name("input");
 
-	while (!p_data->quit) {
-		const double PLAYER_BASE_SPEED = 0.125;
-		const double PLAYER_TURN_SPEED = PI / 32;
+	while (!atomic_load(&p_data->quit)) {
+		int input = getchar();
+		TRACE_INSTANT("key");
 
-		double move_x, move_y;
-
-		char input = getchar();
-		double speed = islower(input) ? PLAYER_BASE_SPEED : PLAYER_BASE_SPEED * 2;
-		switch (tolower(input)) {
-		case CTRL_C:
-			p_data->quit = true;
-			break;
-		case 'w':
-			angle_to_vector(p_player->rotation, speed, &move_x, &move_y);
-			move_player(p_player, move_x, move_y, p_data->map);
-			break;
-		case 's':
-			angle_to_vector(p_player->rotation + PI, speed, &move_x, &move_y);
-			move_player(p_player, move_x, move_y, p_data->map);
-			break;
-		case 'a':
-			angle_to_vector(p_player->rotation + PI / 2, speed, &move_x, &move_y);
-			move_player(p_player, move_x, move_y, p_data->map);
-			break;
-		case 'd':
-			angle_to_vector(p_player->rotation - PI / 2, speed, &move_x, &move_y);
-			move_player(p_player, move_x, move_y, p_data->map);
-			break;
-		case 'j':
-			p_player->rotation += PLAYER_TURN_SPEED;
-			break;
-		case 'l':
-			p_player->rotation -= PLAYER_TURN_SPEED;
-			break;
-		default:
+		if (input == CTRL_C || input == EOF) {
+			atomic_store(&p_data->quit, true);
+			event_signal_notify(p_data->simulation_signal);
+			event_signal_notify(p_data->render_signal);
 			break;
 		}
+
+		struct InputEvent event = { .time_ns = frame_pacer_now_ns(), .key = (char) input };
+		input_queue_push(p_data->input_queue, event); // drops the key if the simulation has fallen far behind
+		event_signal_notify(p_data->simulation_signal);
 	}
 
 	return NULL;
 }
 
+/* Consumer: applies queued input at fixed ticks and publishes the last two poses for the render loop */
+void *simulation_loop_func(void *vp_data)
+{
+	struct CrossThreadData *p_data = (struct CrossThreadData *) vp_data;
+	struct Simulation *simulation = p_data->simulation;
+	struct FramePacer *tick_pacer = frame_pacer_create(SIMULATION_TICK_RATE);
+	trace_set_thread_name("simulation");
+
+	while (!atomic_load(&p_data->quit)) {
+		bool had_input = false;
+
+		struct InputEvent event;
+		while (input_queue_pop(p_data->input_queue, &event)) {
+			if (p_data->input_record != NULL) {
+				input_record_add(p_data->input_record, simulation->tick_count, event.time_ns - p_data->start_ns,
+						event.key);
+			}
+			simulation_apply_input(simulation, event.key);
+			had_input = true;
+		}
+
+		// Nothing can change until the next key press, so stop ticking until one arrives
+		if (!had_input && simulation_is_at_rest(simulation)) {
+			TRACE_BEGIN("idle");
+			event_signal_wait(p_data->simulation_signal, EVENT_SIGNAL_WAIT_FOREVER);
+			TRACE_END("idle");
+			frame_pacer_resync(tick_pacer);
+			continue;
+		}
+
+		// Catch up on ticks the pacer skipped so simulated time keeps pace with wall time
+		TRACE_BEGIN("pace");
+		uint32_t ticks = 1 + frame_pacer_wait(tick_pacer);
+		TRACE_END("pace");
+
+		TRACE_BEGIN("tick");
+		for (uint32_t tick = 0; tick < ticks; tick++) {
+			simulation_step(simulation);
+		}
+
+		struct PoseState pose_state = simulation_get_pose_state(simulation);
+		pose_snapshot_publish(p_data->pose_snapshot, pose_state);
+		TRACE_END("tick");
+
+		if (!pose_equals(pose_state.previous, pose_state.current)) {
+			event_signal_notify(p_data->render_signal);
+		}
+	}
+
+	frame_pacer_destroy(tick_pacer);
+
+	return NULL;
+}
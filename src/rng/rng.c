@@ -0,0 +1,11 @@
+#include "rng.h"
+
+void rng_init(struct Rng *rng, uint64_t seed, uint64_t stream)
+{
+	rng->state = 0;
+	rng->increment = (stream << 1) | 1;
+
+	rng_next(rng);
+	rng->state += seed;
+	rng_next(rng);
+}
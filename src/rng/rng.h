@@ -0,0 +1,34 @@
+#ifndef rng_h
+#define rng_h
+
+#include <stdint.h>
+
+/*
+ * PCG32 (XSH RR): 64-bit state, 32-bit output. Generators with the same seed but different streams give
+ * independent sequences, so parallel workers can each take a stream.
+ */
+struct Rng {
+	uint64_t state;
+	uint64_t increment; // always odd; selects the stream
+};
+
+void rng_init(struct Rng *rng, uint64_t seed, uint64_t stream);
+
+static inline uint32_t rng_next(struct Rng *rng)
+{
+	uint64_t state = rng->state;
+	rng->state = state * 6364136223846793005ULL + rng->increment;
+
+	uint32_t xorshifted = (uint32_t) (((state >> 18) ^ state) >> 27);
+	uint32_t rotation = (uint32_t) (state >> 59);
+
+	return (xorshifted >> rotation) | (xorshifted << ((-rotation) & 31));
+}
+
+/* In [0, bound), by multiply and shift rather than modulo; the bias is below bound / 2^32 */
+static inline uint32_t rng_below(struct Rng *rng, uint32_t bound)
+{
+	return (uint32_t) (((uint64_t) rng_next(rng) * bound) >> 32);
+}
+
+#endif // rng_h
@@ -0,0 +1,329 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../frame-stats/frame-stats.h"
+#include "../maze-gen/maze-gen.h"
+#include "../mem-utils/mem-macros.h"
+#include "../rng/rng.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif
+
+#include "scene.h"
+
+#define NO_GAP RE_CHUNK_SIZE
+
+#define MAZE_TAG_START 1u
+#define MAZE_TAG_FINISH 2u
+
+static struct Maze *create_tagged_maze(uint32_t width, uint32_t height, uint64_t seed);
+static struct REMapCell get_maze_cell_materials(struct MazeCell maze_cell);
+static void release_maze(void *context);
+static bool is_wall_bit_set(const uint64_t *walls, uint32_t col);
+static void generate_world_chunk(void *context, uint64_t seed, uint32_t chunk_x, uint32_t chunk_y,
+		struct REMapCell *cells);
+static void draw_border_gaps(struct Rng *rng, uint64_t seed, uint32_t chunk_x, uint32_t chunk_y, uint32_t *p_top_gap,
+		uint32_t *p_right_gap);
+static int32_t min_int32(int32_t a, int32_t b);
+
+void scene_init_map(struct REMap *map, uint64_t seed)
+{
+	struct Maze *maze = create_tagged_maze(map->width, map->height, seed);
+
+	for (uint32_t row = 0; row < maze->height; row++) {
+		for (uint32_t col = 0; col < maze->width; col++) {
+			re_map_set_cell(map, col, (map->height - 1) - row, get_maze_cell_materials(*maze_get_cell(maze, col, row)));
+		}
+	}
+
+	maze_destroy(maze);
+}
+
+/*
+ * The same maze as scene_init_map, but the map reads the maze's cells in place, a byte each, through a table of what
+ * each byte looks like. Maze row 0 is the top of the map, hence the negative stride.
+ */
+struct REMap *scene_create_maze_map(uint32_t width, uint32_t height, uint64_t seed)
+{
+	struct Maze *maze = create_tagged_maze(width, height, seed);
+
+	struct REMaskSource source = {
+		.masks = (const uint8_t *) maze_get_cell(maze, 0, height - 1),
+		.row_stride = -(ptrdiff_t) width,
+		.release = release_maze,
+		.context = maze
+	};
+	for (uint32_t mask = 0; mask < RE_MASK_TABLE_SIZE; mask++) {
+		uint8_t byte = (uint8_t) mask;
+		struct MazeCell maze_cell;
+		memcpy(&maze_cell, &byte, sizeof maze_cell);
+
+		source.cell_table[mask] = get_maze_cell_materials(maze_cell);
+	}
+
+	return re_map_create_masked(width, height, &source);
+}
+
+/* An effectively unbounded maze, generated a chunk at a time around wherever it is looked at */
+struct REMap *scene_create_world(uint64_t seed, size_t memory_budget)
+{
+	struct REChunkSource source = { .generate = generate_world_chunk, .context = NULL, .seed = seed };
+
+	return re_map_create_chunked(SCENE_WORLD_SIZE, SCENE_WORLD_SIZE, source, memory_budget);
+}
+
+/*
+ * A perfect maze of any height, written to a map file a row at a time as Eller's algorithm makes it, so neither the
+ * maze nor the map is ever held whole: memory stays a few rows of width. Maze row r is map row r, with the start
+ * and finish marked as in scene_init_map.
+ */
+bool scene_save_streamed_maze(const char *path, uint32_t width, uint32_t height, uint64_t seed)
+{
+	if (width == 0 || height == 0) {
+		return false;
+	}
+
+	struct REMapWriter *writer = re_map_writer_open(path, width, height);
+	if (writer == NULL) {
+		return false;
+	}
+
+	struct MazeRowStream *stream = maze_row_stream_create(width, seed);
+	uint64_t *right_walls = ALLOC_ARR(right_walls, stream->row_words);
+	uint64_t *bottom_walls = ALLOC_ARR(bottom_walls, stream->row_words);
+	uint64_t *above_walls = ALLOC_ARR(above_walls, stream->row_words); // the previous row's bottom walls
+	struct REMapCell *cells = ALLOC_ARR(cells, width);
+
+	for (uint64_t word = 0; word < stream->row_words; word++) {
+		above_walls[word] = ~0ull;
+	}
+
+	bool written = true;
+	for (uint32_t row = 0; row < height && written; row++) {
+		maze_row_stream_next(stream, right_walls, bottom_walls, row == height - 1);
+
+		for (uint32_t col = 0; col < width; col++) {
+			struct REMapCell cell = RE_MAP_CELL_SOLID(WALL_NONE);
+			cell.material_top = is_wall_bit_set(bottom_walls, col) ? WALL_BRIGHT_BLUE : WALL_NONE;
+			cell.material_right = is_wall_bit_set(right_walls, col) ? WALL_BLUE : WALL_NONE;
+			cell.material_bottom = is_wall_bit_set(above_walls, col) ? WALL_BRIGHT_BLUE : WALL_NONE;
+			cell.material_left = (col == 0 || is_wall_bit_set(right_walls, col - 1)) ? WALL_BLUE : WALL_NONE;
+
+			cells[col] = cell;
+		}
+		if (row == height - 1) {
+			cells[0].material_left = WALL_RED;
+		}
+		if (row == 0) {
+			cells[width - 1].material_right = WALL_GREEN;
+		}
+
+		written = re_map_writer_write_row(writer, cells);
+
+		uint64_t *swap_walls = above_walls;
+		above_walls = bottom_walls;
+		bottom_walls = swap_walls;
+	}
+
+	free(cells);
+	free(above_walls);
+	free(bottom_walls);
+	free(right_walls);
+	maze_row_stream_destroy(stream);
+
+	return re_map_writer_close(writer) && written;
+}
+
+void scene_draw_frame(struct REMap *map, struct SCGPixelBuffer *pixel_buffer, double origin_x, double origin_y,
+		struct BinaryAngle forward_angle)
+{
+	int32_t screen_width = stg_pixel_buffer_get_width(pixel_buffer);
+	int32_t screen_height = stg_pixel_buffer_get_height(pixel_buffer);
+
+	int32_t scaler_dimension = min_int32(screen_width, screen_height);
+
+	double lengths[screen_width];
+	enum WallMaterial materials[screen_width];
+
+	// Calculate values
+	FRAME_STAGE_BEGIN(FRAME_STAGE_CAST);
+	for (int32_t line = 0; line < screen_width; line++)
+	{
+		struct BinaryAngle rel_angle = scene_column_angle(line, screen_width, screen_height);
+
+		enum WallMaterial collided_material;
+		double forward_distance = re_cast_ray(map, origin_x, origin_y, forward_angle, rel_angle, WALL_NONE, WALL_OUT_OF_BOUNDS, &collided_material);
+
+		double length = scaler_dimension / forward_distance;
+
+		lengths[line] = length;
+		materials[line] = collided_material;
+	}
+	FRAME_STAGE_END(FRAME_STAGE_CAST);
+
+	// Draw
+	FRAME_STAGE_BEGIN(FRAME_STAGE_RASTER);
+	stg_pixel_buffer_fill(pixel_buffer, (enum SCGColorCode) WALL_NONE);
+	for (int32_t line = 0; line < screen_width; line++)
+	{
+		int32_t length = (int32_t) round(lengths[line]);
+		int32_t start = round((screen_height - length) / 2);
+		int32_t end = round((screen_height + length) / 2);
+
+		if (start < 0) {
+			start = 0;
+		}
+		if (end > screen_height) {
+			end = screen_height;
+		}
+
+		if (start < end) {
+			stg_pixel_buffer_fill_column(pixel_buffer, line, start, end, (enum SCGColorCode) materials[line]);
+		}
+	}
+	FRAME_STAGE_END(FRAME_STAGE_RASTER);
+}
+
+/* Angle of a screen column from the view direction; columns right of center turn clockwise */
+struct BinaryAngle scene_column_angle(int32_t line, int32_t screen_width, int32_t screen_height)
+{
+	int32_t line_center_offset = line - screen_width / 2;
+	struct Fixed64 slope = fixed64_divide(fixed64_from_int(line_center_offset),
+			fixed64_from_int(min_int32(screen_width, screen_height)));
+
+	return binary_angle_negate(binary_angle_atan(slope));
+}
+
+/* The start and finish cells are tagged so their walls can be told apart from the rest */
+struct Maze *create_tagged_maze(uint32_t width, uint32_t height, uint64_t seed)
+{
+	srand(seed);
+	struct Maze *maze = maze_create(width, height);
+	maze_generate(maze);
+
+	maze_get_cell(maze, 0, 0)->tag |= MAZE_TAG_START;
+	maze_get_cell(maze, width - 1, height - 1)->tag |= MAZE_TAG_FINISH;
+
+	return maze;
+}
+
+struct REMapCell get_maze_cell_materials(struct MazeCell maze_cell)
+{
+	struct REMapCell cell = RE_MAP_CELL_SOLID(WALL_NONE);
+
+	if (maze_cell.walls & (1u << MAZE_WALL_TOP)) {
+		cell.material_top = WALL_BRIGHT_BLUE;
+	}
+	if (maze_cell.walls & (1u << MAZE_WALL_RIGHT)) {
+		cell.material_right = WALL_BLUE;
+	}
+	if (maze_cell.walls & (1u << MAZE_WALL_BOTTOM)) {
+		cell.material_bottom = WALL_BRIGHT_BLUE;
+	}
+	if (maze_cell.walls & (1u << MAZE_WALL_LEFT)) {
+		cell.material_left = WALL_BLUE;
+	}
+
+	if (maze_cell.tag & MAZE_TAG_START) {
+		cell.material_left = WALL_RED;
+	}
+	if (maze_cell.tag & MAZE_TAG_FINISH) {
+		cell.material_right = WALL_GREEN;
+	}
+
+	return cell;
+}
+
+void release_maze(void *context)
+{
+	maze_destroy((struct Maze *) context);
+}
+
+bool is_wall_bit_set(const uint64_t *walls, uint32_t col)
+{
+	return (walls[col / 64] >> (col % 64)) & 1;
+}
+
+/*
+ * Each world chunk is a perfect maze with one gap in each border to its neighbors. A chunk owns the gaps in its top
+ * and right borders and draws them first from its own stream, so neighbors find them by repeating the draws.
+ */
+void generate_world_chunk(void *context, uint64_t seed, uint32_t chunk_x, uint32_t chunk_y, struct REMapCell *cells)
+{
+	(void) context;
+	const uint32_t LAST_CHUNK = SCENE_WORLD_SIZE / RE_CHUNK_SIZE - 1;
+
+	struct Rng rng;
+	uint32_t top_gap, right_gap, bottom_gap, left_gap, unused_gap;
+
+	if (chunk_y > 0) {
+		draw_border_gaps(&rng, seed, chunk_x, chunk_y - 1, &bottom_gap, &unused_gap);
+	} else {
+		bottom_gap = NO_GAP;
+	}
+	if (chunk_x > 0) {
+		draw_border_gaps(&rng, seed, chunk_x - 1, chunk_y, &unused_gap, &left_gap);
+	} else {
+		left_gap = NO_GAP;
+	}
+	draw_border_gaps(&rng, seed, chunk_x, chunk_y, &top_gap, &right_gap);
+	if (chunk_y == LAST_CHUNK) {
+		top_gap = NO_GAP;
+	}
+	if (chunk_x == LAST_CHUNK) {
+		right_gap = NO_GAP;
+	}
+
+	struct PackedMaze *maze = maze_packed_create(RE_CHUNK_SIZE, RE_CHUNK_SIZE);
+	maze_packed_generate(maze, &rng);
+
+	for (uint32_t local_y = 0; local_y < RE_CHUNK_SIZE; local_y++) {
+		uint32_t row = (RE_CHUNK_SIZE - 1) - local_y; // maze rows count down from the top
+
+		for (uint32_t col = 0; col < RE_CHUNK_SIZE; col++) {
+			bool wall_top = (local_y == RE_CHUNK_SIZE - 1)
+				? col != top_gap
+				: maze_packed_has_wall(maze, col, row, MAZE_WALL_TOP);
+			bool wall_right = (col == RE_CHUNK_SIZE - 1)
+				? local_y != right_gap
+				: maze_packed_has_wall(maze, col, row, MAZE_WALL_RIGHT);
+			bool wall_bottom = (local_y == 0)
+				? col != bottom_gap
+				: maze_packed_has_wall(maze, col, row, MAZE_WALL_BOTTOM);
+			bool wall_left = (col == 0)
+				? local_y != left_gap
+				: maze_packed_has_wall(maze, col, row, MAZE_WALL_LEFT);
+
+			struct REMapCell cell = RE_MAP_CELL_SOLID(WALL_NONE);
+			cell.material_top = wall_top ? WALL_BRIGHT_BLUE : WALL_NONE;
+			cell.material_right = wall_right ? WALL_BLUE : WALL_NONE;
+			cell.material_bottom = wall_bottom ? WALL_BRIGHT_BLUE : WALL_NONE;
+			cell.material_left = wall_left ? WALL_BLUE : WALL_NONE;
+
+			cells[local_y * RE_CHUNK_SIZE + col] = cell;
+		}
+	}
+
+	// Behind the player's starting cell, as in the flat maze
+	if (chunk_x == 0 && chunk_y == LAST_CHUNK) {
+		cells[(RE_CHUNK_SIZE - 1) * RE_CHUNK_SIZE].material_left = WALL_RED;
+	}
+
+	maze_packed_destroy(maze);
+}
+
+/* Leaves rng ready to carve the chunk's maze */
+void draw_border_gaps(struct Rng *rng, uint64_t seed, uint32_t chunk_x, uint32_t chunk_y, uint32_t *p_top_gap,
+		uint32_t *p_right_gap)
+{
+	rng_init(rng, seed, ((uint64_t) chunk_y << 32) | chunk_x);
+	*p_top_gap = rng_below(rng, RE_CHUNK_SIZE);
+	*p_right_gap = rng_below(rng, RE_CHUNK_SIZE);
+}
+
+int32_t min_int32(int32_t a, int32_t b)
+{
+	return (a < b) ? a : b;
+}
@@ -0,0 +1,30 @@
+#ifndef scene_h
+#define scene_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../raycast-engine/raycast-engine.h"
+#include "../simptg/simptg.h"
+
+enum WallMaterial {
+	WALL_OUT_OF_BOUNDS = SCG_COLOR_BRIGHT_BLACK,
+	WALL_NONE = SCG_COLOR_BLACK,
+	WALL_BLUE = SCG_COLOR_BLUE,
+	WALL_BRIGHT_BLUE = SCG_COLOR_BRIGHT_BLUE,
+	WALL_RED = SCG_COLOR_RED,
+	WALL_GREEN = SCG_COLOR_GREEN
+};
+
+#define SCENE_WORLD_SIZE (1u << 30) // cells along each side of the chunked world; walking across takes years
+
+void scene_init_map(struct REMap *map, uint64_t seed);
+struct REMap *scene_create_maze_map(uint32_t width, uint32_t height, uint64_t seed);
+struct REMap *scene_create_world(uint64_t seed, size_t memory_budget);
+bool scene_save_streamed_maze(const char *path, uint32_t width, uint32_t height, uint64_t seed);
+void scene_draw_frame(struct REMap *map, struct SCGPixelBuffer *pixel_buffer, double origin_x, double origin_y,
+		struct BinaryAngle forward_angle);
+
+struct BinaryAngle scene_column_angle(int32_t line, int32_t screen_width, int32_t screen_height);
+
+#endif // scene_h
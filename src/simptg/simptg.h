@@ -1,6 +1,8 @@
 #ifndef simptg_h
 #define simptg_h
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 enum SCGColorCode {
@@ -25,16 +27,26 @@ enum SCGColorCode {
 	SCG_COLOR_BRIGHT_WHITE   = 58
 };
 
+/*** SCGOutput ***/
+
+/* Encoded escape sequences for one frame, written to stdout in a single call */
+struct SCGOutput {
+	char *bytes;
+	size_t length;
+	size_t size;
+};
+
 /*** SCGBuffer ***/
 
+/* Cells are stored as separate ch, fg_color and bg_color planes of width * height bytes each */
 struct SCGBuffer {
 	uint16_t width;
 	uint16_t height;
-	struct SCGCell {
-		char ch;
-		enum SCGColorCode fg_color : 8;
-		enum SCGColorCode bg_color : 8;
-	} cells[];
+	char *ch;
+	int8_t *fg_color;
+	int8_t *bg_color;
+	struct SCGOutput output;
+	uint8_t planes[];
 };
 
 struct SCGBuffer *stg_buffer_create(uint16_t width, uint16_t height);
@@ -51,26 +63,54 @@ void stg_buffer_fill_ch(struct SCGBuffer *buffer, char ch);
 void stg_buffer_fill_fg_color(struct SCGBuffer *buffer, enum SCGColorCode fg_color);
 void stg_buffer_fill_bg_color(struct SCGBuffer *buffer, enum SCGColorCode bg_color);
 
+void stg_buffer_copy(struct SCGBuffer *dest, struct SCGBuffer *src);
+bool stg_buffer_row_equals(struct SCGBuffer *a, struct SCGBuffer *b, uint16_t row);
+
 void stg_buffer_make_space(struct SCGBuffer *buffer);
 void stg_buffer_remove_space(struct SCGBuffer *buffer);
 void stg_buffer_print(struct SCGBuffer *buffer);
+void stg_buffer_print_changes(struct SCGBuffer *buffer, struct SCGBuffer *previous);
 
 int stg_input_adjust();
 int stg_input_restore();
 
 /*** SCGPixelBuffer ***/
 
-struct SCGBuffer *stg_pixel_buffer_create(uint16_t width, uint16_t height); void stg_pixel_buffer_destroy(struct SCGBuffer *pixel_buffer);
+/* One color byte per logical pixel; each pixel is expanded into two terminal cells only when encoded */
+struct SCGPixelBuffer {
+	uint16_t width;
+	uint16_t height;
+	struct SCGOutput output;
+	char *overlay; // width * 2 chars drawn over the top row, or NULL
+	bool overlay_changed; // the top row must be encoded even if its pixels are unchanged
+	int8_t pixels[];
+};
 
-void stg_pixel_buffer_set(struct SCGBuffer *pixel_buffer, uint16_t col, uint16_t row, enum SCGColorCode color);
-enum SCGColorCode stg_pixel_buffer_get(struct SCGBuffer *pixel_buffer, uint16_t col, uint16_t row);
+struct SCGPixelBuffer *stg_pixel_buffer_create(uint16_t width, uint16_t height);
+void stg_pixel_buffer_destroy(struct SCGPixelBuffer *pixel_buffer);
 
-void stg_pixel_buffer_fill(struct SCGBuffer *pixel_buffer, enum SCGColorCode color);
+uint16_t stg_pixel_buffer_get_width(struct SCGPixelBuffer *pixel_buffer);
+uint16_t stg_pixel_buffer_get_height(struct SCGPixelBuffer *pixel_buffer);
 
-void stg_pixel_buffer_make_space(struct SCGBuffer *pixel_buffer);
-void stg_pixel_buffer_remove_space(struct SCGBuffer *pixel_buffer);
+void stg_pixel_buffer_set(struct SCGPixelBuffer *pixel_buffer, uint16_t col, uint16_t row, enum SCGColorCode color);
+enum SCGColorCode stg_pixel_buffer_get(struct SCGPixelBuffer *pixel_buffer, uint16_t col, uint16_t row);
 
-void stg_pixel_buffer_print(struct SCGBuffer *pixel_buffer);
+void stg_pixel_buffer_fill(struct SCGPixelBuffer *pixel_buffer, enum SCGColorCode color);
+void stg_pixel_buffer_fill_column(struct SCGPixelBuffer *pixel_buffer, uint16_t col, uint16_t start_row, uint16_t end_row,
+		enum SCGColorCode color);
 
-#endif // simptg_h
+void stg_pixel_buffer_set_overlay(struct SCGPixelBuffer *pixel_buffer, const char *text);
+
+void stg_pixel_buffer_copy(struct SCGPixelBuffer *dest, struct SCGPixelBuffer *src);
+bool stg_pixel_buffer_row_equals(struct SCGPixelBuffer *a, struct SCGPixelBuffer *b, uint16_t row);
+
+void stg_pixel_buffer_make_space(struct SCGPixelBuffer *pixel_buffer);
+void stg_pixel_buffer_remove_space(struct SCGPixelBuffer *pixel_buffer);
 
+void stg_pixel_buffer_print(struct SCGPixelBuffer *pixel_buffer);
+void stg_pixel_buffer_print_changes(struct SCGPixelBuffer *pixel_buffer, struct SCGPixelBuffer *previous);
+
+size_t stg_pixel_buffer_encode_changes(struct SCGPixelBuffer *pixel_buffer, struct SCGPixelBuffer *previous);
+void stg_pixel_buffer_write(struct SCGPixelBuffer *pixel_buffer);
+
+#endif // simptg_h
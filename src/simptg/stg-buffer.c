@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "../mem-utils/mem-macros.h"
 
@@ -9,88 +10,94 @@
 #endif
 
 #include "simptg.h"
+#include "stg-output.h"
 
-static void stg_print_cell(struct SCGCell cell);
-static uint16_t stg_color_code_to_ansi_fg(enum SCGColorCode color_code);
-static uint16_t stg_color_code_to_ansi_bg(enum SCGColorCode color_code);
+static void stg_buffer_encode(struct SCGBuffer *buffer, struct SCGBuffer *previous);
+static void stg_buffer_encode_row(struct SCGBuffer *buffer, uint16_t row);
 
 struct SCGBuffer *stg_buffer_create(uint16_t width, uint16_t height)
 {
-	size_t cells_size = width * height;
-	struct SCGBuffer *buffer = ALLOC_FLEX_STRUCT(buffer, cells, cells_size);
+	size_t cells_size = (size_t) width * height;
+	struct SCGBuffer *buffer = ALLOC_FLEX_STRUCT(buffer, planes, cells_size * 3);
 
 	buffer->width = width;
 	buffer->height = height;
 
+	buffer->ch = (char *) buffer->planes;
+	buffer->fg_color = (int8_t *) buffer->planes + cells_size;
+	buffer->bg_color = (int8_t *) buffer->planes + cells_size * 2;
+
+	stg_output_init(&buffer->output, stg_output_estimate_size(cells_size, height));
+
 	return buffer;
 }
 
 void stg_buffer_destroy(struct SCGBuffer *buffer)
 {
+	stg_output_destroy(&buffer->output);
 	free(buffer);
 }
 
 inline void stg_buffer_set_ch(struct SCGBuffer *buffer, uint16_t col, uint16_t row, char ch)
 {
-	buffer->cells[row * buffer->width + col].ch = ch;
+	buffer->ch[row * buffer->width + col] = ch;
 }
 
 inline char stg_buffer_get_ch(struct SCGBuffer *buffer, uint16_t col, uint16_t row)
 {
-	return buffer->cells[row * buffer->width + col].ch;
+	return buffer->ch[row * buffer->width + col];
 }
 
 inline void stg_buffer_set_fg_color(struct SCGBuffer *buffer, uint16_t col, uint16_t row, enum SCGColorCode fg_color)
 {
-	buffer->cells[row * buffer->width + col].fg_color = fg_color;
+	buffer->fg_color[row * buffer->width + col] = fg_color;
 }
 
 inline enum SCGColorCode stg_buffer_get_fg_color(struct SCGBuffer *buffer, uint16_t col, uint16_t row)
 {
-	return buffer->cells[row * buffer->width + col].fg_color;
+	return buffer->fg_color[row * buffer->width + col];
 }
 
 inline void stg_buffer_set_bg_color(struct SCGBuffer *buffer, uint16_t col, uint16_t row, enum SCGColorCode bg_color)
 {
-	buffer->cells[row * buffer->width + col].bg_color = bg_color;
+	buffer->bg_color[row * buffer->width + col] = bg_color;
 }
 
 inline enum SCGColorCode stg_buffer_get_bg_color(struct SCGBuffer *buffer, uint16_t col, uint16_t row)
 {
-	return buffer->cells[row * buffer->width + col].bg_color;
+	return buffer->bg_color[row * buffer->width + col];
 }
 
 void stg_buffer_fill_ch(struct SCGBuffer *buffer, char ch)
 {
-	uint16_t width = buffer->width;
-	uint16_t height = buffer->height;
-	for (uint16_t row = 0; row < height; row++) {
-		for (uint16_t col = 0; col < width; col++) {
-			stg_buffer_set_ch(buffer, col, row, ch);
-		}
-	}
+	memset(buffer->ch, ch, (size_t) buffer->width * buffer->height);
 }
 
 void stg_buffer_fill_fg_color(struct SCGBuffer *buffer, enum SCGColorCode fg_color)
 {
-	uint16_t width = buffer->width;
-	uint16_t height = buffer->height;
-	for (uint16_t row = 0; row < height; row++) {
-		for (uint16_t col = 0; col < width; col++) {
-			stg_buffer_set_fg_color(buffer, col, row, fg_color);
-		}
-	}
+	memset(buffer->fg_color, (int8_t) fg_color, (size_t) buffer->width * buffer->height);
 }
 
 void stg_buffer_fill_bg_color(struct SCGBuffer *buffer, enum SCGColorCode bg_color)
 {
-	uint16_t width = buffer->width;
-	uint16_t height = buffer->height;
-	for (uint16_t row = 0; row < height; row++) {
-		for (uint16_t col = 0; col < width; col++) {
-			stg_buffer_set_bg_color(buffer, col, row, bg_color);
-		}
-	}
+	memset(buffer->bg_color, (int8_t) bg_color, (size_t) buffer->width * buffer->height);
+}
+
+/* NOTE: dest and src must have the same dimensions */
+void stg_buffer_copy(struct SCGBuffer *dest, struct SCGBuffer *src)
+{
+	memcpy(dest->planes, src->planes, (size_t) src->width * src->height * 3);
+}
+
+/* NOTE: a and b must have the same dimensions */
+bool stg_buffer_row_equals(struct SCGBuffer *a, struct SCGBuffer *b, uint16_t row)
+{
+	size_t offset = (size_t) row * a->width;
+	size_t width = a->width;
+
+	return memcmp(a->ch + offset, b->ch + offset, width) == 0
+		&& memcmp(a->fg_color + offset, b->fg_color + offset, width) == 0
+		&& memcmp(a->bg_color + offset, b->bg_color + offset, width) == 0;
 }
 
 void stg_buffer_make_space(struct SCGBuffer *buffer)
@@ -109,19 +116,16 @@ void stg_buffer_remove_space(struct SCGBuffer *buffer)
 
 void stg_buffer_print(struct SCGBuffer *buffer)
 {
-	uint16_t width = buffer->width;
-	uint16_t height = buffer->height;
-
-	printf("\x1b[G"); // Move to 1st column
-	printf("\x1b[%dA", height); // Move to top of buffer
-	for (uint16_t row = 0; row < height; row++) {
-		for (uint16_t col = 0; col < width; col++) {
-			stg_print_cell(buffer->cells[row * width + col]);
-		}
-		printf("\x1b[B"); // Move down 1 line
-		printf("\x1b[G"); // Move to 1st column
-	}
+	stg_buffer_encode(buffer, NULL);
+	stg_output_write(&buffer->output);
+	fflush(stdout);
+}
 
+/* Prints only the rows that differ from previous, which must hold the last printed frame */
+void stg_buffer_print_changes(struct SCGBuffer *buffer, struct SCGBuffer *previous)
+{
+	stg_buffer_encode(buffer, previous);
+	stg_output_write(&buffer->output);
 	fflush(stdout);
 }
 
@@ -135,20 +139,46 @@ int stg_input_restore()
 	return system("stty cooked echo");
 }
 
-void stg_print_cell(struct SCGCell cell)
+void stg_buffer_encode(struct SCGBuffer *buffer, struct SCGBuffer *previous)
 {
-	uint16_t ansi_fg_code = stg_color_code_to_ansi_fg(cell.fg_color);
-	uint16_t ansi_bg_code = stg_color_code_to_ansi_bg(cell.bg_color);
-	printf("\x1b[%d;%dm%c\x1b[0m", ansi_fg_code, ansi_bg_code, cell.ch); // Print char with specified fg and bg color
-}
+	struct SCGOutput *output = &buffer->output;
+	uint16_t height = buffer->height;
 
-uint16_t stg_color_code_to_ansi_fg(enum SCGColorCode color_code)
-{
-	return color_code + 39;
+	stg_output_reset(output);
+
+	stg_output_append_str(output, "\x1b[G"); // Move to 1st column
+	stg_output_append_str(output, "\x1b[");
+	stg_output_append_uint(output, height);
+	stg_output_append_str(output, "A"); // Move to top of buffer
+	for (uint16_t row = 0; row < height; row++) {
+		if (previous == NULL || !stg_buffer_row_equals(buffer, previous, row)) {
+			stg_buffer_encode_row(buffer, row);
+		}
+		stg_output_append_str(output, "\x1b[B"); // Move down 1 line
+		stg_output_append_str(output, "\x1b[G"); // Move to 1st column
+	}
 }
 
-uint16_t stg_color_code_to_ansi_bg(enum SCGColorCode color_code)
+/* Emits one color sequence per run of equally colored cells, followed by the run's chars */
+void stg_buffer_encode_row(struct SCGBuffer *buffer, uint16_t row)
 {
-	return color_code + 49;
-}
+	struct SCGOutput *output = &buffer->output;
+	size_t width = buffer->width;
+	const char *ch = buffer->ch + (size_t) row * width;
+	const int8_t *fg_color = buffer->fg_color + (size_t) row * width;
+	const int8_t *bg_color = buffer->bg_color + (size_t) row * width;
 
+	size_t run_start = 0;
+	while (run_start < width) {
+		size_t run_end = run_start + 1;
+		while (run_end < width && fg_color[run_end] == fg_color[run_start] && bg_color[run_end] == bg_color[run_start]) {
+			run_end++;
+		}
+
+		stg_output_append_colors(output, fg_color[run_start], bg_color[run_start]);
+		stg_output_append(output, ch + run_start, run_end - run_start);
+
+		run_start = run_end;
+	}
+	stg_output_append_str(output, "\x1b[0m"); // Reset colors
+}
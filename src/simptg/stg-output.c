@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mem-utils/mem-macros.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif
+
+#include "stg-output.h"
+
+static void stg_output_reserve(struct SCGOutput *output, size_t length);
+static uint16_t stg_color_code_to_ansi_fg(enum SCGColorCode color_code);
+static uint16_t stg_color_code_to_ansi_bg(enum SCGColorCode color_code);
+
+void stg_output_init(struct SCGOutput *output, size_t size)
+{
+	output->bytes = ALLOC_STR_SIZE(size);
+	output->length = 0;
+	output->size = size;
+}
+
+void stg_output_destroy(struct SCGOutput *output)
+{
+	free(output->bytes);
+
+	output->bytes = NULL;
+	output->length = 0;
+	output->size = 0;
+}
+
+void stg_output_reset(struct SCGOutput *output)
+{
+	output->length = 0;
+}
+
+void stg_output_append(struct SCGOutput *output, const char *bytes, size_t length)
+{
+	stg_output_reserve(output, length);
+
+	memcpy(output->bytes + output->length, bytes, length);
+	output->length += length;
+}
+
+void stg_output_append_str(struct SCGOutput *output, const char *str)
+{
+	stg_output_append(output, str, strlen(str));
+}
+
+void stg_output_append_uint(struct SCGOutput *output, uint32_t value)
+{
+	char digits[10];
+	size_t digit_count = 0;
+
+	do {
+		digits[sizeof digits - 1 - digit_count] = '0' + value % 10;
+		digit_count++;
+		value /= 10;
+	} while (value > 0);
+
+	stg_output_append(output, digits + sizeof digits - digit_count, digit_count);
+}
+
+void stg_output_append_fill(struct SCGOutput *output, char ch, size_t count)
+{
+	stg_output_reserve(output, count);
+
+	memset(output->bytes + output->length, ch, count);
+	output->length += count;
+}
+
+void stg_output_append_colors(struct SCGOutput *output, enum SCGColorCode fg_color, enum SCGColorCode bg_color)
+{
+	stg_output_append_str(output, "\x1b[");
+	stg_output_append_uint(output, stg_color_code_to_ansi_fg(fg_color));
+	stg_output_append_str(output, ";");
+	stg_output_append_uint(output, stg_color_code_to_ansi_bg(bg_color));
+	stg_output_append_str(output, "m");
+}
+
+void stg_output_write(struct SCGOutput *output)
+{
+	fwrite(output->bytes, 1, output->length, stdout);
+
+	stg_output_reset(output);
+}
+
+void stg_output_reserve(struct SCGOutput *output, size_t length)
+{
+	if (output->length + length <= output->size) {
+		return;
+	}
+
+	size_t size = (output->size > 0) ? output->size * 2 : 64;
+	while (size < output->length + length) {
+		size *= 2;
+	}
+
+	output->bytes = REALLOC_ARR(output->bytes, size);
+	output->size = size;
+}
+
+uint16_t stg_color_code_to_ansi_fg(enum SCGColorCode color_code)
+{
+	return color_code + 39;
+}
+
+uint16_t stg_color_code_to_ansi_bg(enum SCGColorCode color_code)
+{
+	return color_code + 49;
+}
@@ -0,0 +1,31 @@
+#ifndef stg_output_h
+#define stg_output_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "simptg.h"
+
+#define STG_ENCODED_CELL_ESTIMATE 12 // bytes for one changed cell or pixel, colors included
+#define STG_ENCODED_ROW_OVERHEAD 16 // cursor movement and resets around each row
+
+/* Enough output for a full redraw of height rows holding cell_count cells or pixels, so a frame never grows it */
+static inline size_t stg_output_estimate_size(size_t cell_count, uint16_t height)
+{
+	return cell_count * STG_ENCODED_CELL_ESTIMATE + ((size_t) height + 1) * STG_ENCODED_ROW_OVERHEAD;
+}
+
+void stg_output_init(struct SCGOutput *output, size_t size);
+void stg_output_destroy(struct SCGOutput *output);
+
+void stg_output_reset(struct SCGOutput *output);
+
+void stg_output_append(struct SCGOutput *output, const char *bytes, size_t length);
+void stg_output_append_str(struct SCGOutput *output, const char *str);
+void stg_output_append_uint(struct SCGOutput *output, uint32_t value);
+void stg_output_append_fill(struct SCGOutput *output, char ch, size_t count);
+void stg_output_append_colors(struct SCGOutput *output, enum SCGColorCode fg_color, enum SCGColorCode bg_color);
+
+void stg_output_write(struct SCGOutput *output);
+
+#endif // stg_output_h
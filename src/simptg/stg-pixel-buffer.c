@@ -1,57 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mem-utils/mem-macros.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif
+
 #include "simptg.h"
+#include "stg-output.h"
+
+static void stg_pixel_buffer_encode_row(struct SCGPixelBuffer *buffer, uint16_t row);
+static void stg_pixel_buffer_encode_overlay_row(struct SCGPixelBuffer *buffer);
 
-struct SCGBuffer *stg_pixel_buffer_create(uint16_t width, uint16_t height)
+struct SCGPixelBuffer *stg_pixel_buffer_create(uint16_t width, uint16_t height)
 {
-	struct SCGBuffer *buffer = stg_buffer_create(width * 2, height);
+	size_t pixels_size = (size_t) width * height;
+	struct SCGPixelBuffer *buffer = ALLOC_FLEX_STRUCT(buffer, pixels, pixels_size);
 
-	stg_buffer_fill_ch(buffer, ' ');
+	buffer->width = width;
+	buffer->height = height;
+
+	stg_output_init(&buffer->output, stg_output_estimate_size(pixels_size, height));
+	buffer->overlay = NULL;
+	buffer->overlay_changed = false;
+
+	stg_pixel_buffer_fill(buffer, SCG_COLOR_DEFAULT);
 
 	return buffer;
 }
 
-void stg_pixel_buffer_destroy(struct SCGBuffer *buffer)
+void stg_pixel_buffer_destroy(struct SCGPixelBuffer *buffer)
 {
-	stg_buffer_destroy(buffer);
+	stg_output_destroy(&buffer->output);
+	free(buffer->overlay);
+	free(buffer);
 }
 
-void stg_pixel_buffer_set(struct SCGBuffer *buffer, uint16_t col, uint16_t row, enum SCGColorCode color)
+uint16_t stg_pixel_buffer_get_width(struct SCGPixelBuffer *buffer)
 {
-	stg_buffer_set_bg_color(buffer, col * 2, row, color);
-	stg_buffer_set_bg_color(buffer, col * 2 + 1, row, color);
+	return buffer->width;
 }
 
-enum SCGColorCode stg_pixel_buffer_get(struct SCGBuffer *buffer, uint16_t col, uint16_t row)
+uint16_t stg_pixel_buffer_get_height(struct SCGPixelBuffer *buffer)
 {
-	return stg_buffer_get_bg_color(buffer, col * 2, row);
+	return buffer->height;
 }
 
-void stg_pixel_buffer_fill(struct SCGBuffer *buffer, enum SCGColorCode color)
+void stg_pixel_buffer_set(struct SCGPixelBuffer *buffer, uint16_t col, uint16_t row, enum SCGColorCode color)
 {
-	stg_buffer_fill_bg_color(buffer, color);
+	buffer->pixels[row * buffer->width + col] = color;
 }
 
-void stg_pixel_buffer_make_space(struct SCGBuffer *buffer)
+enum SCGColorCode stg_pixel_buffer_get(struct SCGPixelBuffer *buffer, uint16_t col, uint16_t row)
 {
-	stg_buffer_make_space(buffer);
+	return buffer->pixels[row * buffer->width + col];
+}
+
+void stg_pixel_buffer_fill(struct SCGPixelBuffer *buffer, enum SCGColorCode color)
+{
+	memset(buffer->pixels, (int8_t) color, (size_t) buffer->width * buffer->height);
+}
+
+/* Sets rows start_row (inclusive) to end_row (exclusive) of column col */
+void stg_pixel_buffer_fill_column(struct SCGPixelBuffer *buffer, uint16_t col, uint16_t start_row, uint16_t end_row,
+		enum SCGColorCode color)
+{
+	size_t width = buffer->width;
+	int8_t *pixel = buffer->pixels + (size_t) start_row * width + col;
+
+	for (uint16_t row = start_row; row < end_row; row++) {
+		*pixel = color;
+		pixel += width;
+	}
 }
 
-void stg_pixel_buffer_remove_space(struct SCGBuffer *buffer)
+/* Draws text (truncated or space-padded to two chars per pixel) over the top row; NULL removes it */
+void stg_pixel_buffer_set_overlay(struct SCGPixelBuffer *buffer, const char *text)
 {
-	stg_buffer_remove_space(buffer);
+	size_t overlay_length = (size_t) buffer->width * 2;
+
+	if (text == NULL) {
+		buffer->overlay_changed |= (buffer->overlay != NULL);
+		free(buffer->overlay);
+		buffer->overlay = NULL;
+
+		return;
+	}
+
+	size_t text_length = strlen(text);
+	if (text_length > overlay_length) {
+		text_length = overlay_length;
+	}
+
+	if (buffer->overlay == NULL) {
+		buffer->overlay = ALLOC_STR_LENGTH(overlay_length);
+	} else if (memcmp(buffer->overlay, text, text_length) == 0
+			&& strspn(buffer->overlay + text_length, " ") == overlay_length - text_length) {
+		return;
+	}
+	buffer->overlay_changed = true;
+
+	memcpy(buffer->overlay, text, text_length);
+	memset(buffer->overlay + text_length, ' ', overlay_length - text_length);
+	buffer->overlay[overlay_length] = '\0';
+}
+
+/* NOTE: dest and src must have the same dimensions */
+void stg_pixel_buffer_copy(struct SCGPixelBuffer *dest, struct SCGPixelBuffer *src)
+{
+	memcpy(dest->pixels, src->pixels, (size_t) src->width * src->height);
+}
+
+/* NOTE: a and b must have the same dimensions */
+bool stg_pixel_buffer_row_equals(struct SCGPixelBuffer *a, struct SCGPixelBuffer *b, uint16_t row)
+{
+	size_t offset = (size_t) row * a->width;
+
+	return memcmp(a->pixels + offset, b->pixels + offset, a->width) == 0;
 }
 
-void stg_pixel_buffer_print(struct SCGBuffer *buffer)
+void stg_pixel_buffer_make_space(struct SCGPixelBuffer *buffer)
 {
-	stg_buffer_print(buffer);
+	for (uint16_t row = 0; row < buffer->height; row++) {
+		printf("\n\x1b[G"); // Add <height> lines to bottom of console
+	}
 }
 
-uint16_t stg_pixel_buffer_get_width(struct SCGBuffer *buffer)
+void stg_pixel_buffer_remove_space(struct SCGPixelBuffer *buffer)
 {
-	return buffer->width / 2;
+	printf("\x1b[%dA", buffer->height); // Move to top of buffer
+	printf("\x1b[G"); // Move to 1st column
+	printf("\x1b[J"); // Clear to bottom line
 }
 
-uint16_t stg_pixel_buffer_get_height(struct SCGBuffer *buffer)
+void stg_pixel_buffer_print(struct SCGPixelBuffer *buffer)
 {
-	return buffer->height / 2;
+	stg_pixel_buffer_encode_changes(buffer, NULL);
+	stg_pixel_buffer_write(buffer);
+	fflush(stdout);
 }
 
+/* Prints only the rows that differ from previous, which must hold the last printed frame */
+void stg_pixel_buffer_print_changes(struct SCGPixelBuffer *buffer, struct SCGPixelBuffer *previous)
+{
+	stg_pixel_buffer_encode_changes(buffer, previous);
+	stg_pixel_buffer_write(buffer);
+	fflush(stdout);
+}
+
+/*
+ * The two halves of stg_pixel_buffer_print_changes, for callers that time or inspect them separately: encoding
+ * returns the number of bytes queued, and writing hands them to stdout without flushing. A NULL previous encodes
+ * every row.
+ */
+size_t stg_pixel_buffer_encode_changes(struct SCGPixelBuffer *buffer, struct SCGPixelBuffer *previous)
+{
+	struct SCGOutput *output = &buffer->output;
+	uint16_t height = buffer->height;
+
+	stg_output_reset(output);
+
+	stg_output_append_str(output, "\x1b[G"); // Move to 1st column
+	stg_output_append_str(output, "\x1b[");
+	stg_output_append_uint(output, height);
+	stg_output_append_str(output, "A"); // Move to top of buffer
+	for (uint16_t row = 0; row < height; row++) {
+		bool overlay_row_changed = (row == 0 && buffer->overlay_changed);
+
+		if (previous == NULL || overlay_row_changed || !stg_pixel_buffer_row_equals(buffer, previous, row)) {
+			if (row == 0 && buffer->overlay != NULL) {
+				stg_pixel_buffer_encode_overlay_row(buffer);
+			} else {
+				stg_pixel_buffer_encode_row(buffer, row);
+			}
+		}
+		stg_output_append_str(output, "\x1b[B"); // Move down 1 line
+		stg_output_append_str(output, "\x1b[G"); // Move to 1st column
+	}
+	buffer->overlay_changed = false;
+
+	return output->length;
+}
+
+void stg_pixel_buffer_write(struct SCGPixelBuffer *buffer)
+{
+	stg_output_write(&buffer->output);
+}
+
+/* Each pixel becomes two space cells; one color sequence is emitted per run of equal pixels */
+void stg_pixel_buffer_encode_row(struct SCGPixelBuffer *buffer, uint16_t row)
+{
+	struct SCGOutput *output = &buffer->output;
+	size_t width = buffer->width;
+	const int8_t *pixels = buffer->pixels + (size_t) row * width;
+
+	size_t run_start = 0;
+	while (run_start < width) {
+		size_t run_end = run_start + 1;
+		while (run_end < width && pixels[run_end] == pixels[run_start]) {
+			run_end++;
+		}
+
+		stg_output_append_colors(output, SCG_COLOR_DEFAULT, pixels[run_start]);
+		stg_output_append_fill(output, ' ', (run_end - run_start) * 2);
+
+		run_start = run_end;
+	}
+	stg_output_append_str(output, "\x1b[0m"); // Reset colors
+}
+
+/* Like stg_pixel_buffer_encode_row, but the overlay text replaces the spaces */
+void stg_pixel_buffer_encode_overlay_row(struct SCGPixelBuffer *buffer)
+{
+	struct SCGOutput *output = &buffer->output;
+	size_t width = buffer->width;
+	const int8_t *pixels = buffer->pixels;
+
+	size_t run_start = 0;
+	while (run_start < width) {
+		size_t run_end = run_start + 1;
+		while (run_end < width && pixels[run_end] == pixels[run_start]) {
+			run_end++;
+		}
+
+		stg_output_append_colors(output, SCG_COLOR_BRIGHT_WHITE, pixels[run_start]);
+		stg_output_append(output, buffer->overlay + run_start * 2, (run_end - run_start) * 2);
+
+		run_start = run_end;
+	}
+	stg_output_append_str(output, "\x1b[0m"); // Reset colors
+}
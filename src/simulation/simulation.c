@@ -0,0 +1,258 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif
+
+#include "simulation.h"
+
+#define PI 3.14159265358979323846
+
+// A key press is an impulse that decays at PLAYER_DAMPING per second, so a single tap covers
+// impulse / damping units and a held key (repeating at rate r) settles at impulse * r / damping units per second
+#define PLAYER_DAMPING 10.0
+#define PLAYER_MOVE_IMPULSE (0.125 * PLAYER_DAMPING)
+#define PLAYER_TURN_IMPULSE (PI / 32 * PLAYER_DAMPING)
+#define PLAYER_MAX_SPEED 8.0
+#define PLAYER_MAX_TURN_SPEED (4 * PI)
+#define PLAYER_REST_SPEED 1e-3
+
+static void add_move_impulse(struct Player *p_player, struct BinaryAngle angle, double impulse);
+static double clamp_double(double value, double min, double max);
+static int32_t move_player(struct Player *p_player, double dx, double dy, struct REMap *map, int transparent_material);
+static void angle_to_vector(struct BinaryAngle angle, double length, double *vec_x, double *vec_y);
+
+struct Simulation *simulation_create(struct REMap *map, int transparent_material, struct Player player, double tick_rate)
+{
+	struct Simulation *simulation = malloc(sizeof *simulation);
+
+	simulation->map = map;
+	simulation->transparent_material = transparent_material;
+	simulation->tick_seconds = 1 / tick_rate;
+	simulation->damping = exp(-PLAYER_DAMPING * simulation->tick_seconds);
+	simulation->tick_count = 0;
+
+	simulation->player = player;
+	simulation->previous_player = player;
+
+	return simulation;
+}
+
+void simulation_destroy(struct Simulation *simulation)
+{
+	free(simulation);
+}
+
+/* Upper case keys move at double speed */
+void simulation_apply_input(struct Simulation *simulation, char input)
+{
+	struct Player *p_player = &simulation->player;
+	double impulse = islower(input) ? PLAYER_MOVE_IMPULSE : PLAYER_MOVE_IMPULSE * 2;
+
+	switch (tolower(input)) {
+	case 'w':
+		add_move_impulse(p_player, p_player->rotation, impulse);
+		break;
+	case 's':
+		add_move_impulse(p_player, binary_angle_add(p_player->rotation,
+					(struct BinaryAngle) { BINARY_ANGLE_HALF_TURN }), impulse);
+		break;
+	case 'a':
+		add_move_impulse(p_player, binary_angle_add(p_player->rotation,
+					(struct BinaryAngle) { BINARY_ANGLE_QUARTER_TURN }), impulse);
+		break;
+	case 'd':
+		add_move_impulse(p_player, binary_angle_subtract(p_player->rotation,
+					(struct BinaryAngle) { BINARY_ANGLE_QUARTER_TURN }), impulse);
+		break;
+	case 'j':
+		p_player->angular_velocity += PLAYER_TURN_IMPULSE;
+		break;
+	case 'l':
+		p_player->angular_velocity -= PLAYER_TURN_IMPULSE;
+		break;
+	default:
+		break;
+	}
+
+	p_player->angular_velocity = clamp_double(p_player->angular_velocity, -PLAYER_MAX_TURN_SPEED, PLAYER_MAX_TURN_SPEED);
+}
+
+void simulation_step(struct Simulation *simulation)
+{
+	struct Player *p_player = &simulation->player;
+	double dt = simulation->tick_seconds;
+
+	simulation->previous_player = *p_player;
+
+	if (p_player->velocity_x != 0 || p_player->velocity_y != 0) {
+		int32_t moved = move_player(p_player, p_player->velocity_x * dt, p_player->velocity_y * dt, simulation->map,
+				simulation->transparent_material);
+
+		if (!(moved & 2)) {
+			p_player->velocity_x = 0;
+		}
+		if (!(moved & 1)) {
+			p_player->velocity_y = 0;
+		}
+	}
+	p_player->rotation = binary_angle_add(p_player->rotation,
+			binary_angle_from_radians(p_player->angular_velocity * dt));
+
+	p_player->velocity_x *= simulation->damping;
+	p_player->velocity_y *= simulation->damping;
+	p_player->angular_velocity *= simulation->damping;
+
+	if (fabs(p_player->velocity_x) + fabs(p_player->velocity_y) < PLAYER_REST_SPEED) {
+		p_player->velocity_x = 0;
+		p_player->velocity_y = 0;
+	}
+	if (fabs(p_player->angular_velocity) < PLAYER_REST_SPEED) {
+		p_player->angular_velocity = 0;
+	}
+
+	simulation->tick_count++;
+}
+
+/* True once the player has stopped moving and turning and the last tick left the pose unchanged */
+bool simulation_is_at_rest(struct Simulation *simulation)
+{
+	struct Player *p_player = &simulation->player;
+	struct Player *p_previous = &simulation->previous_player;
+
+	return p_player->velocity_x == 0 && p_player->velocity_y == 0 && p_player->angular_velocity == 0
+		&& p_player->x == p_previous->x && p_player->y == p_previous->y && p_player->rotation.as_uint == p_previous->rotation.as_uint;
+}
+
+void add_move_impulse(struct Player *p_player, struct BinaryAngle angle, double impulse)
+{
+	double impulse_x, impulse_y;
+	angle_to_vector(angle, impulse, &impulse_x, &impulse_y);
+
+	p_player->velocity_x += impulse_x;
+	p_player->velocity_y += impulse_y;
+
+	double speed = sqrt(p_player->velocity_x * p_player->velocity_x + p_player->velocity_y * p_player->velocity_y);
+	if (speed > PLAYER_MAX_SPEED) {
+		p_player->velocity_x *= PLAYER_MAX_SPEED / speed;
+		p_player->velocity_y *= PLAYER_MAX_SPEED / speed;
+	}
+}
+
+double clamp_double(double value, double min, double max)
+{
+	return (value < min) ? min : (value > max) ? max : value;
+}
+
+int32_t move_player(struct Player *p_player, double dx, double dy, struct REMap *map, int transparent_material)
+{
+	bool can_move_x = true;
+	bool can_move_y = true;
+
+	double x_new = p_player->x + dx;
+	double y_new = p_player->y + dy;
+
+	int64_t cell_x = (int64_t) p_player->x; // no floor--should never be negative
+	int64_t cell_y = (int64_t) p_player->y; // ^^^
+	int64_t cell_x_new = (int64_t) floor(x_new);
+	int64_t cell_y_new = (int64_t) floor(y_new);
+
+	// check x collision
+	if (cell_x != cell_x_new) {
+		if (!re_map_coords_in_bounds(map, cell_x_new, cell_y)) {
+			can_move_x = false;
+		} else {
+			struct REMapCell cell_current = re_map_get_cell(map, cell_x, cell_y);
+			struct REMapCell cell_new = re_map_get_cell(map, cell_x_new, cell_y);
+
+			int passed_wall_materials[2];
+			if (cell_x_new < cell_x) {
+				passed_wall_materials[0] = cell_current.material_left;
+				passed_wall_materials[1] = cell_new.material_right;
+			} else {
+				passed_wall_materials[0] = cell_current.material_right;
+				passed_wall_materials[1] = cell_new.material_left;
+			}
+
+			if (passed_wall_materials[0] != transparent_material || passed_wall_materials[1] != transparent_material) {
+				can_move_x = false;
+			}
+		}
+	}
+
+	// check y collision
+	if (cell_y != cell_y_new) {
+		if (!re_map_coords_in_bounds(map, cell_x, cell_y_new)) {
+			can_move_y = false;
+		} else {
+			struct REMapCell cell_current = re_map_get_cell(map, cell_x, cell_y);
+			struct REMapCell cell_new = re_map_get_cell(map, cell_x, cell_y_new);
+
+			int passed_wall_materials[2];
+			if (cell_y_new < cell_y) {
+				passed_wall_materials[0] = cell_current.material_bottom;
+				passed_wall_materials[1] = cell_new.material_top;
+			} else {
+				passed_wall_materials[0] = cell_current.material_top;
+				passed_wall_materials[1] = cell_new.material_bottom;
+			}
+
+			if (passed_wall_materials[0] != transparent_material || passed_wall_materials[1] != transparent_material) {
+				can_move_y = false;
+			}
+		}
+	}
+
+	// special case when crossing x and y at the same time
+	// (prevents walking through convex corners)
+	if (cell_x != cell_x_new && cell_y != cell_y_new && can_move_x && can_move_y) {
+		struct REMapCell cell_pass_x = re_map_get_cell(map, cell_x_new, cell_y);
+		struct REMapCell cell_pass_y = re_map_get_cell(map, cell_x, cell_y_new);
+		struct REMapCell cell_new = re_map_get_cell(map, cell_x_new, cell_y_new);
+
+		int passed_wall_materials[4];
+		if (cell_x_new < cell_x) {
+			passed_wall_materials[0] = cell_pass_x.material_left;
+			passed_wall_materials[1] = cell_new.material_right;
+		} else {
+			passed_wall_materials[0] = cell_pass_x.material_right;
+			passed_wall_materials[1] = cell_new.material_left;
+		}
+
+		if (cell_y_new < cell_y) {
+			passed_wall_materials[2] = cell_pass_y.material_bottom;
+			passed_wall_materials[3] = cell_new.material_top;
+		} else {
+			passed_wall_materials[2] = cell_pass_y.material_top;
+			passed_wall_materials[3] = cell_new.material_bottom;
+		}
+
+		if (passed_wall_materials[0] != transparent_material || passed_wall_materials[1] != transparent_material
+				|| passed_wall_materials[2] != transparent_material || passed_wall_materials[3] != transparent_material) {
+			
+			if (dx > dy) {
+				can_move_y = false;
+			} else {
+				can_move_x = false;
+			}
+		}
+	}
+
+	if (can_move_x) {
+		p_player->x += dx;
+	}
+	if (can_move_y) {
+		p_player->y += dy;
+	}
+
+	return can_move_x * 2 + can_move_y;
+}
+
+void angle_to_vector(struct BinaryAngle angle, double length, double *vx, double *vy)
+{
+	*vx = length * fixed64_to_double(binary_angle_cos(angle));
+	*vy = length * fixed64_to_double(binary_angle_sin(angle));
+}
@@ -0,0 +1,38 @@
+#ifndef simulation_h
+#define simulation_h
+
+#include <stdint.h>
+
+#include "../fixed/fixed.h"
+#include "../raycast-engine/raycast-engine.h"
+
+struct Player {
+	double x;
+	double y;
+	struct BinaryAngle rotation;
+	double velocity_x;
+	double velocity_y;
+	double angular_velocity;
+};
+
+/* Advances in fixed ticks of 1 / tick_rate seconds, independent of wall time and render rate */
+struct Simulation {
+	struct REMap *map;
+	int transparent_material;
+	double tick_seconds;
+	double damping; // velocity multiplier applied every tick
+	uint64_t tick_count;
+
+	struct Player player;
+	struct Player previous_player; // state before the last tick
+};
+
+struct Simulation *simulation_create(struct REMap *map, int transparent_material, struct Player player, double tick_rate);
+void simulation_destroy(struct Simulation *simulation);
+
+void simulation_apply_input(struct Simulation *simulation, char input);
+void simulation_step(struct Simulation *simulation);
+
+bool simulation_is_at_rest(struct Simulation *simulation);
+
+#endif // simulation_h
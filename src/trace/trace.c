@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../mem-utils/mem-macros.h"
+
+#ifdef MEM_DEBUG
+#include "../mem-utils/mem-debug.h"
+#endif // MEM_DEBUG
+
+#include "trace.h"
+
+#define NS_PER_SEC 1000000000L
+#define TRACE_BUFFER_CAPACITY (1 << 17)
+
+struct TraceEvent {
+	const char *name;
+	uint64_t time_ns;
+	char phase; // 'B'egin, 'E'nd or 'i'nstant
+};
+
+/* Written only by its own thread; other threads only read length (acquire) and the events before it */
+struct TraceBuffer {
+	struct TraceBuffer *next;
+	uint32_t thread_id;
+	const char *thread_name;
+	atomic_uint_fast32_t length;
+	uint64_t dropped_count;
+	struct TraceEvent events[];
+};
+
+atomic_bool trace_enabled = false;
+
+static char *trace_path = NULL;
+static uint64_t trace_start_ns = 0;
+static _Atomic(struct TraceBuffer *) trace_buffers = NULL;
+static atomic_uint_fast32_t next_thread_id = 1;
+static _Thread_local struct TraceBuffer *thread_buffer = NULL;
+
+static struct TraceBuffer *get_thread_buffer();
+static void record_event(const char *name, char phase);
+static uint64_t now_ns();
+static void write_json_string(FILE *file, const char *str);
+
+/* Returns false if tracing is already running */
+bool trace_start(const char *path)
+{
+	if (trace_is_enabled()) {
+		return false;
+	}
+
+	trace_path = ALLOC_STR_LENGTH(strlen(path));
+	strcpy(trace_path, path);
+
+	trace_start_ns = now_ns();
+	atomic_store(&trace_enabled, true);
+
+	return true;
+}
+
+/*
+ * Writes the trace and frees every thread's buffer. Must be called from the thread that called trace_start after
+ * all other traced threads have exited. Returns false if the file could not be written.
+ */
+bool trace_stop()
+{
+	if (!trace_is_enabled()) {
+		return false;
+	}
+	atomic_store(&trace_enabled, false);
+
+	FILE *file = fopen(trace_path, "w");
+	int pid = getpid();
+	bool first = true;
+
+	if (file != NULL) {
+		fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	}
+
+	struct TraceBuffer *buffer = atomic_exchange(&trace_buffers, NULL);
+	while (buffer != NULL) {
+		if (file != NULL) {
+			if (buffer->thread_name != NULL) {
+				fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":",
+						first ? "" : ",", pid, buffer->thread_id);
+				write_json_string(file, buffer->thread_name);
+				fprintf(file, "}}");
+				first = false;
+			}
+
+			uint_fast32_t length = atomic_load_explicit(&buffer->length, memory_order_acquire);
+			for (uint_fast32_t index = 0; index < length; index++) {
+				struct TraceEvent *event = &buffer->events[index];
+
+				fprintf(file, "%s\n{\"name\":", first ? "" : ",");
+				write_json_string(file, event->name);
+				fprintf(file, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u%s}", event->phase,
+						(event->time_ns - trace_start_ns) / 1000.0, pid, buffer->thread_id,
+						(event->phase == 'i') ? ",\"s\":\"t\"" : "");
+				first = false;
+			}
+
+			if (buffer->dropped_count > 0) {
+				fprintf(stderr, "trace: dropped %llu events on thread %u\n",
+						(unsigned long long) buffer->dropped_count, buffer->thread_id);
+			}
+		}
+
+		struct TraceBuffer *next = buffer->next;
+		free(buffer);
+		buffer = next;
+	}
+	thread_buffer = NULL;
+
+	bool written = false;
+	if (file != NULL) {
+		fprintf(file, "\n]}\n");
+		written = (fclose(file) == 0);
+	}
+
+	free(trace_path);
+	trace_path = NULL;
+
+	return written;
+}
+
+/* Labels the calling thread's track in the viewer */
+void trace_set_thread_name(const char *name)
+{
+	if (!trace_is_enabled()) {
+		return;
+	}
+
+	get_thread_buffer()->thread_name = name;
+}
+
+void trace_begin(const char *name)
+{
+	record_event(name, 'B');
+}
+
+void trace_end(const char *name)
+{
+	record_event(name, 'E');
+}
+
+void trace_instant(const char *name)
+{
+	record_event(name, 'i');
+}
+
+/* Allocated on a thread's first event and pushed onto the global list with a CAS */
+struct TraceBuffer *get_thread_buffer()
+{
+	if (thread_buffer != NULL) {
+		return thread_buffer;
+	}
+
+	struct TraceBuffer *buffer = ALLOC_FLEX_STRUCT(buffer, events, TRACE_BUFFER_CAPACITY);
+	buffer->thread_id = atomic_fetch_add(&next_thread_id, 1);
+	buffer->thread_name = NULL;
+	atomic_init(&buffer->length, 0);
+	buffer->dropped_count = 0;
+
+	buffer->next = atomic_load(&trace_buffers);
+	while (!atomic_compare_exchange_weak(&trace_buffers, &buffer->next, buffer)) {
+		// buffer->next was reloaded with the current head; retry
+	}
+
+	thread_buffer = buffer;
+
+	return buffer;
+}
+
+void record_event(const char *name, char phase)
+{
+	struct TraceBuffer *buffer = get_thread_buffer();
+	uint_fast32_t length = atomic_load_explicit(&buffer->length, memory_order_relaxed);
+
+	if (length == TRACE_BUFFER_CAPACITY) {
+		buffer->dropped_count++;
+		return;
+	}
+
+	buffer->events[length] = (struct TraceEvent) { .name = name, .time_ns = now_ns(), .phase = phase };
+	atomic_store_explicit(&buffer->length, length + 1, memory_order_release);
+}
+
+uint64_t now_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+void write_json_string(FILE *file, const char *str)
+{
+	fputc('"', file);
+	for (const char *ch = str; *ch != '\0'; ch++) {
+		if (*ch == '"' || *ch == '\\') {
+			fputc('\\', file);
+		}
+		fputc(*ch, file);
+	}
+	fputc('"', file);
+}
@@ -0,0 +1,33 @@
+#ifndef trace_h
+#define trace_h
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Opt-in timeline tracer that writes Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev). Every thread
+ * records into its own buffer, so recording takes no locks. Names must be string literals or otherwise outlive
+ * the trace. While tracing is off, the macros cost one relaxed load.
+ */
+#define TRACE_BEGIN(name) do { if (trace_is_enabled()) trace_begin(name); } while (0)
+#define TRACE_END(name) do { if (trace_is_enabled()) trace_end(name); } while (0)
+#define TRACE_INSTANT(name) do { if (trace_is_enabled()) trace_instant(name); } while (0)
+
+extern atomic_bool trace_enabled;
+
+static inline bool trace_is_enabled()
+{
+	return atomic_load_explicit(&trace_enabled, memory_order_relaxed);
+}
+
+bool trace_start(const char *path);
+bool trace_stop();
+
+void trace_set_thread_name(const char *name);
+
+void trace_begin(const char *name);
+void trace_end(const char *name);
+void trace_instant(const char *name);
+
+#endif // trace_h